@@ -0,0 +1,175 @@
+// Lectura de archivos y paquetes de recursos
+// Si hay un paquete abierto (paquete::abrir), los recursos se buscan primero en él y si no están se leen de disco
+// El paquete se mapea en memoria con una sola apertura del archivo, y las texturas y figuras se suben a la GPU
+// directamente desde el mapeo, sin copias intermedias
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+
+#include "debug.h"
+#include "paquete.h"
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tofu
+{
+    static_assert(paquete::hashNombre("tofu", 4) == fnv1a("tofu", 4), "Los nombres del paquete tienen que usar el mismo hash que los Id");
+
+    namespace detail
+    {
+        // Mapear un archivo completo en memoria, abriéndolo una sola vez
+        inline bool mapear(const fs::path& ruta, Mapeo& m) {
+            m = Mapeo{};
+            #ifdef _WIN32
+            HANDLE archivo = CreateFileW(ruta.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (archivo == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER tam;
+            GetFileSizeEx(archivo, &tam);
+            HANDLE objeto = tam.QuadPart > 0 ? CreateFileMappingW(archivo, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+            CloseHandle(archivo);
+            if (not objeto)
+                return false;
+            m.datos = (const ui8*)MapViewOfFile(objeto, FILE_MAP_READ, 0, 0, 0);
+            m.tam = tam.QuadPart;
+            m.objeto = objeto;
+            #else
+            int fd = open(ruta.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat info;
+            fstat(fd, &info);
+            void* datos = info.st_size > 0 ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            close(fd);
+            if (datos != MAP_FAILED) {
+                m.datos = (const ui8*)datos;
+                m.tam = info.st_size;
+            }
+            #endif
+            return m.datos != nullptr;
+        }
+
+        inline void desmapear(Mapeo& m) {
+            if (not m.datos)
+                return;
+            #ifdef _WIN32
+            UnmapViewOfFile(m.datos);
+            CloseHandle((HANDLE)m.objeto);
+            #else
+            munmap((void*)m.datos, m.tam);
+            #endif
+            m = Mapeo{};
+        }
+    }
+
+    namespace paquete
+    {
+        // Cerrar el paquete abierto
+        // Las texturas con streaming que apuntan al paquete tienen que liberarse antes
+        inline void cerrar() {
+            tofu::detail::desmapear(gl.paquete.mapeo);
+            gl.paquete = Paquete{};
+        }
+
+        // Abrir un paquete creado con tofu-pack y mapearlo en memoria
+        // Solo puede haber uno abierto a la vez, abrir otro cierra el anterior
+        inline bool abrir(const fs::path& ruta) {
+            cerrar();
+            Paquete& p = gl.paquete;
+            if (not tofu::detail::mapear(ruta, p.mapeo) or not leer(p.mapeo.datos, p.mapeo.tam, p.indice)) {
+                log::error("El paquete {} no es válido", ruta.string());
+                cerrar();
+                return false;
+            }
+            log::info("Paquete {}: {} recursos, {} KiB mapeados", ruta.string(), p.indice.num_entradas, p.mapeo.tam / 1024);
+            return true;
+        }
+
+        // Buscar un recurso en el paquete abierto
+        inline const Entrada* buscar(const str& nombre, ui32 tipo = ARCHIVO) {
+            Paquete& p = gl.paquete;
+            if (not p.mapeo.datos)
+                return nullptr;
+            const Entrada* e = buscar(p.indice, nombre.data(), nombre.size());
+            return e and e->tipo == tipo ? e : nullptr;
+        }
+
+        // Datos de un recurso del paquete, apuntando a la memoria mapeada
+        inline std::optional<Archivo> leer(const str& nombre, ui32 tipo = ARCHIVO) {
+            const Entrada* e = buscar(nombre, tipo);
+            if (not e)
+                return std::nullopt;
+            return Archivo(gl.paquete.mapeo.datos + e->offset, e->tam);
+        }
+    }
+
+    namespace detail
+    {
+        // Los recursos se guardan en el paquete con su ruta relativa, separada con '/'
+        inline str nombrePaquete(const fs::path& path) {
+            return path.lexically_normal().generic_string();
+        }
+
+        inline std::optional<str> leerArchivo(fs::path path) {
+            // Primero lo buscamos en el paquete
+            if (gl.paquete.mapeo.datos) {
+                if (auto a = paquete::leer(nombrePaquete(path)))
+                    return str((const char*)a->datos, a->tam);
+            }
+
+            // Comprobamos que el directorio existe
+            if (not fs::exists(path))
+                return std::nullopt;
+
+            // Abrimos el fichero
+            std::ifstream in(path.string());
+            if (not in.is_open()) {
+                log::error("No se ha podido abrir el archivo: {}", path.string());
+                std::exit(-1);
+            }
+
+            // Devolvemos su contenido
+            str src((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            return src;
+        }
+
+        // Leer un archivo binario completo (por ejemplo, una imagen antes de decodificarla)
+        // Si está en el paquete no se copia, se devuelve la memoria mapeada
+        inline std::optional<Archivo> leerBinario(fs::path path) {
+            if (gl.paquete.mapeo.datos) {
+                if (auto a = paquete::leer(nombrePaquete(path)))
+                    return a;
+            }
+
+            if (not fs::exists(path))
+                return std::nullopt;
+
+            std::ifstream in(path.string(), std::ios::binary);
+            if (not in.is_open()) {
+                log::error("No se ha podido abrir el archivo: {}", path.string());
+                std::exit(-1);
+            }
+
+            std::vector<ui8> datos(fs::file_size(path));
+            in.read((char*)datos.data(), datos.size());
+            return Archivo(std::move(datos));
+        }
+    }
+}
@@ -4,6 +4,9 @@
 #include <numeric>
 
 #include "debug.h"
+#include "hash.h"
+#include "ktx.h"
+#include "shaders.h"
 #include "stb_image.h"
 
 namespace tofu
@@ -54,15 +57,15 @@ namespace tofu
             // Guardamos la nueva referencia
             buf.buffer = nuevo;
             buf.tam = tam_nuevo;
+            buf.version++;
 
             debug::gl();
         }
 
         // Cargar datos en un buffer
         template <typename T>
-        void cargar(ui32 buffer, std::vector<T> datos, ui32 pos = 0) {
+        void cargar(ui32 buffer, const T* datos, ui32 tam, ui32 pos = 0) {
             Buffer& buf = gl.buffers[buffer];
-            ui32 tam = datos.size();
             
             // Redimensionar el buffer si es necesario
             if (pos + tam > buf.tam)
@@ -70,30 +73,103 @@ namespace tofu
 
             // Cargamos los datos
             glBindBuffer(buf.tipo, buf.buffer);
-            glBufferSubData(buf.tipo, pos * buf.bytes, tam * buf.bytes, datos.data());
+            glBufferSubData(buf.tipo, pos * buf.bytes, tam * buf.bytes, datos);
+
+            debug::gl();
+        }
+
+        template <typename T>
+        void cargar(ui32 buffer, const std::vector<T>& datos, ui32 pos = 0) {
+            cargar(buffer, datos.data(), datos.size(), pos);
+        }
+
+        // Reemplazar todo el contenido de un buffer que cambia cada frame (por ejemplo, las instancias visibles)
+        // Se pide almacenamiento nuevo antes de escribir (orphaning), así el driver no espera a que la GPU deje de leer el anterior
+        template <typename T>
+        void reemplazar(ui32 buffer, const T* datos, ui32 tam) {
+            Buffer& buf = gl.buffers[buffer];
+            glBindBuffer(buf.tipo, buf.buffer);
+            glBufferData(buf.tipo, std::max(tam, buf.tam) * buf.bytes, nullptr, GL_STREAM_DRAW);
+            if (tam > 0)
+                glBufferSubData(buf.tipo, 0, tam * buf.bytes, datos);
+            if (tam > buf.tam) {
+                buf.tam = tam;
+                buf.version++;
+            }
+            debug::gl();
+        }
+
+        // Poner a cero un rango de un buffer en la GPU (glClearBufferSubData es de OpenGL 4.3)
+        // Se copia de un buffer de ceros compartido, que solo se sube de nuevo cuando hace falta uno más grande
+        inline void borrar(ui32 buffer, ui32 tam, ui32 pos = 0) {
+            Buffer& buf = gl.buffers[buffer];
+            ui32 bytes = tam * buf.bytes;
+            if (gl.buffer_ceros < 0)
+                gl.buffer_ceros = crear(GL_COPY_READ_BUFFER, std::vector<ui8>{});
+            Buffer& ceros = gl.buffers[gl.buffer_ceros];
+            glBindBuffer(GL_COPY_READ_BUFFER, ceros.buffer);
+            if (ceros.tam < bytes) {
+                std::vector<ui8> datos(bytes, 0);
+                glBufferData(GL_COPY_READ_BUFFER, bytes, datos.data(), GL_STATIC_DRAW);
+                ceros.tam = bytes;
+            }
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buf.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, pos * buf.bytes, bytes);
+            debug::gl();
+        }
+
+        // Mapear una parte de un buffer para escribir en ella directamente
+        // Los datos anteriores de ese rango se descartan, así el driver no tiene que esperar a que la GPU termine de usarlos
+        // Hay que llamar a glUnmapBuffer con el buffer vinculado antes de dibujar
+        template <typename T>
+        T* mapear(ui32 buffer, ui32 tam, ui32 pos = 0) {
+            Buffer& buf = gl.buffers[buffer];
+            if (pos + tam > buf.tam)
+                redimensionar(buffer, pos + tam);
 
+            glBindBuffer(buf.tipo, buf.buffer);
+            T* datos = (T*)glMapBufferRange(buf.tipo, pos * buf.bytes, tam * buf.bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
             debug::gl();
+            return datos;
         }
 
         // Inicializamos los buffers principales de OpenGL
-        inline void iniciarVAO(std::vector<ui32> attr, str n = "main", ui32 vert_alloc = 0, ui32 ind_alloc = 0) {
+        inline void iniciarVAO(std::vector<ui32> attr, VaoId n = "main"_id, ui32 vert_alloc = 0, ui32 ind_alloc = 0) {
             // VAO
-            glGenVertexArrays(1, &gl.VAOs[n].vao);
+            VAO& v = gl.VAOs[internar(n)];
+            glGenVertexArrays(1, &v.vao);
 
             // Creamos los buffers de vértices e índices
-            gl.VAOs[n].vbo = crear(GL_ARRAY_BUFFER, std::vector<float>(vert_alloc), GL_STATIC_DRAW);
-            gl.VAOs[n].ebo = crear(GL_ELEMENT_ARRAY_BUFFER, std::vector<ui32>(ind_alloc), GL_STATIC_DRAW);
+            v.vbo = crear(GL_ARRAY_BUFFER, std::vector<float>(vert_alloc), GL_STATIC_DRAW);
+            v.ebo = crear(GL_ELEMENT_ARRAY_BUFFER, std::vector<ui32>(ind_alloc), GL_STATIC_DRAW);
 
             // Guardamos los atributos del VAO
-            gl.VAOs[n].atributos = attr;
+            v.atributos = attr;
 
             debug::gl();
         }
 
+        // Apuntar los atributos por instancia del VAO activo a partir de la instancia base
+        // OpenGL 3.3 no tiene glDrawElementsInstancedBaseInstance (4.2), así que antes de cada dibujo
+        // se mueve el offset de los punteros hasta la primera instancia, igual que hace baseins con texelFetch
+        inline void enlazarInstancias(const VAO& v, ui32 base) {
+            ui32 loc = v.atributos.size();
+            for (auto& s : v.por_instancia) {
+                ui32 tam = std::accumulate(s.atributos.begin(), s.atributos.end(), 0) * sizeof(float);
+                ui64 offset = (ui64)base * tam;
+                glBindBuffer(GL_ARRAY_BUFFER, gl.buffers[s.buffer].buffer);
+                for (ui32 a : s.atributos) {
+                    glVertexAttribPointer(loc++, a, GL_FLOAT, GL_FALSE, tam, (void*)offset);
+                    offset += a * sizeof(float);
+                }
+            }
+        }
+
         // Configurar el VAO y sus atributos
-        inline void configurarVAO(str n) {
+        inline void configurarVAO(VaoId n) {
             if (gl.VAOs.find(n) == gl.VAOs.end()) {
-                log::error("No existe el VAO " + n);
+                log::error("No existe el VAO {}", n);
                 std::exit(-1);
             }
             VAO& v = gl.VAOs[n];
@@ -103,6 +179,7 @@ namespace tofu
             }
 
             glBindVertexArray(v.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, gl.buffers[v.vbo].buffer);
             ui32 tam_total = std::accumulate(v.atributos.begin(), v.atributos.end(), 0);
             ui32 attr_offset = 0;
             for (ui32 i = 0; i < v.atributos.size(); i++) {
@@ -111,6 +188,37 @@ namespace tofu
                 attr_offset += v.atributos[i];
             }
 
+            // Los atributos por instancia van a continuación de los de vértice
+            ui32 loc = v.atributos.size();
+            for (auto& s : v.por_instancia) {
+                for (ui32 a = 0; a < s.atributos.size(); a++, loc++) {
+                    glEnableVertexAttribArray(loc);
+                    glVertexAttribDivisor(loc, 1);
+                }
+            }
+            enlazarInstancias(v, 0);
+
+            debug::gl();
+        }
+
+        // Añadir al VAO atributos que avanzan una vez por instancia en vez de por vértice, leídos de un buffer
+        // Es una alternativa a leer los datos de la instancia con texelFetch de un TexBuffer
+        // Por ejemplo, una matriz de modelo por instancia: atributosInstancia("main", buf_modelos.b, { 4, 4, 4, 4 })
+        // En la shader se declaran tras los de vértice: layout (location = 1) in mat4 in_modelo;
+        inline void atributosInstancia(VaoId n, ui32 buffer, std::vector<ui32> attr) {
+            gl.VAOs[n].por_instancia.push_back({ buffer, attr });
+            configurarVAO(n);
+        }
+
+        // Quitar todos los atributos por instancia del VAO
+        inline void quitarAtributosInstancia(VaoId n) {
+            VAO& v = gl.VAOs[n];
+            glBindVertexArray(v.vao);
+            ui32 loc = v.atributos.size();
+            for (auto& s : v.por_instancia)
+                for (ui32 a = 0; a < s.atributos.size(); a++)
+                    glDisableVertexAttribArray(loc++);
+            v.por_instancia.clear();
             debug::gl();
         }
 
@@ -127,50 +235,135 @@ namespace tofu
             return pos;
         }
 
-        // Cargar los datos de los vértices en la GPU (sin índices)
-        inline void cargarVert(str nombre, std::vector<float> vertices, str vao = "main", ui32 tipo_dibujo = GL_TRIANGLES) {
-            // Activar el VAO
-            glBindVertexArray(gl.VAOs[vao].vao);
-
-            // Obtener últimas posiciones utilizadas
+        // Reservar el sitio de una geometría nueva a continuación de la última
+        // Los índices también avanzan en las geometrías sin índices, para no pisar los de la anterior
+        inline Geometria reservarVert(ui32 num_vert, ui32 num_ind, ui32 tipo_dibujo) {
             Geometria pos = ultimaPosVert();
             pos.voff += pos.vcount;
-            pos.vcount = vertices.size();
-            pos.icount = 0;
+            pos.vcount = num_vert;
+            pos.ioff += pos.icount;
+            pos.icount = num_ind;
             pos.tipo_dibujo = tipo_dibujo;
+            return pos;
+        }
+
+        // Cargar los datos de los vértices en la GPU
+        // Si no hay índices se dibuja con glDrawArrays
+        inline void cargarVert(GeomId nombre, const float* vertices, ui32 num_vert, const ui32* indices, ui32 num_ind, VaoId vao = "main"_id, ui32 tipo_dibujo = GL_TRIANGLES) {
+            // Activar el VAO
+            VAO& v = gl.VAOs[vao];
+            glBindVertexArray(v.vao);
 
-            // Añadir vértices
-            cargar(gl.VAOs[vao].vbo, vertices, pos.voff);
+            // Añadir vértices e índices en las últimas posiciones utilizadas
+            Geometria pos = reservarVert(num_vert, num_ind, tipo_dibujo);
+            cargar(v.vbo, vertices, num_vert, pos.voff);
+            if (num_ind > 0)
+                cargar(v.ebo, indices, num_ind, pos.ioff);
 
             // Guardar la posición de la geometría
-            gl.geometrias[nombre] = pos;
+            gl.geometrias[internar(nombre)] = pos;
 
             debug::gl();
             configurarVAO(vao);
         }
 
-        // Cargar los datos de los vértices en la GPU (con índices)
-        inline void cargarVert(str nombre, std::pair<std::vector<float>, std::vector<ui32>> vertices, str vao = "main", ui32 tipo_dibujo = GL_TRIANGLES) {
-            // Activar el VAO
-            glBindVertexArray(gl.VAOs[vao].vao);
+        // Sin índices
+        inline void cargarVert(GeomId nombre, const std::vector<float>& vertices, VaoId vao = "main"_id, ui32 tipo_dibujo = GL_TRIANGLES) {
+            cargarVert(nombre, vertices.data(), vertices.size(), nullptr, 0, vao, tipo_dibujo);
+        }
 
-            // Obtener últimas posiciones utilizadas
-            Geometria pos = ultimaPosVert();
-            pos.voff += pos.vcount;
-            pos.vcount = vertices.first.size();
-            pos.ioff += pos.icount;
-            pos.icount = vertices.second.size();
-            pos.tipo_dibujo = tipo_dibujo;
+        // Con índices
+        inline void cargarVert(GeomId nombre, const std::pair<std::vector<float>, std::vector<ui32>>& vertices, VaoId vao = "main"_id, ui32 tipo_dibujo = GL_TRIANGLES) {
+            cargarVert(nombre, vertices.first.data(), vertices.first.size(), vertices.second.data(), vertices.second.size(), vao, tipo_dibujo);
+        }
 
-            // Añadir vértices e índices
-            cargar(gl.VAOs[vao].vbo, vertices.first, pos.voff);
-            cargar(gl.VAOs[vao].ebo, vertices.second, pos.ioff);
+        // Geometrías fijas generadas al compilar (geometria::cubo, geometria::esferaOctFija...)
+        template <size_t V, size_t I>
+        void cargarVert(GeomId nombre, const std::pair<std::array<float, V>, std::array<ui32, I>>& vertices, VaoId vao = "main"_id, ui32 tipo_dibujo = GL_TRIANGLES) {
+            cargarVert(nombre, vertices.first.data(), V, vertices.second.data(), I, vao, tipo_dibujo);
+        }
 
-            // Guardar la posición de la geometría
-            gl.geometrias[nombre] = pos;
+        // Cargar una figura guardada en el paquete de recursos (tofu-pack -m)
+        // Los vértices e índices se suben directamente desde la memoria mapeada
+        // Devuelve false si no hay paquete o no contiene esa figura, para poder generarla en su lugar
+        inline bool cargarMalla(GeomId nombre, VaoId vao = "main"_id) {
+            auto a = paquete::leer(nombre.texto, paquete::MALLA);
+            if (not a)
+                return false;
+
+            paquete::CabeceraMalla cab;
+            std::memcpy(&cab, a->datos, sizeof(cab));
+            if (sizeof(cab) + (ui64)cab.num_vert * sizeof(float) + (ui64)cab.num_ind * sizeof(ui32) + (ui64)cab.num_clusters * sizeof(Cluster) > a->tam) {
+                log::error("La figura {} del paquete está incompleta", nombre);
+                std::exit(-1);
+            }
+            const float* vertices = (const float*)(a->datos + sizeof(cab));
+            const ui32* indices = (const ui32*)(vertices + cab.num_vert);
+            cargarVert(nombre, vertices, cab.num_vert, indices, cab.num_ind, vao, cab.tipo_dibujo);
+
+            // Clusters guardados con tofu-pack -c, los índices ya vienen ordenados
+            if (cab.num_clusters > 0) {
+                const Cluster* c = (const Cluster*)(indices + cab.num_ind);
+                gl.clusters[internar(nombre)].assign(c, c + cab.num_clusters);
+            }
+            return true;
+        }
+
+        // Cargar una geometría agrupada en clusters, para dibujarla con dibujarClusters
+        // Los índices se reordenan en una copia antes de subirlos, la posición tiene que ser el primer atributo del VAO
+        inline void cargarVertClusters(GeomId nombre, const float* vertices, ui32 num_vert, std::vector<ui32> indices, VaoId vao = "main"_id) {
+            const VAO& v = gl.VAOs[vao];
+            ui32 stride = std::accumulate(v.atributos.begin(), v.atributos.end(), 0);
+            auto c = clusters::agrupar(vertices, num_vert, stride, indices.data(), indices.size());
+            cargarVert(nombre, vertices, num_vert, indices.data(), indices.size(), vao);
+            gl.clusters[internar(nombre)] = std::move(c);
+        }
+
+        inline void cargarVertClusters(GeomId nombre, const std::pair<std::vector<float>, std::vector<ui32>>& vertices, VaoId vao = "main"_id) {
+            cargarVertClusters(nombre, vertices.first.data(), vertices.first.size(), vertices.second, vao);
+        }
+
+        // Generar los vértices directamente en los buffers de la GPU, sin copias intermedias
+        // generar recibe la memoria mapeada para num_vert floats y num_ind índices, por ejemplo:
+        //     generarVert("esfera"_id, geometria::verticesEsferaOct(n) * 3, geometria::indicesEsferaOct(n),
+        //                 [n](float* v, ui32* i){ geometria::esferaOct(n, v, i); });
+        // En la web no se pueden mapear buffers, así que se genera en memoria y se sube
+        template <typename F>
+        void generarVert(GeomId nombre, ui32 num_vert, ui32 num_ind, F generar, VaoId vao = "main"_id, ui32 tipo_dibujo = GL_TRIANGLES) {
+            #ifdef EMSCRIPTEN
+            std::vector<float> vertices(num_vert);
+            std::vector<ui32> indices(num_ind);
+            generar(vertices.data(), indices.data());
+            cargarVert(nombre, vertices.data(), num_vert, indices.data(), num_ind, vao, tipo_dibujo);
+            #else
+            VAO& v = gl.VAOs[vao];
+            glBindVertexArray(v.vao);
+
+            Geometria pos = reservarVert(num_vert, num_ind, tipo_dibujo);
+            float* vertices = mapear<float>(v.vbo, num_vert, pos.voff);
+            ui32* indices = num_ind > 0 ? mapear<ui32>(v.ebo, num_ind, pos.ioff) : nullptr;
+            if (not vertices or (num_ind > 0 and not indices)) {
+                log::error("No se ha podido mapear el buffer de la geometría {}", nombre);
+                std::exit(-1);
+            }
+            generar(vertices, indices);
+
+            // El driver avisa al desmapear si el contenido se ha perdido mientras tanto (por ejemplo, al cambiar de modo de pantalla)
+            bool ok = true;
+            glBindBuffer(GL_ARRAY_BUFFER, gl.buffers[v.vbo].buffer);
+            ok &= glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+            if (num_ind > 0) {
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.buffers[v.ebo].buffer);
+                ok &= glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE;
+            }
+            if (not ok)
+                log::warn("Se han perdido los datos mapeados de la geometría {}", nombre);
+
+            gl.geometrias[internar(nombre)] = pos;
 
             debug::gl();
             configurarVAO(vao);
+            #endif
         }
     }
 
@@ -197,19 +390,41 @@ namespace tofu
             return indice;
         }
 
+        // Comprobar si un formato es de profundidad (con o sin stencil)
+        inline bool esProfundidad(ui32 fint) {
+            return fint == GL_DEPTH_COMPONENT24 or fint == GL_DEPTH_COMPONENT32F or fint == GL_DEPTH24_STENCIL8 or fint == GL_DEPTH32F_STENCIL8;
+        }
+
+        // Bytes por píxel de un formato
+        inline ui32 bytesPixel(ui32 fint) {
+            switch (fint) {
+                case GL_R8: return 1;
+                case GL_RG8: case GL_R16F: return 2;
+                case GL_RGBA8: case GL_RGB10_A2: case GL_R11F_G11F_B10F: case GL_RG16F:
+                case GL_R32F: case GL_R32I: case GL_R32UI:
+                case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: return 4;
+                case GL_RGBA16F: case GL_RG32F: case GL_RG32I: case GL_RG32UI: case GL_DEPTH32F_STENCIL8: return 8;
+                case GL_RGB32F: case GL_RGB32I: case GL_RGB32UI: return 12;
+                case GL_RGBA32F: case GL_RGBA32I: case GL_RGBA32UI: return 16;
+                default: return 4;
+            }
+        }
+
         // Transformar el formato combinado a un formato simple
         inline ui32 fi_a_formato(ui32 fint) {
             ui32 formato;
 
-            if (fint == GL_R32F or fint == GL_R32I or fint == GL_R32UI)
+            if (fint == GL_R32F or fint == GL_R32I or fint == GL_R32UI or fint == GL_R8 or fint == GL_R16F)
                 formato = GL_RED;
-            else if (fint == GL_RG32F or fint == GL_RG32I or fint == GL_RG32UI)
+            else if (fint == GL_RG32F or fint == GL_RG32I or fint == GL_RG32UI or fint == GL_RG8 or fint == GL_RG16F)
                 formato = GL_RG;
-            else if (fint == GL_RGB32F or fint == GL_RGB32I or fint == GL_RGB32UI)
+            else if (fint == GL_RGB32F or fint == GL_RGB32I or fint == GL_RGB32UI or fint == GL_R11F_G11F_B10F)
                 formato = GL_RGB;
-            else if (fint == GL_RGBA32F or fint == GL_RGBA32I or fint == GL_RGBA32UI)
+            else if (fint == GL_RGBA32F or fint == GL_RGBA32I or fint == GL_RGBA32UI or fint == GL_RGBA8 or fint == GL_RGB10_A2 or fint == GL_RGBA16F)
                 formato = GL_RGBA;
-            else if (fint == GL_DEPTH24_STENCIL8)
+            else if (fint == GL_DEPTH_COMPONENT24 or fint == GL_DEPTH_COMPONENT32F)
+                formato = GL_DEPTH_COMPONENT;
+            else if (fint == GL_DEPTH24_STENCIL8 or fint == GL_DEPTH32F_STENCIL8)
                 formato = GL_DEPTH_STENCIL;
             else {
                 log::error("Formato de textura no soportado");
@@ -223,14 +438,24 @@ namespace tofu
         inline ui32 fi_a_tipo(ui32 fint) {
             ui32 tipo;
 
-            if (fint == GL_R32F or fint == GL_RG32F or fint == GL_RGB32F or fint == GL_RGBA32F)
+            if (fint == GL_R32F or fint == GL_RG32F or fint == GL_RGB32F or fint == GL_RGBA32F or fint == GL_DEPTH_COMPONENT32F)
                 tipo = GL_FLOAT;
             else if (fint == GL_R32I or fint == GL_RG32I or fint == GL_RGB32I or fint == GL_RGBA32I)
                 tipo = GL_INT;
-            else if (fint == GL_R32UI or fint == GL_RG32UI or fint == GL_RGB32UI or fint == GL_RGBA32UI)
+            else if (fint == GL_R32UI or fint == GL_RG32UI or fint == GL_RGB32UI or fint == GL_RGBA32UI or fint == GL_DEPTH_COMPONENT24)
                 tipo = GL_UNSIGNED_INT;
+            else if (fint == GL_R8 or fint == GL_RG8 or fint == GL_RGBA8)
+                tipo = GL_UNSIGNED_BYTE;
+            else if (fint == GL_R16F or fint == GL_RG16F or fint == GL_RGBA16F)
+                tipo = GL_HALF_FLOAT;
+            else if (fint == GL_RGB10_A2)
+                tipo = GL_UNSIGNED_INT_2_10_10_10_REV;
+            else if (fint == GL_R11F_G11F_B10F)
+                tipo = GL_UNSIGNED_INT_10F_11F_11F_REV;
             else if (fint == GL_DEPTH24_STENCIL8)
                 tipo = GL_UNSIGNED_INT_24_8;
+            else if (fint == GL_DEPTH32F_STENCIL8)
+                tipo = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
             else {
                 log::error("Formato de textura no soportado");
                 std::exit(-1);
@@ -239,85 +464,340 @@ namespace tofu
             return tipo;
         }
 
+        namespace detail
+        {
+            inline str hash_str(const std::vector<str>& v) {
+                str hash = "";
+                for (auto i : v)
+                    hash += i + ";";
+                return hash;
+            }
+
+            // Clave del contenido de una imagen: hash del archivo y de los parámetros de decodificación (volteo vertical, 4 canales)
+            inline ui64 claveContenido(const Archivo& bytes) {
+                const ui64 parametros = hash::combinar(1, 4);
+                return hash::xxh64(bytes.datos, bytes.tam, parametros);
+            }
+
+            // Si una clave ya está cargada, reutilizamos la textura y contamos una referencia más
+            inline std::optional<ui32> buscarCache(ui64 clave, const str& nombre) {
+                CacheImagenes& cache = gl.cache_imagenes;
+                auto it = cache.entradas.find(clave);
+                if (it == cache.entradas.end()) {
+                    cache.fallos++;
+                    return std::nullopt;
+                }
+
+                it->second.refs++;
+                cache.aciertos++;
+                cache.bytes_ahorrados += it->second.bytes;
+                gl.imagenes[nombre] = it->second.textura;
+                return it->second.textura;
+            }
+
+            // Copia en la GPU una imagen ya cargada en otra textura a una capa de un array, sin decodificarla de nuevo
+            inline void copiarCapa(UbicacionImagen origen, Textura& destino, ui32 capa) {
+                Textura& src = gl.texturas[origen.textura];
+
+                ui32 fbo;
+                glGenFramebuffers(1, &fbo);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+                if (src.target == GL_TEXTURE_2D_ARRAY)
+                    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, src.textura, 0, origen.capa);
+                else
+                    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, src.target, src.textura, 0);
+                glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+                vincularCarga(destino);
+                glCopyTexSubImage3D(destino.target, 0, 0, 0, capa, 0, 0, destino.tam.x, destino.tam.y);
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+                glDeleteFramebuffers(1, &fbo);
+                debug::gl();
+            }
+        }
+
         // Cargar una imágen a una textura
+        // Si otra ruta ya cargó una imagen con el mismo contenido, se reutiliza su textura
         inline void cargar(str imagen) {
-            // Cargar la imágen a memoria
+            // Leemos el archivo y buscamos su contenido en la caché
+            auto bytes = tofu::detail::leerBinario(imagen);
+            if (not bytes) {
+                log::error("No se pudo cargar la textura {}", imagen);
+                std::exit(-1);
+            }
+            ui64 contenido = detail::claveContenido(*bytes);
+            ui64 clave = hash::combinar(contenido, GL_TEXTURE_2D);
+            if (detail::buscarCache(clave, imagen))
+                return;
+
+            // Decodificar la imágen a memoria
             int w, h, ch;
             stbi_set_flip_vertically_on_load(true);
-            ui8* data = stbi_load(imagen.c_str(), &w, &h, &ch, 0);
+            ui8* data = stbi_load_from_memory(bytes->datos, bytes->tam, &w, &h, &ch, 4);
             if (!data) {
                 log::error("No se pudo cargar la textura {}", imagen);
                 std::exit(-1);
             }
 
             // Creamos la textura
-            ui32 tex_id = crear(GL_TEXTURE_2D, GL_RGBA32UI, 0, 0, glm::ivec2(w, h));
+            ui32 tex_id = crear(GL_TEXTURE_2D, GL_RGBA8, 0, 0, glm::ivec2(w, h));
             Textura& tex = gl.texturas[tex_id];
             gl.imagenes[imagen] = tex_id;
 
             // Añadir la imagen a la textura
-            glBindTexture(tex.target, tex.textura);
+            detail::vincularCarga(tex);
             glTexImage2D(tex.target, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            tex.sampler = sampler::obtener(GL_LINEAR, GL_LINEAR, GL_REPEAT);
             debug::gl();
 
             stbi_image_free(data);
-        }
 
-        namespace detail
-        {
-            inline str hash_str(const std::vector<str>& v) {
-                str hash = "";
-                for (auto i : v)
-                    hash += i + ";";
-                return hash;
-            }
+            // Guardamos la entrada en la caché
+            gl.cache_imagenes.entradas[clave] = { tex_id, 1, (ui64)w * h * 4 };
+            gl.cache_imagenes.capas[contenido] = { tex_id, 0 };
         }
 
+        // Cargar varias imágenes del mismo tamaño a un array de texturas
+        // Las imágenes repetidas (dentro del array o ya cargadas en otra textura) no se vuelven a decodificar
         inline str cargar(std::vector<str> imagenes) {
-            // Cargar la imágen a memoria
-            int w, h, ch;
-            stbi_set_flip_vertically_on_load(true);
-            std::vector<ui8*> datos;
-            
+            str nombre = detail::hash_str(imagenes);
+            CacheImagenes& cache = gl.cache_imagenes;
+
+            // Leemos los archivos y calculamos sus claves de contenido
+            std::vector<Archivo> bytes;
+            std::vector<ui64> claves;
             for (auto i : imagenes) {
-                ui8* d = stbi_load(i.c_str(), &w, &h, &ch, 4);
-                if (!d) {
+                auto b = tofu::detail::leerBinario(i);
+                if (not b) {
                     log::error("No se pudo cargar la textura {}", i);
                     std::exit(-1);
                 }
-                datos.push_back(d);
+                claves.push_back(detail::claveContenido(*b));
+                bytes.push_back(std::move(*b));
+            }
+
+            // Si el array completo ya existe lo devolvemos directamente
+            ui64 clave = hash::xxh64(claves.data(), claves.size() * sizeof(ui64), GL_TEXTURE_2D_ARRAY);
+            if (detail::buscarCache(clave, nombre))
+                return nombre;
+
+            // Comprobamos el tamaño de las imágenes sin decodificarlas
+            int w = 0, h = 0, ch;
+            for (ui32 i = 0; i < imagenes.size(); i++) {
+                int iw, ih;
+                if (not stbi_info_from_memory(bytes[i].datos, bytes[i].tam, &iw, &ih, &ch)) {
+                    log::error("No se pudo cargar la textura {}", imagenes[i]);
+                    std::exit(-1);
+                }
+                if (i > 0 and (iw != w or ih != h)) {
+                    log::error("Las imágenes de un array de texturas tienen que tener el mismo tamaño: {}", imagenes[i]);
+                    std::exit(-1);
+                }
+                w = iw; h = ih;
             }
 
             // Creamos la textura
             ui32 tex_id = crear(GL_TEXTURE_2D_ARRAY, GL_RGBA8, 0, 0, glm::ivec2(w, h));
             Textura& tex = gl.texturas[tex_id];
-            gl.imagenes[detail::hash_str(imagenes)] = tex_id;
+            gl.imagenes[nombre] = tex_id;
 
-            // Añadir la imagen a la textura
-            glBindTexture(tex.target, tex.textura);
-            glTexImage3D(tex.target, 0, GL_RGBA, w, h, datos.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-            for (int i = 0; i < datos.size(); i++)
-                glTexSubImage3D(tex.target, 0, 0, 0, i, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, datos[i]);
+            detail::vincularCarga(tex);
+            glTexImage3D(tex.target, 0, GL_RGBA, w, h, imagenes.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 
-            glTexParameteri(tex.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(tex.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(tex.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(tex.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            // Añadir cada imagen a su capa
+            // - Si ya está en otra textura del mismo tamaño, la copiamos en la GPU
+            // - Si se repite dentro de este array, subimos los mismos datos decodificados
+            // - Si no, la decodificamos
+            const ui64 bytes_capa = (ui64)w * h * 4;
+            std::unordered_map<ui64, ui8*> decodificadas;
+            stbi_set_flip_vertically_on_load(true);
+            for (ui32 i = 0; i < imagenes.size(); i++) {
+                auto ubicacion = cache.capas.find(claves[i]);
+                if (ubicacion != cache.capas.end() and gl.texturas[ubicacion->second.textura].tam == tex.tam) {
+                    detail::copiarCapa(ubicacion->second, tex, i);
+                    cache.aciertos++;
+                    cache.bytes_ahorrados += bytes_capa;
+                    continue;
+                }
+
+                ui8*& d = decodificadas[claves[i]];
+                if (d != nullptr) {
+                    cache.aciertos++;
+                    cache.bytes_ahorrados += bytes_capa;
+                } else {
+                    d = stbi_load_from_memory(bytes[i].datos, bytes[i].tam, &w, &h, &ch, 4);
+                    if (!d) {
+                        log::error("No se pudo cargar la textura {}", imagenes[i]);
+                        std::exit(-1);
+                    }
+                }
+                detail::vincularCarga(tex);
+                glTexSubImage3D(tex.target, 0, 0, 0, i, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, d);
+            }
 
+            tex.sampler = sampler::obtener(GL_LINEAR);
             debug::gl();
 
-            for (auto d : datos)
+            for (auto [c, d] : decodificadas)
                 stbi_image_free(d);
 
-            return detail::hash_str(imagenes);
+            // Guardamos las entradas en la caché
+            cache.entradas[clave] = { tex_id, 1, bytes_capa * imagenes.size() };
+            for (ui32 i = 0; i < imagenes.size(); i++)
+                if (not cache.capas.count(claves[i]))
+                    cache.capas[claves[i]] = { tex_id, i };
+
+            return nombre;
+        }
+
+        // Comprobar si la GPU puede muestrear directamente un formato comprimido
+        inline bool formatoSoportado(ui32 formato) {
+            switch (formato) {
+                case ktx::BC1: case ktx::BC3: return extension("GL_EXT_texture_compression_s3tc");
+                case ktx::BC7: return extension("GL_ARB_texture_compression_bptc");
+                case ktx::BC4: case ktx::BC5: return true; // RGTC es core desde OpenGL 3.0
+                default: return false;
+            }
+        }
+
+        namespace detail
+        {
+            // Subir un nivel de mipmap (con todas sus capas) de un archivo KTX a una textura ya vinculada
+            // Si la textura no usa el formato comprimido del archivo, se descomprime en la CPU a RGBA8
+            // Devuelve los bytes que ocupa en la GPU
+            inline ui64 subirNivel(const Textura& tex, ui32 l, ui32 formato_archivo, const ktx::Nivel& n, ui32 capas) {
+                const ui8* datos = n.datos;
+                ui32 tam = n.bytes_capa * capas;
+                bool comprimido = ktx::bytesBloque(formato_archivo) > 0;
+
+                std::vector<ui8> rgba;
+                if (comprimido and tex.formato != formato_archivo) {
+                    rgba.resize(n.ancho * n.alto * 4 * capas);
+                    for (ui32 c = 0; c < capas; c++)
+                        if (not ktx::decodificar(formato_archivo, n.ancho, n.alto, n.datos + c * n.bytes_capa, rgba.data() + c * n.ancho * n.alto * 4)) {
+                            log::error("No se pudo descomprimir la textura");
+                            std::exit(-1);
+                        }
+                    datos = rgba.data();
+                    tam = rgba.size();
+                    comprimido = false;
+                }
+
+                if (comprimido) {
+                    if (tex.target == GL_TEXTURE_2D_ARRAY)
+                        glCompressedTexImage3D(tex.target, l, tex.formato, n.ancho, n.alto, capas, 0, tam, datos);
+                    else
+                        glCompressedTexImage2D(tex.target, l, tex.formato, n.ancho, n.alto, 0, tam, datos);
+                } else {
+                    if (tex.target == GL_TEXTURE_2D_ARRAY)
+                        glTexImage3D(tex.target, l, GL_RGBA8, n.ancho, n.alto, capas, 0, GL_RGBA, GL_UNSIGNED_BYTE, datos);
+                    else
+                        glTexImage2D(tex.target, l, GL_RGBA8, n.ancho, n.alto, 0, GL_RGBA, GL_UNSIGNED_BYTE, datos);
+                }
+                debug::gl();
+                return tam;
+            }
+        }
+
+        // Nombres de las capas de un array KTX guardados por tofu-bake, en orden
+        // Vacío si el archivo no existe o no los tiene
+        inline std::vector<str> capasKTX(str ruta) {
+            auto bytes = tofu::detail::leerBinario(ruta);
+            if (not bytes)
+                return {};
+            return ktx::capas(bytes->datos, bytes->tam);
+        }
+
+        // Cargar una textura KTX generada con tofu-bake (mipmaps precalculados y compresión por bloques)
+        // Si el driver no soporta el formato comprimido, se decodifica en la CPU y se sube como RGBA8
+        inline void cargarKTX(str ruta) {
+            auto bytes = tofu::detail::leerBinario(ruta);
+            if (not bytes) {
+                log::error("No se pudo cargar la textura {}", ruta);
+                std::exit(-1);
+            }
+            ui64 clave = hash::xxh64(bytes->datos, bytes->tam, ktx::RGBA8);
+            if (detail::buscarCache(clave, ruta))
+                return;
+
+            ktx::Cabecera cab;
+            std::vector<ktx::Nivel> niveles;
+            if (not ktx::leer(bytes->datos, bytes->tam, cab, niveles)) {
+                log::error("El archivo {} no es una textura KTX válida", ruta);
+                std::exit(-1);
+            }
+
+            // Formato y tipo de textura
+            ui32 capas = std::max(cab.capas, 1u);
+            ui32 target = cab.capas > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+            bool comprimido = cab.gl_type == 0;
+            bool nativo = not comprimido or formatoSoportado(cab.gl_internal_format);
+            ui32 formato = nativo ? cab.gl_internal_format : GL_RGBA8;
+            if (not nativo)
+                log::warn("El formato de {} no está soportado, se descomprime a RGBA8", ruta);
+
+            ui32 tex_id = crear(target, formato, 0, 0, glm::ivec2(cab.ancho, cab.alto));
+            Textura& tex = gl.texturas[tex_id];
+            gl.imagenes[ruta] = tex_id;
+            detail::vincularCarga(tex);
+
+            // Subimos cada nivel de la cadena de mipmaps
+            ui64 bytes_gpu = 0;
+            for (ui32 l = 0; l < niveles.size(); l++)
+                bytes_gpu += detail::subirNivel(tex, l, cab.gl_internal_format, niveles[l], capas);
+
+            glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, niveles.size() - 1);
+            tex.sampler = sampler::obtener(niveles.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            debug::gl();
+
+            gl.cache_imagenes.entradas[clave] = { tex_id, 1, bytes_gpu };
+            log::info("Textura {}: {} niveles, {} capas, {} KiB en la GPU", ruta, niveles.size(), capas, bytes_gpu / 1024);
+        }
+
+        // Liberar una referencia a una imagen cargada
+        // Cada carga cuenta una referencia, aunque se repita el nombre, así que el nombre sigue valiendo hasta que se
+        // libera la última. Entonces se elimina la textura y todos los nombres que apuntaban a ella
+        inline void liberar(str nombre) {
+            auto it = gl.imagenes.find(nombre);
+            if (it == gl.imagenes.end()) {
+                log::warn("No existe la imagen a liberar: {}", nombre);
+                return;
+            }
+            ui32 tex_id = it->second;
+
+            CacheImagenes& cache = gl.cache_imagenes;
+            for (auto e = cache.entradas.begin(); e != cache.entradas.end(); e++) {
+                if (e->second.textura != tex_id)
+                    continue;
+                if (--e->second.refs > 0)
+                    return;
+                cache.entradas.erase(e);
+                break;
+            }
+
+            // Era la última referencia, eliminamos la textura, sus nombres y las capas que apuntaban a ella
+            for (auto i = gl.imagenes.begin(); i != gl.imagenes.end();)
+                i = (i->second == tex_id) ? gl.imagenes.erase(i) : std::next(i);
+            for (auto c = cache.capas.begin(); c != cache.capas.end();)
+                c = (c->second.textura == tex_id) ? cache.capas.erase(c) : std::next(c);
+            liberarUnidad(tex_id);
+            detail::olvidar(gl.texturas[tex_id].textura);
+            glDeleteTextures(1, &gl.texturas[tex_id].textura);
+            gl.texturas.erase(tex_id);
+            debug::gl();
+        }
+
+        // Mostrar las estadísticas de la caché de imágenes
+        inline void informeCache() {
+            CacheImagenes& cache = gl.cache_imagenes;
+            log::info("Caché de texturas: {} aciertos, {} fallos, {} KiB ahorrados", cache.aciertos, cache.fallos, cache.bytes_ahorrados / 1024);
         }
     }
 
     namespace texbuffer
     {
-        // Offset en el número de texturas desde donde empezarán a contar los texbuffers (para evitar colisiones)
-        inline const ui32 texbuffer_offset = 8;
-
         // Crea un texture buffer
         template <typename T>
         TexBuffer crear(std::vector<T> datos = {}) {
@@ -354,16 +834,15 @@ namespace tofu
             }
 
             ui32 buffer = buffer::crear(GL_TEXTURE_BUFFER, datos, GL_DYNAMIC_COPY);
-            ui32 textura = textura::crear(GL_TEXTURE_BUFFER, formato, 0, texbuffer_offset);
+            ui32 textura = textura::crear(GL_TEXTURE_BUFFER, formato, 0);
             return {buffer, textura};
         }
     }
 
     namespace framebuffer
     {
-        inline const ui32 fb_offset = 12;
-
         // Crea las texturas de un framebuffer
+        // Al redimensionar se reutilizan los mismos identificadores, así cada attachment mantiene su unidad de textura
         inline void crearTexturas(Framebuffer &fb) {
             glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
 
@@ -376,19 +855,24 @@ namespace tofu
             bool has_depth = false;
 
             // Creamos los attachments y sus texturas
-            for (auto a : fb.attachment_description) {
-                fb.attachments.push_back(textura::crear(dimension, a, 0));
-                Textura& tex = gl.texturas[fb.attachments.back()];
-                glActiveTexture(GL_TEXTURE0 + attachment_count + fb_offset);
-                glBindTexture(dimension, tex.textura);
+            for (ui32 i = 0; i < fb.attachment_description.size(); i++) {
+                ui32 a = fb.attachment_description[i];
+                if (i < fb.attachments.size())
+                    glGenTextures(1, &gl.texturas[fb.attachments[i]].textura);
+                else
+                    fb.attachments.push_back(textura::crear(dimension, a, 0));
+                Textura& tex = gl.texturas[fb.attachments[i]];
+                tex.tam = glm::ivec2(fb.tam);
+                tex.sampler = sampler::obtener(textura::esProfundidad(a) ? GL_NEAREST : GL_LINEAR, textura::esProfundidad(a) ? GL_NEAREST : GL_LINEAR);
+                textura::detail::vincularCarga(tex);
 
                 if (has_depth == true) {
                     log::error("No se puede crear un framebuffer con más de un attachment de profundidad");
                     std::exit(-1);
                 }
 
-                ui32 slot_attachment = GL_DEPTH_STENCIL_ATTACHMENT;
-                if (a == GL_DEPTH24_STENCIL8)
+                ui32 slot_attachment = (a == GL_DEPTH24_STENCIL8 or a == GL_DEPTH32F_STENCIL8) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+                if (textura::esProfundidad(a))
                     has_depth = true;
                 else
                     slot_attachment = GL_COLOR_ATTACHMENT0 + attachment_count++;
@@ -398,8 +882,6 @@ namespace tofu
                     glFramebufferTexture1D(GL_FRAMEBUFFER, slot_attachment, GL_TEXTURE_1D, tex.textura, 0);
                 } else if (dimension == GL_TEXTURE_2D) { // 2D
                     glTexImage2D(GL_TEXTURE_2D, 0, tex.formato, fb.tam.x, fb.tam.y, 0, textura::fi_a_formato(tex.formato), textura::fi_a_tipo(tex.formato), NULL);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
                     glFramebufferTexture2D(GL_FRAMEBUFFER, slot_attachment, GL_TEXTURE_2D, tex.textura, 0); 
                 } else {
                     log::error("Dimension de framebuffer no soportada");
@@ -413,6 +895,10 @@ namespace tofu
                 debug::gl();
                 std::exit(-1);
             }
+
+            // Vinculamos cada attachment a su unidad para poder leerlo desde las shaders
+            for (auto t : fb.attachments)
+                textura::vincular(t);
             debug::gl();
         }
 
@@ -439,11 +925,17 @@ namespace tofu
             fb.tam = glm::ivec3(tam.x, tam.y, 1);
             for (auto t : fb.attachments) {
                 Textura& tex = gl.texturas[t];
+                textura::detail::olvidar(tex.textura);
                 glDeleteTextures(1, &tex.textura);
             }
             crearTexturas(fb);
 
             debug::gl();
         }
+
+        // Unidad de textura de un attachment, para asignarla al sampler de la shader que lo lee
+        inline int vincular(ui32 id, ui32 attachment) {
+            return textura::vincular(gl.framebuffers[id].attachments[attachment]);
+        }
     }
 }
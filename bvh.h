@@ -0,0 +1,130 @@
+// Jerarquía de volúmenes envolventes (BVH) estática para instancias que no se mueven
+// Se construye una vez sobre las esferas de las instancias y las reordena para que cada nodo sea un rango seguido,
+// así el culling descarta o acepta nodos enteros y cada nodo visible se dibuja desplazando la instancia base,
+// sin compactar nada (ver dibujarRangos)
+// Los nodos se guardan en profundidad: el hijo izquierdo va justo después de su padre, y dos nodos seguidos en el
+// recorrido también son rangos seguidos, que se juntan en uno
+#pragma once
+
+#include <numeric>
+
+#include "visibilidad.h"
+
+namespace tofu
+{
+    namespace bvh
+    {
+        // Instancias que puede tener una hoja como mucho
+        constexpr ui32 max_hoja = 256;
+
+        struct Nodo {
+            glm::vec3 min, max;     // Caja que envuelve las esferas del nodo
+            ui32 ini, num;          // Rango de instancias
+            ui32 derecho;           // Índice del hijo derecho (el izquierdo es el siguiente), 0 si es una hoja
+        };
+
+        struct Arbol {
+            std::vector<Nodo> nodos;
+            std::vector<ui32> orden;    // Índice original de la instancia que hay en cada posición
+        };
+
+        namespace detail
+        {
+            inline ui32 dividir(Arbol& a, const visibilidad::Esferas& e, ui32 ini, ui32 num, ui32 hoja) {
+                ui32 id = a.nodos.size();
+                a.nodos.push_back({ glm::vec3(INFINITY), glm::vec3(-INFINITY), ini, num, 0 });
+
+                glm::vec3 min_c = glm::vec3(INFINITY), max_c = glm::vec3(-INFINITY);
+                for (ui32 i = ini; i < ini + num; i++) {
+                    ui32 k = a.orden[i];
+                    glm::vec3 c = glm::vec3(e.x[k], e.y[k], e.z[k]);
+                    a.nodos[id].min = glm::min(a.nodos[id].min, c - e.r[k]);
+                    a.nodos[id].max = glm::max(a.nodos[id].max, c + e.r[k]);
+                    min_c = glm::min(min_c, c);
+                    max_c = glm::max(max_c, c);
+                }
+                if (num <= hoja)
+                    return id;
+
+                // Partimos por la mediana de los centros en el eje más largo
+                glm::vec3 lado = max_c - min_c;
+                ui32 eje = lado.x >= lado.y and lado.x >= lado.z ? 0 : (lado.y >= lado.z ? 1 : 2);
+                const std::vector<float>& coord = eje == 0 ? e.x : (eje == 1 ? e.y : e.z);
+                ui32 mitad = num / 2;
+                std::nth_element(a.orden.begin() + ini, a.orden.begin() + ini + mitad, a.orden.begin() + ini + num,
+                                 [&](ui32 i, ui32 j) { return coord[i] < coord[j]; });
+
+                dividir(a, e, ini, mitad, hoja);
+                ui32 derecho = dividir(a, e, ini + mitad, num - mitad, hoja);
+                a.nodos[id].derecho = derecho;
+                return id;
+            }
+        }
+
+        // Construir el árbol sobre unas esferas, que quedan reordenadas en el orden de los nodos
+        // Los demás datos por instancia se tienen que reordenar igual con arbol.orden antes de subirlos a la GPU
+        inline Arbol construir(visibilidad::Esferas& e, ui32 hoja = max_hoja) {
+            Arbol a;
+            ui32 n = e.x.size();
+            a.orden.resize(n);
+            std::iota(a.orden.begin(), a.orden.end(), 0);
+            if (n == 0)
+                return a;
+            a.nodos.reserve(2 * (n / std::max(hoja, 1u)) + 1);
+            detail::dividir(a, e, 0, n, std::max(hoja, 1u));
+
+            visibilidad::Esferas ordenadas;
+            for (ui32 i : a.orden)
+                visibilidad::insertar(ordenadas, glm::vec3(e.x[i], e.y[i], e.z[i]), e.r[i]);
+            e = std::move(ordenadas);
+            return a;
+        }
+
+        // Rangos de instancias (inicio y número) de los nodos visibles desde una cámara, juntando los seguidos
+        // Un nodo que está dentro del frustum entero se acepta sin mirar sus hijos, y las hojas que lo cruzan se aceptan
+        // enteras: alguna instancia puede quedar fuera, pero la GPU la recorta sin más coste que el de dibujarla
+        // Devuelve el número de instancias
+        inline ui32 frustum(const Arbol& a, const glm::mat4& viewproj, std::vector<glm::uvec2>& rangos) {
+            rangos.clear();
+            if (a.nodos.empty())
+                return 0;
+            visibilidad::Planos p = visibilidad::planos(viewproj);
+
+            ui32 total = 0;
+            auto aceptar = [&](const Nodo& n) {
+                total += n.num;
+                if (not rangos.empty() and rangos.back().x + rangos.back().y == n.ini)
+                    rangos.back().y += n.num;
+                else
+                    rangos.push_back(glm::uvec2(n.ini, n.num));
+            };
+
+            ui32 pila[64], tope = 0;
+            pila[tope++] = 0;
+            while (tope > 0) {
+                ui32 id = pila[--tope];
+                const Nodo& n = a.nodos[id];
+                glm::vec3 centro = (n.min + n.max) * 0.5f, extension = (n.max - n.min) * 0.5f;
+
+                bool fuera = false, cruza = false;
+                for (const glm::vec4& q : p) {
+                    float d = glm::dot(glm::vec3(q), centro) + q.w;
+                    float r = glm::dot(glm::abs(glm::vec3(q)), extension);
+                    fuera |= d < -r;
+                    cruza |= d < r;
+                }
+                if (fuera)
+                    continue;
+                if (not cruza or n.derecho == 0) {
+                    aceptar(n);
+                    continue;
+                }
+
+                // El izquierdo se saca primero para que los rangos salgan en orden
+                pila[tope++] = n.derecho;
+                pila[tope++] = id + 1;
+            }
+            return total;
+        }
+    }
+}
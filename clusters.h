@@ -0,0 +1,204 @@
+// Clusters de triángulos (meshlets)
+// Una malla grande se divide en grupos de hasta 64 vértices y 124 triángulos que ocupan un rango seguido de índices
+// Cada cluster guarda una esfera envolvente y un cono con las normales de sus triángulos, así se pueden descartar
+// en la CPU los que están fuera de la pantalla o de espaldas a la cámara y dibujar solo el resto (ver dibujarClusters)
+// No depende de OpenGL para poder agrupar las mallas al crear el paquete (tofu-pack -c)
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+namespace tofu
+{
+    using ui32 = std::uint32_t;
+
+    struct Cluster {
+        ui32 ioff, icount;          // Rango de índices, relativo al inicio de la geometría
+        float centro[3], radio;     // Esfera envolvente
+        float eje[3], corte;        // Cono de normales, corte es el seno del semiángulo (1 si no se puede descartar por orientación)
+    };
+    static_assert(sizeof(Cluster) == 40, "Los clusters tienen que ocupar 40 bytes para guardarlos en el paquete");
+
+    namespace clusters
+    {
+        constexpr ui32 max_vertices = 64;
+        constexpr ui32 max_triangulos = 124;
+
+        namespace detail
+        {
+            inline const float* pos(const float* vertices, ui32 stride, ui32 i) {
+                return vertices + (size_t)i * stride;
+            }
+
+            // Esfera envolvente y cono de normales de los triángulos de un cluster
+            // Las normales siguen el orden de los vértices (cross(b - a, c - a)), el mismo que usa OpenGL con glFrontFace(GL_CCW),
+            // así un cluster descartado por orientación es uno en el que la GPU descartaría todos los triángulos
+            inline void limites(Cluster& c, const float* vertices, ui32 stride, const ui32* indices) {
+                float min[3] = { INFINITY, INFINITY, INFINITY }, max[3] = { -INFINITY, -INFINITY, -INFINITY };
+                for (ui32 i = 0; i < c.icount; i++) {
+                    const float* p = pos(vertices, stride, indices[c.ioff + i]);
+                    for (ui32 k = 0; k < 3; k++) {
+                        min[k] = std::min(min[k], p[k]);
+                        max[k] = std::max(max[k], p[k]);
+                    }
+                }
+                float r2 = 0.f;
+                for (ui32 k = 0; k < 3; k++)
+                    c.centro[k] = (min[k] + max[k]) * 0.5f;
+                for (ui32 i = 0; i < c.icount; i++) {
+                    const float* p = pos(vertices, stride, indices[c.ioff + i]);
+                    float dx = p[0] - c.centro[0], dy = p[1] - c.centro[1], dz = p[2] - c.centro[2];
+                    r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+                }
+                c.radio = std::sqrt(r2);
+
+                // Normales de los triángulos, ignorando los degenerados
+                std::vector<std::array<float, 3>> normales;
+                normales.reserve(c.icount / 3);
+                float suma[3] = { 0.f, 0.f, 0.f };
+                for (ui32 i = 0; i < c.icount; i += 3) {
+                    const float* a = pos(vertices, stride, indices[c.ioff + i]);
+                    const float* b = pos(vertices, stride, indices[c.ioff + i + 1]);
+                    const float* d = pos(vertices, stride, indices[c.ioff + i + 2]);
+                    float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                    float v[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+                    float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+                    float l = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (l == 0.f)
+                        continue;
+                    normales.push_back({ n[0] / l, n[1] / l, n[2] / l });
+                    for (ui32 k = 0; k < 3; k++)
+                        suma[k] += n[k] / l;
+                }
+
+                // El eje es la normal media, y el corte sale de la normal más alejada de él
+                // Si el cono es muy abierto no merece la pena comprobarlo, se deja un corte que nunca descarta
+                float l = std::sqrt(suma[0] * suma[0] + suma[1] * suma[1] + suma[2] * suma[2]);
+                float min_cos = l > 0.f ? 1.f : -1.f;
+                for (ui32 k = 0; k < 3; k++)
+                    c.eje[k] = l > 0.f ? suma[k] / l : 0.f;
+                for (auto& n : normales)
+                    min_cos = std::min(min_cos, n[0] * c.eje[0] + n[1] * c.eje[1] + n[2] * c.eje[2]);
+                c.corte = min_cos <= 0.1f ? 1.f : std::sqrt(1.f - min_cos * min_cos);
+            }
+        }
+
+        // Agrupar los triángulos de una malla en clusters
+        // Reordena los índices para que cada cluster sea un rango seguido, sin tocar los vértices
+        // num_vert es el número de floats, como en buffer::cargarVert, y stride los floats de cada vértice (la posición va primero)
+        // Se empieza por el primer triángulo libre y se añaden los vecinos que meten menos vértices nuevos, hasta llenar el cluster
+        inline std::vector<Cluster> agrupar(const float* vertices, ui32 num_vert, ui32 stride, ui32* indices, ui32 num_ind,
+                                            ui32 max_vert = max_vertices, ui32 max_tri = max_triangulos) {
+            ui32 nv = num_vert / stride, nt = num_ind / 3;
+            std::vector<Cluster> resultado;
+            if (nt == 0 or max_vert < 3 or max_tri == 0)
+                return resultado;
+
+            // Triángulos que usan cada vértice
+            std::vector<ui32> inicio(nv + 1, 0), adyacentes(nt * 3);
+            for (ui32 i = 0; i < nt * 3; i++)
+                inicio[indices[i] + 1]++;
+            for (ui32 v = 0; v < nv; v++)
+                inicio[v + 1] += inicio[v];
+            std::vector<ui32> llenos(inicio.begin(), inicio.end() - 1);
+            for (ui32 i = 0; i < nt * 3; i++)
+                adyacentes[llenos[indices[i]]++] = i / 3;
+
+            std::vector<ui32> ordenados;
+            ordenados.reserve(num_ind);
+            std::vector<bool> usado(nt, false);
+            std::vector<ui32> marca(nv, ~0u), candidatos, triangulos;
+            ui32 siguiente = 0;
+
+            auto nuevos = [&](ui32 t, ui32 id) {
+                ui32 n = 0;
+                for (ui32 k = 0; k < 3; k++)
+                    n += marca[indices[t * 3 + k]] != id;
+                return n;
+            };
+
+            while (ordenados.size() < nt * 3) {
+                ui32 id = resultado.size();
+                ui32 num_v = 0;
+                triangulos.clear();
+                candidatos.clear();
+
+                while (siguiente < nt and usado[siguiente])
+                    siguiente++;
+                ui32 t = siguiente;
+
+                while (true) {
+                    // Añadir el triángulo y sus vecinos como candidatos
+                    usado[t] = true;
+                    triangulos.push_back(t);
+                    for (ui32 k = 0; k < 3; k++) {
+                        ui32 v = indices[t * 3 + k];
+                        if (marca[v] != id) {
+                            marca[v] = id;
+                            num_v++;
+                        }
+                        for (ui32 j = inicio[v]; j < inicio[v + 1]; j++)
+                            if (not usado[adyacentes[j]])
+                                candidatos.push_back(adyacentes[j]);
+                    }
+                    if (triangulos.size() >= max_tri)
+                        break;
+
+                    // El mejor candidato es el que añade menos vértices, quitando los que ya no sirven
+                    ui32 mejor = ~0u, mejor_nuevos = 4, n = 0;
+                    for (ui32 c : candidatos) {
+                        if (usado[c])
+                            continue;
+                        candidatos[n++] = c;
+                        ui32 x = nuevos(c, id);
+                        if (x < mejor_nuevos and num_v + x <= max_vert) {
+                            mejor = c;
+                            mejor_nuevos = x;
+                        }
+                    }
+                    candidatos.resize(n);
+                    if (mejor == ~0u)
+                        break;
+                    t = mejor;
+                }
+
+                // Guardar el cluster con sus índices seguidos
+                Cluster c = {};
+                c.ioff = ordenados.size();
+                c.icount = triangulos.size() * 3;
+                for (ui32 tri : triangulos)
+                    for (ui32 k = 0; k < 3; k++)
+                        ordenados.push_back(indices[tri * 3 + k]);
+                resultado.push_back(c);
+            }
+
+            std::copy(ordenados.begin(), ordenados.end(), indices);
+            for (auto& c : resultado)
+                detail::limites(c, vertices, stride, indices);
+            return resultado;
+        }
+
+        // Comprobar si un cluster se puede ver
+        // planos son los 6 planos del frustum en el espacio del modelo, 4 floats cada uno (normal hacia dentro y distancia, normalizados)
+        // cam es la posición de la cámara en el espacio del modelo, o nullptr para no comprobar la orientación
+        // margen agranda la esfera, por ejemplo si la shader desplaza los vértices
+        inline bool visible(const Cluster& c, const float* planos, const float* cam, float margen = 0.f) {
+            float r = c.radio + margen;
+            for (const float* p = planos; p < planos + 24; p += 4)
+                if (p[0] * c.centro[0] + p[1] * c.centro[1] + p[2] * c.centro[2] + p[3] < -r)
+                    return false;
+
+            // Todos los triángulos están de espaldas si la cámara queda detrás del cono desplazado por la esfera
+            if (cam and c.corte < 1.f) {
+                float d[3] = { c.centro[0] - cam[0], c.centro[1] - cam[1], c.centro[2] - cam[2] };
+                float l = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+                if (d[0] * c.eje[0] + d[1] * c.eje[1] + d[2] * c.eje[2] >= c.corte * l + r)
+                    return false;
+            }
+            return true;
+        }
+    }
+}
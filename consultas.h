@@ -0,0 +1,108 @@
+// Pool de consultas a la GPU
+// Leer una consulta con GL_QUERY_RESULT justo después de emitirla bloquea la CPU hasta que la GPU termina
+// Aquí cada consulta rota entre varios objetos de OpenGL entre frames, y solo se leen los que ya tienen el
+// resultado disponible (GL_QUERY_RESULT_AVAILABLE), devolviendo el último que ha terminado
+// Sirve para timer queries (resolución dinámica), contadores de transform feedback y consultas de oclusión
+#pragma once
+
+#include <optional>
+
+#include "debug.h"
+
+namespace tofu
+{
+    namespace consulta
+    {
+        // Objetos de OpenGL con los que empieza cada anillo
+        constexpr ui32 tam_inicial = 3;
+
+        namespace detail
+        {
+            // Leer en orden las consultas que ya han terminado, sin esperar por las que no
+            inline void actualizar(Consulta& c) {
+                while (c.pendientes > 0) {
+                    ui32 id = c.ids[c.primera];
+                    ui32 disponible = 0;
+                    glGetQueryObjectuiv(id, GL_QUERY_RESULT_AVAILABLE, &disponible);
+                    if (not disponible)
+                        break;
+
+                    // En la web no existe la versión de 64 bits
+                    NOWEB(glGetQueryObjectui64v(id, GL_QUERY_RESULT, &c.resultado);)
+                    WEB(ui32 r; glGetQueryObjectuiv(id, GL_QUERY_RESULT, &r); c.resultado = r;)
+                    c.valido = true;
+                    c.leido = false;
+                    c.primera = (c.primera + 1) % c.ids.size();
+                    c.pendientes--;
+                }
+                debug::gl();
+            }
+        }
+
+        // Empezar una consulta del tipo indicado
+        // No puede haber dos consultas del mismo tipo activas a la vez (es una limitación de OpenGL)
+        inline void empezar(ConsultaId nombre, ui32 tipo) {
+            auto it = gl.consultas.find(nombre);
+            if (it == gl.consultas.end()) {
+                it = gl.consultas.emplace(internar(nombre), Consulta{ .tipo = tipo }).first;
+                it->second.ids.resize(tam_inicial);
+                glGenQueries(tam_inicial, it->second.ids.data());
+            }
+            Consulta& c = it->second;
+            detail::actualizar(c);
+
+            // Si todas están esperando a la GPU, añadimos otra al anillo justo antes de la más antigua en vez de esperar
+            if (c.pendientes == c.ids.size()) {
+                ui32 nueva;
+                glGenQueries(1, &nueva);
+                c.ids.insert(c.ids.begin() + c.primera, nueva);
+                c.primera++;
+            }
+
+            glBeginQuery(c.tipo, c.ids[(c.primera + c.pendientes) % c.ids.size()]);
+            debug::gl();
+        }
+
+        inline void terminar(ConsultaId nombre) {
+            Consulta& c = gl.consultas[nombre];
+            glEndQuery(c.tipo);
+            c.pendientes++;
+            debug::gl();
+        }
+
+        // Último resultado disponible, o nada si todavía no ha terminado ninguna
+        inline std::optional<ui64> resultado(ConsultaId nombre) {
+            auto it = gl.consultas.find(nombre);
+            if (it == gl.consultas.end())
+                return std::nullopt;
+            detail::actualizar(it->second);
+            if (not it->second.valido)
+                return std::nullopt;
+            return it->second.resultado;
+        }
+
+        // Igual que resultado, pero solo devuelve cada resultado una vez (por ejemplo, para medir cada frame)
+        inline std::optional<ui64> nuevo(ConsultaId nombre) {
+            auto r = resultado(nombre);
+            if (not r or gl.consultas[nombre].leido)
+                return std::nullopt;
+            gl.consultas[nombre].leido = true;
+            return r;
+        }
+
+        // Olvidar los resultados anteriores, por ejemplo si lo que se mide ha cambiado
+        inline void reiniciar(ConsultaId nombre) {
+            auto it = gl.consultas.find(nombre);
+            if (it == gl.consultas.end())
+                return;
+            it->second.valido = false;
+            it->second.leido = false;
+        }
+
+        inline void liberar() {
+            for (auto& [n, c] : gl.consultas)
+                glDeleteQueries(c.ids.size(), c.ids.data());
+            gl.consultas.clear();
+        }
+    }
+}
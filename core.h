@@ -8,6 +8,10 @@
 #include "window.h"
 #include "gui.h"
 #include "shaders.h"
+#include "streaming.h"
+#include "resolucion.h"
+#include "hiz.h"
+#include "visibilidad.h"
 
 namespace tofu
 {
@@ -37,9 +41,19 @@ namespace tofu
         // Multisampling
         glEnable(GL_MULTISAMPLE);
 
+        // Uniform buffer con los datos comunes del frame, enlazado para todas las shaders
+        glGenBuffers(1, &gl.ubo_frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, gl.ubo_frame);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding_frame, gl.ubo_frame);
+
         // Obtener atributos
         // Tamaño máximo de textura
         glGetIntegerv(GL_MAX_TEXTURE_SIZE, (GLint*)&gl.max_tex_size);
+        // Unidades de textura disponibles
+        int unidades;
+        glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &unidades);
+        gl.unidades.resize(unidades);
 
         t = debug::time();        
         debug::gl();
@@ -59,6 +73,10 @@ namespace tofu
         debug::num_instancias = 0;
         debug::num_triangulos = 0;
         debug::num_vertices = 0;
+        debug::num_vinculos = 0;
+        debug::num_clusters = 0;
+        debug::clusters_visibles = 0;
+        debug::asignaciones_frame = debug::num_asignaciones.exchange(0);
         #endif
 
         // Limpiar la pantalla antes de seguir
@@ -75,8 +93,22 @@ namespace tofu
         // Resetear la instancia base
         gl.instancia_base = 0;
 
+        // Los datos del frame se suben al usar la primera shader
+        gl.frame_pendiente = true;
+
+        // Subir los niveles de textura pedidos en el frame anterior
+        streaming::actualizar();
+
         // Llamar a los comandos de renderizados especificados
+        resolucion::detail::empezar();
+        #ifdef DEBUG
+        ui32 asignaciones = debug::num_asignaciones;
+        #endif
         TIME(render(), debug::render_usuario_time);
+        #ifdef DEBUG
+        debug::asignaciones_render = debug::num_asignaciones - asignaciones;
+        #endif
+        resolucion::detail::terminar();
         TIME(gui::render(gui_render), debug::render_gui_time);
 
         // Cambiar los buffers y presentar a pantalla
@@ -95,48 +127,58 @@ namespace tofu
     }
 
     // Dibujar objeto por instancias
-    inline void dibujar(ui32 n, str geom, str vao = "main") {
+    inline void dibujar(ui32 n, GeomId nombre, VaoId vao = "main"_id) {
+        auto it = gl.geometrias.find(nombre);
+        if (it == gl.geometrias.end()) {
+            log::error("No se ha encontrado la geometría con nombre: {}", nombre);
+            return;
+        }
+        const Geometria& geom = it->second;
+
         // Métricas de debug
         #ifdef DEBUG
         debug::num_instancias += n;
-        debug::num_vertices += gl.geometrias[geom].vcount * n;
-        debug::num_triangulos += gl.geometrias[geom].icount * n / 3;
+        debug::num_vertices += geom.vcount * n;
+        debug::num_triangulos += geom.icount * n / 3;
         #endif
 
-        if (not gl.geometrias.count(geom)) {
-            log::error("No se ha encontrado la geometría con nombre: ", geom);
-            return;
-        }
-
         // Actualizamos la instancia base (todas las shaders tienen que tener un uniform baseins)
-        shader::uniform("baseins", gl.instancia_base);
-        ui32 attr_offset = std::accumulate(gl.VAOs[vao].atributos.begin(), gl.VAOs[vao].atributos.end(), 0); 
+        shader::uniform("baseins"_id, gl.instancia_base);
+        const VAO& v = gl.VAOs[vao];
+        ui32 attr_offset = std::accumulate(v.atributos.begin(), v.atributos.end(), 0);
+
+        // Los atributos por instancia empiezan en la instancia base
+        bool por_instancia = not v.por_instancia.empty();
+        if (por_instancia)
+            buffer::enlazarInstancias(v, gl.instancia_base);
 
         // Sin índices
-        if (gl.geometrias[geom].icount == 0) {
+        if (geom.icount == 0) {
             #ifdef DEBUG
             if (debug::usar_instancias) {
                 glDrawArraysInstanced(
-                    gl.geometrias[geom].tipo_dibujo,
-                    gl.geometrias[geom].voff / attr_offset,
-                    gl.geometrias[geom].vcount / attr_offset,
+                    geom.tipo_dibujo,
+                    geom.voff / attr_offset,
+                    geom.vcount / attr_offset,
                     n);
                 debug::num_draw++;
             } else {
                 for (ui32 i = 1; i <= n; i++) {
                     glDrawArrays(
-                        gl.geometrias[geom].tipo_dibujo,
-                        gl.geometrias[geom].voff / attr_offset,
-                        gl.geometrias[geom].vcount / attr_offset);
-                    shader::uniform<int>("baseins", gl.instancia_base + i);
+                        geom.tipo_dibujo,
+                        geom.voff / attr_offset,
+                        geom.vcount / attr_offset);
+                    shader::uniform<int>("baseins"_id, gl.instancia_base + i);
+                    if (por_instancia)
+                        buffer::enlazarInstancias(v, gl.instancia_base + i);
                     debug::num_draw++;
                 }
             }
             #else
             glDrawArraysInstanced(
-                gl.geometrias[geom].tipo_dibujo,
-                gl.geometrias[geom].voff / attr_offset,
-                gl.geometrias[geom].vcount / attr_offset,
+                geom.tipo_dibujo,
+                geom.voff / attr_offset,
+                geom.vcount / attr_offset,
                 n);
             #endif
         }
@@ -145,34 +187,36 @@ namespace tofu
             #ifdef DEBUG
             if (debug::usar_instancias) {
                 glDrawElementsInstancedBaseVertex(
-                    gl.geometrias[geom].tipo_dibujo,
-                    gl.geometrias[geom].icount,
+                    geom.tipo_dibujo,
+                    geom.icount,
                     GL_UNSIGNED_INT,
-                    (void*)(gl.geometrias[geom].ioff * sizeof(ui32)),
+                    (void*)(geom.ioff * sizeof(ui32)),
                     n, 
-                    gl.geometrias[geom].voff / attr_offset);
+                    geom.voff / attr_offset);
                 debug::num_draw++;
             } else {
                 debug::num_draw--;
                 for (ui32 i = 1; i <= n; i++) {
                     glDrawElementsBaseVertex(
-                        gl.geometrias[geom].tipo_dibujo,
-                        gl.geometrias[geom].icount,
+                        geom.tipo_dibujo,
+                        geom.icount,
                         GL_UNSIGNED_INT,
-                        (void*)(gl.geometrias[geom].ioff * sizeof(ui32)),
-                        gl.geometrias[geom].voff / attr_offset);
-                    shader::uniform<int>("baseins", gl.instancia_base + i);
+                        (void*)(geom.ioff * sizeof(ui32)),
+                        geom.voff / attr_offset);
+                    shader::uniform<int>("baseins"_id, gl.instancia_base + i);
+                    if (por_instancia)
+                        buffer::enlazarInstancias(v, gl.instancia_base + i);
                     debug::num_draw++;
                 }
             }
             #else
             glDrawElementsInstancedBaseVertex(
-                gl.geometrias[geom].tipo_dibujo,
-                gl.geometrias[geom].icount,
+                geom.tipo_dibujo,
+                geom.icount,
                 GL_UNSIGNED_INT,
-                (void*)(gl.geometrias[geom].ioff * sizeof(ui32)),
+                (void*)(geom.ioff * sizeof(ui32)),
                 n, 
-                gl.geometrias[geom].voff / attr_offset);
+                geom.voff / attr_offset);
             #endif
         }
 
@@ -180,6 +224,92 @@ namespace tofu
         debug::gl();
     }
 
+    // Dibujar varios rangos de instancias (inicio y número), cada uno a partir de gl.instancia_base + su inicio
+    // Por ejemplo, los nodos visibles de un bvh::Arbol, que guarda las instancias en el orden de sus nodos
+    inline void dibujarRangos(const std::vector<glm::uvec2>& rangos, GeomId nombre, VaoId vao = "main"_id) {
+        int base = gl.instancia_base;
+        for (const glm::uvec2& r : rangos) {
+            gl.instancia_base = base + r.x;
+            dibujar(r.y, nombre, vao);
+        }
+        gl.instancia_base = base;
+    }
+
+    // Dibujar una sola instancia de una geometría agrupada en clusters (buffer::cargarVertClusters o tofu-pack -c)
+    // Los clusters fuera de la pantalla o con todos los triángulos de espaldas se descartan en la CPU, y el resto se dibuja
+    // con un solo glMultiDrawElementsBaseVertex, juntando los que quedan seguidos en el buffer de índices
+    // modelo es la matriz de la instancia gl.instancia_base, que la shader sigue leyendo como siempre
+    // margen agranda las esferas de los clusters si la shader desplaza los vértices
+    inline void dibujarClusters(GeomId nombre, const glm::mat4& modelo, float margen = 0.f, VaoId vao = "main"_id) {
+        auto it = gl.clusters.find(nombre);
+        if (it == gl.clusters.end()) {
+            dibujar(1, nombre, vao);
+            return;
+        }
+        const Geometria& geom = gl.geometrias[nombre];
+        const std::vector<Cluster>& clusters = it->second;
+
+        // Planos del frustum en el espacio del modelo
+        // Como las transformaciones afines conservan los planos, se comparan directamente con las esferas de los clusters
+        visibilidad::Planos planos = visibilidad::planos(gl.proj * gl.view * modelo);
+
+        // La orientación de las caras también se conserva, salvo si el modelo es un reflejo (que invierte el orden de los vértices)
+        glm::vec3 cam = glm::inverse(modelo) * glm::inverse(gl.view)[3];
+        bool cono = glm::determinant(glm::mat3(modelo)) > 0.f;
+
+        const VAO& v = gl.VAOs[vao];
+        ui32 attr_offset = std::accumulate(v.atributos.begin(), v.atributos.end(), 0);
+        int base = geom.voff / attr_offset;
+
+        RangosClusters& r = gl.rangos_clusters;
+        r.cuentas.clear();
+        r.offsets.clear();
+        r.bases.clear();
+        ui32 fin = ~0u, num_ind = 0;
+        #ifdef DEBUG
+        debug::num_clusters += clusters.size();
+        #endif
+        for (const Cluster& c : clusters) {
+            if (not clusters::visible(c, glm::value_ptr(planos[0]), cono ? glm::value_ptr(cam) : nullptr, margen))
+                continue;
+            #ifdef DEBUG
+            debug::clusters_visibles++;
+            #endif
+            num_ind += c.icount;
+            if (c.ioff == fin) {
+                r.cuentas.back() += c.icount;
+            } else {
+                r.cuentas.push_back(c.icount);
+                r.offsets.push_back((void*)((geom.ioff + c.ioff) * sizeof(ui32)));
+                r.bases.push_back(base);
+            }
+            fin = c.ioff + c.icount;
+        }
+
+        if (r.cuentas.empty())
+            return;
+
+        #ifdef DEBUG
+        debug::num_instancias += 1;
+        debug::num_vertices += geom.vcount;
+        debug::num_triangulos += num_ind / 3;
+        debug::num_draw++;
+        #endif
+
+        shader::uniform("baseins"_id, gl.instancia_base);
+        if (not v.por_instancia.empty())
+            buffer::enlazarInstancias(v, gl.instancia_base);
+
+        // En la web no hay glMultiDrawElementsBaseVertex, se dibuja cada rango por separado
+        #ifdef EMSCRIPTEN
+        for (ui32 i = 0; i < r.cuentas.size(); i++)
+            glDrawElementsBaseVertex(geom.tipo_dibujo, r.cuentas[i], GL_UNSIGNED_INT, r.offsets[i], r.bases[i]);
+        #else
+        glMultiDrawElementsBaseVertex(geom.tipo_dibujo, r.cuentas.data(), GL_UNSIGNED_INT, r.offsets.data(), r.cuentas.size(), r.bases.data());
+        #endif
+        debug::gl();
+    }
+
     // Limpieza
     inline void terminarGL() {
         gui::terminar();
@@ -192,16 +322,26 @@ namespace tofu
 
         for (auto& [i, b] : gl.buffers)
             glDeleteBuffers(1, &b.buffer);
+        glDeleteBuffers(1, &gl.ubo_frame);
 
         for (auto& [i, t] : gl.texturas)
             glDeleteTextures(1, &t.textura);
 
+        for (auto& [k, s] : gl.samplers)
+            glDeleteSamplers(1, &s);
+
         for (auto& [i, f] : gl.framebuffers)
             glDeleteFramebuffers(1, &f.fbo);
+        for (auto& p : gl.grafo.pasos)
+            glDeleteFramebuffers(1, &p.fbo);
+        glDeleteFramebuffers(gl.hiz.fbos.size(), gl.hiz.fbos.data());
+        consulta::liberar();
 
         for (auto& [n, s] : gl.shaders)
             glDeleteProgram(s.pid);
 
+        paquete::cerrar();
+
         debug::gl();
         glfwTerminate();
     }
@@ -3,6 +3,8 @@
 
 #include <iostream>
 #include <sstream>
+#include <atomic>
+#include <new>
 
 #include "tipos.h"
 
@@ -14,6 +16,9 @@
 #endif
 
 namespace tofu {
+    // Los identificadores se muestran con su nombre original
+    inline std::ostream& operator<<(std::ostream& os, const Id& id) { return os << id.texto; }
+
     // Formatear strings
     namespace detail
     {
@@ -180,6 +185,12 @@ namespace tofu {
 
         inline ui32 num_draw = 0, num_instancias = 0;
         inline ui32 num_vertices = 0, num_triangulos = 0;
+        inline ui32 num_vinculos = 0;
+        inline ui32 num_clusters = 0, clusters_visibles = 0;
+
+        // Reservas de memoria con new (solo se cuentan si se define TOFU_CONTAR_ASIGNACIONES, ver abajo)
+        inline std::atomic<ui32> num_asignaciones = 0;
+        inline ui32 asignaciones_frame = 0, asignaciones_render = 0;
 
         inline bool usar_instancias = true;
 
@@ -200,3 +211,18 @@ namespace tofu {
 #else
     #define TIME(x, res) x
 #endif
+
+// Contador de asignaciones
+// Sustituye el operator new global para contar cuántas reservas hace cada frame, y así comprobar que el bucle
+// principal no crea strings ni vectores temporales. Igual que STB_IMAGE_IMPLEMENTATION, hay que definir
+// TOFU_CONTAR_ASIGNACIONES en un solo archivo del proyecto antes de incluir tofu
+#if defined(DEBUG) && defined(TOFU_CONTAR_ASIGNACIONES)
+void* operator new(size_t n) {
+    tofu::debug::num_asignaciones.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n > 0 ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+#endif
@@ -18,12 +18,10 @@ const std::vector<ui32> atributos = { 3 /* Pos */ };
 
 // ---
 
-struct Modelo {
-    glm::mat4 trans;
-    glm::mat4 rot;
-    glm::mat4 model;
-};
-inline std::vector<Modelo> modelos_grua;
+// Jerarquía de las piezas
+// Cada pieza tiene dos nodos: su articulación (posición relativa y giro), que heredan sus hijas, y su escala, que es solo suya
+// Las articulaciones van primero y las escalas después, así las matrices que se dibujan son un rango seguido
+Jerarquia jerarquia_grua;
 
 // Buffers de instancias
 TexBuffer buf_modelo;
@@ -35,39 +33,32 @@ glm::vec3 glmvec(v3 v) {
     return glm::vec3(v.v[0], v.v[1], v.v[2]);
 }
 
-glm::mat4 modeloObjeto(ui32 id) {
-    glm::mat4 modelo = glm::mat4(1.f);
+void crearJerarquia() {
+    ui32 n = piezas_grua.size();
+    for (ui32 id = 0; id < n; id++)
+        jerarquia::insertar(jerarquia_grua, piezas_grua[id].padre);
+    for (ui32 id = 0; id < n; id++)
+        jerarquia::insertar(jerarquia_grua, id);
+}
 
+// Todas las piezas giran sobre el eje Y de su padre, que sin escalas heredadas es siempre el vertical
+void modeloObjeto(ui32 id) {
     PiezaGrua& obj = piezas_grua[id];
-    Modelo& m_obj = modelos_grua[id];
-    PiezaGrua* padre = obj.padre < 0 ? nullptr : &piezas_grua[obj.padre];
-    Modelo* m_padre = obj.padre < 0 ? nullptr : &modelos_grua[obj.padre];
-
-    std::vector<glm::mat4> modelos;
-    while (padre != nullptr) {
-        modelos.push_back(m_padre->trans * m_padre->rot);
-        m_padre = padre->padre < 0 ? nullptr : &modelos_grua[padre->padre];
-        padre = padre->padre < 0 ? nullptr : &piezas_grua[padre->padre];
-    }
-    for (auto it = modelos.rbegin(); it != modelos.rend(); it++)
-        modelo *= *it;
-
-    m_obj.trans = glm::translate(glm::mat4(1.f), glmvec(posRelativa(id)));
-    m_obj.rot = glm::rotate(glm::mat4(1.f), obj.angulo, glm::vec3(modelo[1].x, modelo[1].y, modelo[1].z));
-    glm::mat4 esc = glm::scale(glm::mat4(1.f), glmvec(obj.escala));
-    modelo *= m_obj.trans * m_obj.rot * esc;
-
-    return modelo;
+    glm::mat4 trans = glm::translate(glm::mat4(1.f), glmvec(posRelativa(id)));
+    glm::mat4 rot = glm::rotate(glm::mat4(1.f), obj.angulo, glm::vec3(0.f, 1.f, 0.f));
+    jerarquia::cambiar(jerarquia_grua, id, trans * rot);
+    jerarquia::cambiar(jerarquia_grua, piezas_grua.size() + id, glm::scale(glm::mat4(1.f), glmvec(obj.escala)));
 }
 
+// Solo se recalculan y suben las piezas que se han movido o cuyo padre se ha movido
 void actualizarModelosObjetos() {
-    std::vector<glm::mat4> modelos;
-    for (ui32 id = 0; id < piezas_grua.size(); id++) {
-        modelos.push_back(modeloObjeto(id));
-    }
+    ui32 n = piezas_grua.size();
+    for (ui32 id = 0; id < n; id++)
+        modeloObjeto(id);
+    jerarquia::actualizar(jerarquia_grua);
+    jerarquia::subir(jerarquia_grua, buf_modelo.b, n, n);
+    jerarquia::descartar(jerarquia_grua);
 
-    buffer::cargar(buf_modelo.b, modelos, 0);
-    
     shader::usar("grua");
     shader::uniform("modelos", buf_modelo);
 }
@@ -139,9 +130,8 @@ void render() {
     controlarGrua();
     actualizarModelosObjetos();
 
-    // Shader y uniforms
+    // Shader (la matriz de vista y proyección va en el bloque FrameData)
     shader::usar("grua");
-    shader::uniform("viewproj", gl.proj * gl.view);
     
     // Dibujar objetos por instancias
     dibujar(piezas_grua.size(), "cubo");
@@ -168,13 +158,14 @@ int main(int arcg, char** argv) {
     buf_color = texbuffer::crear<glm::vec4>();
 
     // Cargar en memoria las figuras a dibujar
-    buffer::cargarVert("cubo", geometria::cubo());
+    static constexpr auto cubo = geometria::cubo();
+    buffer::cargarVert("cubo", cubo);
 
     // Generador de números aleatorios
     std::srand(std::time(nullptr));
 
     // Crear objetos
-    modelos_grua.resize(piezas_grua.size());
+    crearJerarquia();
     actualizarModelosObjetos();
     actualizarColoresObjetos();
 
@@ -2,7 +2,8 @@
 
 layout (location = 0) in vec3 in_pos;
 
-uniform mat4 viewproj;
+#include "tofu/frame.glsl"
+
 
 uniform int baseins;
 uniform samplerBuffer modelos;
@@ -51,14 +51,8 @@ constexpr int MAX_ESCENAS = 4;
 // Esta función se llama cada frame dentro de tofu::update()
 // Es la manera que tenemos de indicar fuera de la librería qué objetos queremos dibujar y actualizar los uniforms que cambian cada frame
 void render() {
-    shader::usar("raymarch");
-    
-    shader::uniform("time", (float)glfwGetTime());
-    shader::uniform("camera_pos", cam::pos);
-    shader::uniform("camera_rot", cam::rot);
-    shader::uniform("escena", (float)escena);
-
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    // El raymarching se dibuja a la resolución dinámica y se escala a la pantalla (ver crearGrafo)
+    grafo::ejecutar();
     debug::gl();
 
     // Actualizar cámara
@@ -69,6 +63,21 @@ void render() {
         escena = (escena + 1) % MAX_ESCENAS;
 }
 
+// Grafo de renderizado
+// El coste del raymarching es por píxel, así que se dibuja en un recurso dinámico que baja de resolución si no llegamos al objetivo
+void crearGrafo() {
+    grafo::recurso("imagen", GL_RGBA8, 1.f, true);
+
+    grafo::paso("raymarch", {}, { "imagen" }, [](){
+        shader::usar("raymarch");
+        shader::uniform("camera_pos", cam::pos);
+        shader::uniform("camera_rot", cam::rot);
+        shader::uniform("escena", (float)escena);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+    resolucion::escalar("imagen");
+}
+
 // ---
 
 // ············
@@ -90,7 +99,9 @@ int main(int arcg, char** argv) {
     // Cargamos las shader a utilizar
     shader::cargar("raymarch");
 
-    // Especificamos los attachments a usar en deferred
+    // Creamos el grafo con la resolución dinámica activada (objetivo de 60fps)
+    crearGrafo();
+    resolucion::activar(1000.f / 60.f);
 
     // Generador de números aleatorios
     std::srand(std::time(nullptr));
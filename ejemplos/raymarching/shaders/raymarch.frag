@@ -2,7 +2,8 @@
 
 in vec2 uv;
 
-uniform float time;
+#include "tofu/frame.glsl"
+
 uniform vec3 camera_pos;
 uniform mat4 camera_rot;
 uniform float escena;
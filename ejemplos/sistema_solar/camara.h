@@ -26,6 +26,10 @@ namespace cam
     inline str planeta = "Tierra";
     inline str mirar_a = "Sol";
 
+    // Índice y matriz (sin los datos extra de calc_modelos) del planeta que sigue la cámara
+    inline ui32 planeta_i = 0;
+    inline glm::mat4 planeta_mat = glm::mat4(1.f);
+
     const float aceleracion = 2.f;
     const float deceleracion = 0.9f;
     const float vel_max = 20.f;
@@ -127,12 +131,13 @@ inline void camara() {
     desactivarCulling();
 
     // Obtener matriz de planeta de la gpu
-    glm::mat4 planeta_mat;
-    ui32 i = std::distance(planetas.begin(), planetas.find(planeta));
+    planeta_i = std::distance(planetas.begin(), planetas.find(planeta));
 
     glBindBuffer(GL_TEXTURE_BUFFER, gl.buffers[buf_modelos.b].buffer);
-    glGetBufferSubData(GL_TEXTURE_BUFFER, i * sizeof(glm::mat4), sizeof(glm::mat4), &planeta_mat);
+    glGetBufferSubData(GL_TEXTURE_BUFFER, planeta_i * sizeof(glm::mat4), sizeof(glm::mat4), &planeta_mat);
     debug::gl();
+    planeta_mat[0][3] = 0.f;
+    planeta_mat[1][3] = 0.f;
 
     glm::vec3 planeta_pos = planeta_mat[3];
     float planeta_radio = planeta_mat[1][1];
@@ -159,3 +164,21 @@ inline void camara() {
     pos = planeta_pos;
     gl.view = glm::lookAt(planeta_pos, mirar_a_pos, up);
 }
+
+// En el modo planeta la cámara está pegada a un planeta que ocupa casi toda la pantalla
+// Ese planeta se dibuja por clusters, descartando los que quedan fuera o de espaldas, y el resto por instancias a los dos lados
+// La shader hunde los vértices de los planetas iluminados hasta un 20%, así que las esferas de los clusters se agrandan
+inline void dibujarPlanetaCercano() {
+    using namespace cam;
+    int base = gl.instancia_base;
+    if (planeta_i > 0)
+        dibujar(planeta_i, "esfera_planeta"_id);
+
+    gl.instancia_base = base + planeta_i;
+    dibujarClusters("esfera_planeta"_id, planeta_mat, 0.2f);
+
+    gl.instancia_base = base + planeta_i + 1;
+    if (planeta_i + 1 < num_planetas)
+        dibujar(num_planetas - planeta_i - 1, "esfera_planeta"_id);
+    gl.instancia_base = base;
+}
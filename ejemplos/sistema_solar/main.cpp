@@ -4,6 +4,7 @@
 // Opciones
 //#define DEBUG
 #define STB_IMAGE_IMPLEMENTATION
+#define TOFU_CONTAR_ASIGNACIONES
 #define ORBITAS_ELIPTICAS
 //#define USE_MULTISAMPLING
 //#define USE_RETINA_FB
@@ -46,14 +47,10 @@ const std::vector<ui32> atributos = { 3 /* Pos */ };
 // La shader para calcular los modelos de los planetas no necesita ningún atributo
 const std::vector<ui32> atributos_planeta = {};
 
-// Vista y proyección
-// Matriz que combina gl.view y gl.proj para transformar los modelos
-glm::mat4 viewproj;
-
-// Framebuffer para deferred rendering
-ui32 fbo_dibujo;
-const std::vector<ui32> attachments_dibujo = { GL_RGBA32F, GL_RGBA32F, GL_RGBA32F, GL_DEPTH24_STENCIL8 };
-const std::vector<ui32> color_att_dibujo = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+// G-buffer compacto para deferred rendering: albedo (RGBA8), normal octaédrica (RG16F) y profundidad, de donde se reconstruye la posición
+// Son 12 bytes por píxel en vez de los 52 de guardar color, normal y posición en GL_RGBA32F
+// Son recursos del grafo de renderizado, que crea las texturas y el framebuffer del paso que las escribe
+const std::vector<std::pair<str, ui32>> gbuffer = { { "albedo", GL_RGBA8 }, { "normal", GL_RG16F }, { "profundidad", GL_DEPTH24_STENCIL8 } };
 
 // ---
 
@@ -65,16 +62,54 @@ void crearMateriales() {
     // Estructura de materiales para la gpu:
     // 0 - albedo
     
+    // Si tenemos las texturas precalculadas por tofu-bake (con mipmaps y comprimidas), las usamos
+    // Se cargan con streaming: primero los niveles pequeños y los grandes según lo cerca que estén los planetas
+    // Si no, o si sus capas no coinciden con los materiales (en el mismo orden), cargamos directamente los PNG
     std::vector<str> albedo;
     for (const auto &[n, m] : materiales)
         albedo.push_back(m.albedo);
 
-    ui32 alb_tex = gl.texturas[gl.imagenes[textura::cargar(albedo)]].textura;
+    str nombre = "texturas/materiales.ktx";
+    bool precalculadas = paquete::buscar(nombre) or fs::exists(nombre);
+    if (precalculadas and textura::capasKTX(nombre) != albedo) {
+        log::warn("Las capas de {} no coinciden con los materiales, se cargan los PNG", nombre);
+        precalculadas = false;
+    }
+
+    if (precalculadas)
+        streaming::cargar(nombre);
+    else
+        nombre = textura::cargar(albedo);
 
     shader::usar("planetas");
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, alb_tex);
-    shader::uniform("albedo", 0);
+    shader::uniform("albedo", textura::vincular(gl.imagenes[nombre]));
+}
+
+// Pedir los niveles de mipmap de los materiales según el tamaño máximo de los planetas en pantalla
+// Las posiciones exactas están en la GPU, así que usamos la distancia mínima posible a la órbita de cada planeta
+// Una órbita elíptica de distancia d y excentricidad e está entre d y (1 + 2e)d del centro
+void pedirTexturas() {
+    static const str nombre = "texturas/materiales.ktx";
+    if (not gl.streaming.texturas.count(nombre))
+        return;
+
+    float dist_cam = glm::length(cam::pos);
+    float escala = gl.proj[1][1] * gl.tam_fb.y * 0.5f;
+    for (const auto &[n, p] : planetas) {
+        float dmin = p.distancia, dmax = p.distancia * (1.f + 2.f * p.excentricidad);
+        float lunas = 0.f;
+        if (p.orbita != "") {
+            const Planeta& padre = planetas.at(p.orbita);
+            lunas = p.distancia;
+            dmin = padre.distancia;
+            dmax = padre.distancia * (1.f + 2.f * padre.excentricidad);
+        }
+        float d = std::max({ dist_cam - dmax, dmin - dist_cam, 0.f }) - lunas;
+        d = std::max(d, p.radio * 1.1f);
+
+        // El diámetro en píxeles del planeta es el tamaño que necesitamos de la textura
+        streaming::pedir(nombre, 2.f * p.radio * escala / d);
+    }
 }
 
 void iniciarDatosPlanetas() {
@@ -171,8 +206,24 @@ void iniciarDatosPlanetas() {
         m = glm::translate(m, pos);
 
         estrellas.push_back(m);
+
+        // Las estrellas son cubos de lado 2 que no se mueven, así que sus esferas para el culling en la CPU son fijas
+        visibilidad::insertar(esferas_estrellas, pos, std::sqrt(3.f));
     }
 
+    // BVH de las estrellas, que reordena sus esferas en el orden de los nodos
+    // Las matrices se suben en el mismo orden, así los demás modos de culling siguen funcionando igual
+    arbol_estrellas = bvh::construir(esferas_estrellas);
+    std::vector<glm::mat4> ordenadas(num_estrellas);
+    for (ui32 i = 0; i < num_estrellas; i++)
+        ordenadas[i] = estrellas[arbol_estrellas.orden[i]];
+    estrellas = std::move(ordenadas);
+
+    // Oclusor del Sol para el culling en la CPU: una icosfera de pocos triángulos, inscrita y algo más pequeña
+    // para que los bordes del buffer de oclusión, de menos resolución que la pantalla, no tapen de más
+    oclusor_sol = geometria::esfera(geometria::ICOSAEDRO, 3);
+    modelo_sol = glm::scale(glm::mat4(1.f), glm::vec3(planetas.at("Sol").radio * 0.95f));
+
     // Cargar buffers a la GPU
     buffer::cargar(buf_planetas.b, planetas_gpu);
     buffer::cargar(buf_color.b, color, 0);
@@ -190,7 +241,6 @@ void iniciarDatosPlanetas() {
     shader::usar("planetas");
     shader::uniform("bmodelos", buf_modelos);
     shader::uniform("bcolor", buf_color);
-    shader::uniform("activar_luz", 1.f); 
 
     shader::usar("orbitas");
     shader::uniform("borbitas", buf_modelos);
@@ -209,29 +259,11 @@ void iniciarDatosPlanetas() {
 // Esta función se llama cada frame dentro de tofu::update()
 // Es la manera que tenemos de indicar fuera de la librería qué objetos queremos dibujar y actualizar los uniforms que cambian cada frame
 void render() {
-    // Planetas
-    shader::usar("planetas");
-    shader::uniform("viewproj", viewproj); 
-    glDrawBuffers(color_att_dibujo.size(), color_att_dibujo.data());
-    DIBUJAR_SI(planetas, cull_planetas, num_planetas, esfera20) // Planetas
-    DIBUJAR_SI(asteroides, cull_asteroides, num_asteroides, esfera5) // Asteroides (modelo con menos resolucion) 
+    pedirTexturas();
 
-    // Orbitas
-    shader::usar("orbitas");
-    shader::uniform("viewproj", viewproj);
-    DIBUJAR_SI(orbitas, num_planetas, num_planetas, circulo)
-
-    // Estrellas
-    shader::usar("estrellas");
-    shader::uniform("time", tiempo);
-    shader::uniform("viewproj", viewproj);
-    DIBUJAR_SI(estrellas, cull_estrellas, num_estrellas, cubo)
-
-    // Dibujo en diferido
-    // Tomamos el framebuffer fbo_dibujo y lo mostramos en pantalla
-    shader::usar("deferred");
-    shader::uniform("viewpos", cam::pos);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    // Los pasos de dibujo están declarados en crearGrafo
+    // El grafo decide en qué orden se ejecutan y se salta los que no llegan a la pantalla
+    grafo::ejecutar();
     debug::gl();
 
     // ---
@@ -242,24 +274,113 @@ void render() {
 
     // Calculamos los modelos de los planetas y asteroides usando una vertex shader (no tenemos acceso a compute)
     // Utilizamos "transform feedback" para guardar los resultados directamente en buf_modelos
-    shader::usar("calc_modelos");
-    shader::uniform("time", tiempo);
-    shader::uniform("viewproj", viewproj);
-    shader::uniform("culling", 0);
-    cull_planetas = transformFeedback(0, num_planetas, gl.buffers[buf_modelos.b]);
-    cull_asteroides = transformFeedback(num_planetas, num_asteroides, gl.buffers[buf_modelos.b]);
+    // Los planetas se escriben todos, en orden, porque la cámara planeta los lee por su índice
+    // Con oclusión se descartan los asteroides tapados (permutación OCLUSION), y entonces se cuentan con una consulta como las estrellas
+    bool ocluir = culling and oclusion;
+    shader::definir("calc_modelos"_id, "OCLUSION", false);
+    shader::usar("calc_modelos"_id);
+    shader::uniform("sim_time"_id, tiempo);
+    cull_planetas = transformFeedback(0, num_planetas, buf_modelos.b);
+
+    shader::definir("calc_modelos"_id, "OCLUSION", ocluir);
+    shader::usar("calc_modelos"_id);
+    shader::uniform("sim_time"_id, tiempo);
+    if (ocluir)
+        hiz::uniforms();
+    cull_asteroides = transformFeedback(num_planetas, num_asteroides, buf_modelos.b, ocluir ? "tf_asteroides"_id : ConsultaId{});
 
     // Calculamos también las estrellas visibles (frustrum culling)
-    if (culling) {
-        shader::usar("calc_estrellas");
-        shader::uniform("viewproj", viewproj);
-        shader::uniform("culling", (int)culling);
-        cull_estrellas = transformFeedback(2*num_planetas + num_asteroides, num_estrellas, gl.buffers[buf_modelos.b]);
+    // En la CPU se comprueban sus esferas y se sube la lista de índices visibles, sin esperar a la GPU
+    // Con oclusión se quitan de la lista las que tapa el Sol, rasterizado también en la CPU (solo si se dibuja)
+    // Con el BVH solo se recorren sus nodos, y los visibles se dibujan como rangos sin lista de índices
+    if (culling and culling_bvh) {
+        cull_estrellas = bvh::frustum(arbol_estrellas, gl.proj * gl.view, rangos_estrellas);
+    } else if (culling and culling_cpu) {
+        cull_estrellas = visibilidad::frustum(esferas_estrellas, gl.proj * gl.view, estrellas_visibles);
+        if (oclusion and sgui.dibujar["planetas"]) {
+            auto& [v, i] = oclusor_sol;
+            oclusores::empezar(oclusion_cpu, gl.proj * gl.view);
+            oclusores::oclusor(oclusion_cpu, v.data(), v.size(), 3, i.data(), i.size(), modelo_sol);
+            oclusores::rasterizar(oclusion_cpu);
+            cull_estrellas = oclusores::filtrar(oclusion_cpu, esferas_estrellas, estrellas_visibles, cull_estrellas);
+        }
+        buffer::reemplazar(buf_visibles.b, estrellas_visibles.data(), cull_estrellas);
+    } else if (culling) {
+        shader::definir("calc_estrellas"_id, "CULLING");
+        shader::definir("calc_estrellas"_id, "OCLUSION", ocluir);
+        shader::usar("calc_estrellas"_id);
+        if (ocluir)
+            hiz::uniforms();
+        cull_estrellas = transformFeedback(2*num_planetas + num_asteroides, num_estrellas, buf_modelos.b, "tf_estrellas"_id);
     }
 
     // Calculamos la matriz de la cámara
+    // La vista, la proyección y el tiempo llegan a todas las shaders en el bloque FrameData, que se sube una vez por frame
     camara();
-    viewproj = gl.proj * gl.view;
+}
+
+// Grafo de renderizado
+// Los planetas y asteroides se dibujan en el G-buffer, las órbitas y estrellas directamente en pantalla, el paso
+// deferred ilumina el G-buffer y el paso de escalado lo compone encima. Si se ocultan planetas y asteroides, se saltan los tres
+// Todo lo que depende del G-buffer se dibuja a la resolución dinámica, las órbitas y estrellas siempre a resolución completa
+void crearGrafo() {
+    #ifdef USE_RETINA_FB
+        float escala = (float)gl.tam_fb.x / gl.tam_win.x;
+    #else
+        float escala = 1.f;
+    #endif
+    for (auto& [n, f] : gbuffer)
+        grafo::recurso(n, f, escala, true);
+
+    // La iluminación también se calcula a la resolución dinámica y se escala al final
+    grafo::recurso("iluminado", GL_RGBA8, escala, true);
+
+    grafo::paso("gbuffer", {}, { "albedo", "normal", "profundidad" }, [](){
+        gl.instancia_base = 0;
+        shader::usar("planetas"_id);
+        if (cam::modo == cam::CAMARA_PLANETA and sgui.clusters) { // Planetas, el de la cámara por clusters
+            if (sgui.dibujar["planetas"])
+                dibujarPlanetaCercano();
+            gl.instancia_base += num_planetas;
+        } else {
+            DIBUJAR_SI(planetas, cull_planetas, num_planetas, esfera_planeta) // Planetas
+        }
+        DIBUJAR_SI(asteroides, cull_asteroides, num_asteroides, esfera_asteroide) // Asteroides (modelo con menos resolucion)
+    }, ACTIVO_SI("planetas", "asteroides"));
+
+    grafo::paso("orbitas", {}, { grafo::pantalla }, [](){
+        gl.instancia_base = num_planetas + num_asteroides;
+        shader::usar("orbitas"_id);
+        DIBUJAR_SI(orbitas, num_planetas, num_planetas, circulo)
+    }, ACTIVO_SI("orbitas"));
+
+    grafo::paso("estrellas", {}, { grafo::pantalla }, [](){
+        gl.instancia_base = 2*num_planetas + num_asteroides;
+        shader::definir("estrellas"_id, "INDICES", culling and culling_cpu);
+        shader::usar("estrellas"_id);
+        if (culling and culling_cpu)
+            shader::uniform("bvisibles"_id, buf_visibles);
+        if (culling and culling_bvh) {
+            if (sgui.dibujar["estrellas"])
+                dibujarRangos(rangos_estrellas, "cubo"_id);
+        } else {
+            DIBUJAR_SI(estrellas, cull_estrellas, num_estrellas, cubo)
+        }
+    }, ACTIVO_SI("estrellas"));
+
+    // Dibujo en diferido
+    // Iluminamos el G-buffer con un triángulo que cubre toda la imagen, y el paso de escalado lo lleva a la pantalla
+    grafo::paso("deferred", { "albedo", "normal", "profundidad" }, { "iluminado" }, [](){
+        shader::usar("deferred"_id);
+        shader::uniform("color"_id, grafo::vincular("albedo"));
+        shader::uniform("normal"_id, grafo::vincular("normal"));
+        shader::uniform("depth"_id, grafo::vincular("profundidad"));
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+    resolucion::escalar("iluminado");
+
+    // Pirámide de profundidad del G-buffer para descartar en el siguiente frame lo que tapan los planetas
+    hiz::paso("profundidad", [](){ return culling and oclusion; });
 }
 
 // ---
@@ -277,6 +398,10 @@ int main(int arcg, char** argv) {
     // Iniciamos GLFW y OpenGL
     initGL(WIDTH, HEIGHT, "Sistema Solar");
 
+    // Si se ha generado el paquete de recursos (make paquete), las shaders, texturas y figuras se leen de él
+    if (fs::exists("datos.tofu"))
+        paquete::abrir("datos.tofu");
+
     // Creamos los buffers principales que almacenan la información por instancia
     buffer::iniciarVAO(atributos);
     buffer::iniciarVAO(atributos_planeta, "vao_vacio");
@@ -284,42 +409,43 @@ int main(int arcg, char** argv) {
     buf_modelos = texbuffer::crear<glm::mat4>();
     buf_color = texbuffer::crear<glm::vec4>();
     buf_estrellas = texbuffer::crear<glm::mat4>();
-
-    // Creamos el framebuffer necesario para hacer deferred rendering
-    #ifdef USE_RETINA_FB
-        glm::uvec2 tam = gl.tam_fb;
-    #else
-        glm::uvec2 tam = gl.tam_win;
-    #endif
-    fbo_dibujo = framebuffer::crear(tam, {0.f, 0.f, 0.f, 0.f}, attachments_dibujo);
+    buf_visibles = texbuffer::crear<ui32>();
 
     // Cargamos las shader a utilizar
-    shader::cargar("planetas", "main", fbo_dibujo, { .blend = false });
+    // Se envían todas en un lote para que el driver las compile mientras cargamos el resto de datos
+    // Las que se usan antes de terminar el lote (para poner uniforms) se esperan individualmente
+    shader::empezarLote();
+    // Las opciones que se cambian desde la interfaz son defines, cada combinación es una permutación distinta
+    shader::cargar("planetas", "main", 0, { .blend = false }, {}, { "LUZ" });
     shader::cargar("orbitas");
     shader::cargar("estrellas");
     shader::cargar("calc_modelos", "vao_vacio", 0, {}, { "out_modelo" });
-    shader::cargar("calc_estrellas", "vao_vacio", 0, {}, { "out_modelo" });
-    shader::cargar("deferred", "vao_vacio", 0);
-
-    // Especificamos los attachments a usar en deferred
-    shader::usar("deferred");
-    shader::uniform("color", (int)framebuffer::fb_offset + 0);
-    shader::uniform("normal", (int)framebuffer::fb_offset + 1);
-    shader::uniform("pos", (int)framebuffer::fb_offset + 2);
-    shader::uniform("depth", (int)framebuffer::fb_offset + 3);
-    shader::uniform("tam_win", glm::vec2(gl.tam_win));
-    shader::uniform("activar_bordes", 0.f);
-    shader::uniform("activar_toon", 0.f); 
+    shader::cargar("calc_estrellas", "vao_vacio", 0, {}, { "out_modelo" }, { "CULLING" });
+    shader::cargar("deferred", "vao_vacio", 0, { .blend = false });
+
+    // Creamos el grafo de renderizado con los pasos de dibujo y el G-buffer
+    // Con resolución dinámica el G-buffer se reduce si el frame tarda más de 16ms en la GPU
+    crearGrafo();
+    resolucion::activar(1000.f / 60.f);
 
     // Cargamos en memoria las figuras a dibujar
     // Se añaden automáticamente al VBO/EBO y guardamos la información de indexado
     // Utilizamos un mismos buffer para guardar todos los vértices y pasamos offsets al dibujar
     // Esto evita que tengamos que desvincular y vincular varios VBOs en cada frame, operación bastante costosa
     // Además, si tuvieramos acceso, es la manera más recomendada de hacer renderizado indirecto
-    buffer::cargarVert("esfera20", geometria::esferaOct(20));
-    buffer::cargarVert("esfera5", geometria::esferaOct(5));
-    buffer::cargarVert("cubo", geometria::cubo());
-    buffer::cargarVert("circulo", geometria::circulo(100), "main", GL_LINE_STRIP); 
+    // Las figuras pequeñas se generan al compilar, y la esfera grande al iniciar si no está en el paquete
+    // Si están en el paquete de recursos, las figuras se suben directamente desde él
+    // Las esferas son icosaedros subdivididos, que tienen el mismo error en la silueta que las de octaedro que se usaban antes
+    // (esferaOct con 20 y 5 subdivisiones) con menos vértices: 1212 en vez de 1602 y 92 en vez de 102 (ver geometria::mejorEsfera)
+    // La de los planetas se agrupa en clusters para dibujar solo las partes visibles en el modo planeta (ya viene agrupada en el paquete)
+    if (not buffer::cargarMalla("esfera_planeta"))
+        buffer::cargarVertClusters("esfera_planeta", geometria::esfera(geometria::ICOSAEDRO, 11));
+    static constexpr auto esfera_asteroide = geometria::icosferaFija<3>();
+    buffer::cargarVert("esfera_asteroide", esfera_asteroide);
+    static constexpr auto cubo = geometria::cubo();
+    buffer::cargarVert("cubo", cubo);
+    if (not buffer::cargarMalla("circulo"))
+        buffer::cargarVert("circulo", geometria::circulo(100), "main", GL_LINE_STRIP);
 
     // Generador de números aleatorios
     std::srand(std::time(nullptr));
@@ -330,9 +456,8 @@ int main(int arcg, char** argv) {
     crearMateriales();
     iniciarDatosPlanetas(); 
 
-    // Creamos queries
-    glGenQueries(1, &tf_query);
-    debug::gl();
+    // Esperamos a las shaders que falten
+    shader::terminarLote();
 
 	// Llamamos al bucle principal de la aplicación
     // Devuelve false cuando se cierra la ventana
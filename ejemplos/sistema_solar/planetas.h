@@ -78,41 +78,117 @@ inline float velocidad = 1.0;
 // Habilitar / deshabilitar culling
 inline bool culling = true;
 
-// Query para contar las instancias renderizadas con transform feedback
-inline ui32 tf_query, cull_planetas, cull_asteroides, cull_estrellas;
+// Culling de las estrellas en la CPU (visibilidad::frustum) en vez de con transform feedback
+// No espera a la GPU para saber cuántas son visibles, y la lista de índices se sube a buf_visibles
+inline bool culling_cpu = false;
+inline visibilidad::Esferas esferas_estrellas;
+inline std::vector<ui32> estrellas_visibles;
+inline TexBuffer buf_visibles;
+
+// Culling de las estrellas por nodos de un BVH (bvh.h), construido una vez porque las estrellas no se mueven
+// Las estrellas se guardan en el orden de los nodos, así que cada nodo visible es un rango seguido de buf_modelos
+// que se dibuja desplazando la instancia base, sin compactar nada
+inline bool culling_bvh = false;
+inline bvh::Arbol arbol_estrellas;
+inline std::vector<glm::uvec2> rangos_estrellas;
+
+// Oclusión, solo con culling
+// Con transform feedback se usa la pirámide de profundidad (hiz.h): los asteroides y estrellas tapados por los planetas
+// en el frame anterior no se escriben en buf_modelos, y los asteroides pasan a contarse con una consulta como las estrellas
+// Con el culling en la CPU se rasteriza el Sol en la CPU (oclusores.h) y se quitan de la lista las estrellas que tapa
+// El Sol es el único planeta que no se mueve, así que es el único del que conocemos el modelo sin leerlo de la GPU
+inline bool oclusion = false;
+inline oclusores::Buffer oclusion_cpu;
+inline std::pair<std::vector<float>, std::vector<ui32>> oclusor_sol;
+inline glm::mat4 modelo_sol;
+
+// Instancias a dibujar después del culling
+inline ui32 cull_planetas, cull_asteroides, cull_estrellas;
 
 // ---
 
 // Calcular modelos
-inline int transformFeedback(int base, int num, Buffer &b) {
+// Si se indica una consulta, el número de modelos escritos se cuenta con ella en el pool de consultas (solo hace falta
+// con culling, sin él se escriben todos). El resultado llega uno o dos frames tarde sin esperar a la GPU, así que
+// para no perder instancias que acaban de entrar en pantalla se dibujan algunas de más, y para que esas sobrantes
+// no muestren modelos antiguos antes se pone a cero el rango (una matriz nula no dibuja nada)
+inline ui32 transformFeedback(int base, int num, ui32 buffer, ConsultaId consulta = {}) {
+    Buffer& b = gl.buffers[buffer];
+    if (not consulta.vacio())
+        buffer::borrar(buffer, num, base);
+
     // Transform feedback
     glEnable(GL_RASTERIZER_DISCARD);
     glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, b.buffer, base * b.bytes, num * b.bytes);
-    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, tf_query);
+    if (not consulta.vacio())
+        consulta::empezar(consulta, GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
     glBeginTransformFeedback(GL_POINTS);
 
     // "Dibujar" los modelos en el buffer
-    shader::uniform("baseins", base);
+    shader::uniform("baseins"_id, base);
     glDrawArrays(GL_POINTS, 0, num);
    
     // Acabar transform feedback
     glEndTransformFeedback();
-    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    if (not consulta.vacio())
+        consulta::terminar(consulta);
     glDisable(GL_RASTERIZER_DISCARD);
+    debug::gl();
+
+    // Número de modelos que se han dibujado, con margen
+    if (consulta.vacio())
+        return num;
+    auto n = consulta::resultado(consulta);
+    return n ? std::min<ui32>(num, *n + *n / 8 + 64) : num;
+}
 
-    // Obtener el número de modelos que se han dibujado
-    ui32 num_modelos;
-    glGetQueryObjectuiv(tf_query, GL_QUERY_RESULT, &num_modelos);
+// Leer los modelos como atributos por instancia (glVertexAttribDivisor) en vez de con texelFetch
+// Permite comparar los dos métodos en el panel de rendimiento
+inline void atributosInstancia(bool activar) {
+    if (activar)
+        buffer::atributosInstancia("main", buf_modelos.b, { 4, 4, 4, 4 });
+    else
+        buffer::quitarAtributosInstancia("main");
+    for (auto s : { "planetas", "orbitas", "estrellas" })
+        shader::definir(s, "ATRIBUTOS", activar);
+}
 
-    debug::gl();
-    return num_modelos;
+// Escribir todas las estrellas en orden en buf_modelos
+// Los modos de culling que no compactan con transform feedback las leen por su posición
+inline void escribirEstrellas() {
+    shader::definir("calc_estrellas", "CULLING", false);
+    shader::definir("calc_estrellas", "OCLUSION", false);
+    shader::usar("calc_estrellas");
+    transformFeedback(2*num_planetas + num_asteroides, num_estrellas, buf_modelos.b);
+}
+
+// Cambiar entre el culling de las estrellas en la CPU y con transform feedback
+// Los índices visibles apuntan a las estrellas de buf_modelos, así que al activarlo se escriben todas en orden
+inline void cullingCPU(bool activar) {
+    culling_cpu = activar;
+    if (not activar)
+        return;
+    culling_bvh = false;
+    escribirEstrellas();
+}
+
+// Cambiar entre el culling de las estrellas por nodos del BVH y con transform feedback
+inline void cullingBVH(bool activar) {
+    culling_bvh = activar;
+    if (not activar)
+        return;
+    culling_cpu = false;
+    escribirEstrellas();
 }
 
 // Desactivar culling (activa todas las estrellas)
 inline void desactivarCulling() {
     culling = false;
+    consulta::reiniciar("tf_estrellas"_id);
+    consulta::reiniciar("tf_asteroides"_id);
 
+    shader::definir("calc_estrellas", "CULLING", false);
+    shader::definir("calc_estrellas", "OCLUSION", false);
     shader::usar("calc_estrellas");
-    shader::uniform("culling", 0);
-    cull_estrellas = transformFeedback(2*num_planetas + num_asteroides, num_estrellas, gl.buffers[buf_modelos.b]);
+    cull_estrellas = transformFeedback(2*num_planetas + num_asteroides, num_estrellas, buf_modelos.b);
 }
@@ -1,8 +1,10 @@
 #version 330 core
 
-uniform mat4 viewproj;
+#include "tofu/frame.glsl"
+#include "comun/frustum.glsl"
+#include "tofu/hiz.glsl"
+
 uniform int baseins;
-uniform int culling;
 
 uniform samplerBuffer bestrellas;
 
@@ -12,20 +14,6 @@ out float id;
 
 // ---
 
-// Frustum culling en espacio clip
-int fustrum(mat4 m, float r) {
-    // En este caso solo usamos la posición porque están tan lejos que las podemos tratar como un punto
-    vec4 pos = (viewproj * m)[3];
-    if (pos.x < -pos.w || pos.x > pos.w)
-        return 0;
-    if (pos.y < -pos.w || pos.y > pos.w)
-        return 0;
-
-    return 1;
-}
-
-// ---
-
 void main() {
     // Numero de vértice
     int ins = baseins + gl_VertexID;
@@ -39,9 +27,18 @@ void main() {
         texelFetch(bestrellas, ins * 4 + 3)
     );
 
-    // Frustum culling
-    if (culling == 1)
-        visible = fustrum(modelo, 1.0);
-    else
-        visible = 1;
+    // Frustum culling (permutación CULLING)
+    // Las estrellas están tan lejos que las podemos tratar como un punto
+    #ifdef CULLING
+    visible = fustrum(modelo, 0.0);
+    #else
+    visible = 1;
+    #endif
+
+    // Oclusión con la pirámide de profundidad del frame anterior (permutación OCLUSION)
+    // Las estrellas son cubos de lado 2, los tapan los planetas que hay delante
+    #ifdef OCLUSION
+    if (visible == 1 && ocluido(modelo[3].xyz, sqrt(3.0)))
+        visible = 0;
+    #endif
 }
@@ -1,13 +1,18 @@
 #version 330 core
 
-uniform float time;
-uniform mat4 viewproj;
+#include "tofu/frame.glsl"
+#include "comun/aleatorio.glsl"
+#include "comun/transformaciones.glsl"
+#include "comun/frustum.glsl"
+#include "tofu/hiz.glsl"
+
+uniform float sim_time;
 uniform int baseins;
-uniform int culling;
 
 uniform samplerBuffer bplanetas;
 
 out mat4 modelo;
+out float uniforme;
 out int visible;
 out float id;
 out float mat;
@@ -16,54 +21,9 @@ out float mat;
 
 // ---
 
-float rand(float n){
-    return fract(sin(n) * 43758.5453123);
-}
-
-mat4 translate(vec3 v) {
-    return mat4(1.0, 0.0, 0.0, 0.0,
-                0.0, 1.0, 0.0, 0.0,
-                0.0, 0.0, 1.0, 0.0,
-                v.x, v.y, v.z, 1.0);
-}
-
-mat4 scale(vec3 v) {
-    return mat4(v.x, 0.0, 0.0, 0.0,
-                0.0, v.y, 0.0, 0.0,
-                0.0, 0.0, v.z, 0.0,
-                0.0, 0.0, 0.0, 1.0);
-}
-
-mat4 rotate(float angle, vec3 v) {
-    float c = cos(angle);
-    float s = sin(angle);
-    float t = 1.0 - c;
-
-    return mat4(t * v.x * v.x + c,       t * v.x * v.y - s * v.z, t * v.x * v.z + s * v.y, 0.0,
-                t * v.x * v.y + s * v.z, t * v.y * v.y + c,       t * v.y * v.z - s * v.x, 0.0,
-                t * v.x * v.z - s * v.y, t * v.y * v.z + s * v.x, t * v.z * v.z + c,       0.0,
-                0.0,                     0.0,                     0.0,                     1.0);
-}
-
-// ---
-
-// Frustum culling en espacio clip
-int fustrum(mat4 m, float r) {
-    vec4 pos = viewproj * m[3];
-    pos.w += (viewproj * vec4(r)).w;
-    if (pos.x < -pos.w || pos.x > pos.w)
-        return 0;
-    if (pos.y < -pos.w || pos.y > pos.w)
-        return 0;
-
-    return 1;
-}
-
-// ---
-
 mat4 calcularModelo(float r, float d, float i, float exc, bool padre) {
     float v = d > 1.0 ? (10.0 / d + rand(i * 55) * 0.05) * 0.5 : 0.0;
-    float pos = time * v + rand(i * 67) * 10.0;
+    float pos = sim_time * v + rand(i * 67) * 10.0;
 
     mat4 m = translate(vec3(d * ((1.0 + exc) * cos(pos) - exc), 0.0, d * sin(pos)));
     if (!padre)
@@ -79,6 +39,7 @@ void main() {
 
     // Obtener los datos del buffer de entrada
     vec4 buf = texelFetch(bplanetas, ins);
+    float radio = buf.x;
     float padre = buf.z;
 
     // Transformación del planeta
@@ -99,9 +60,25 @@ void main() {
         modelo = mp * modelo;
     }
 
-    // Frustum culling
-    if (culling == 1)
-        visible = fustrum(modelo, buf.x);
-    else
-        visible = 1;
+    // Comprobamos una vez por instancia si el modelo solo rota y escala uniformemente
+    // En ese caso la matriz normal es la propia rotación (la normal se normaliza al final), y al dibujar
+    // no hace falta invertir la matriz en cada vértice
+    mat3 r = mat3(modelo);
+    vec3 l = vec3(dot(r[0], r[0]), dot(r[1], r[1]), dot(r[2], r[2]));
+    vec3 o = abs(vec3(dot(r[0], r[1]), dot(r[0], r[2]), dot(r[1], r[2])));
+    float e = 1e-4 * max(l.x, max(l.y, l.z));
+    uniforme = float(abs(l.x - l.y) <= e && abs(l.x - l.z) <= e && max(o.x, max(o.y, o.z)) <= e);
+
+    // Frustum culling (permutación CULLING)
+    #ifdef CULLING
+    visible = fustrum(modelo, buf.x);
+    #else
+    visible = 1;
+    #endif
+
+    // Oclusión con la pirámide de profundidad del frame anterior (permutación OCLUSION)
+    #ifdef OCLUSION
+    if (ocluido(modelo[3].xyz, radio))
+        visible = 0;
+    #endif
 }
@@ -0,0 +1,9 @@
+// Hashes pseudo-aleatorios
+
+float rand(float n) {
+    return fract(sin(n) * 43758.5453123);
+}
+
+float rand(vec2 co) { return fract(sin(dot(co.xy, vec2(12.9898, 78.233))) * 43758.5453); }
+float rand(vec2 co, float l) { return rand(vec2(rand(co), l)); }
+float rand(vec2 co, float l, float t) { return rand(vec2(rand(co, l), t)); }
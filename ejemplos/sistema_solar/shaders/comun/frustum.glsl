@@ -0,0 +1,15 @@
+// Frustum culling en espacio clip
+// Con r = 0 el objeto se trata como un punto (por ejemplo, las estrellas, que están muy lejos)
+
+#include "tofu/frame.glsl"
+
+int fustrum(mat4 m, float r) {
+    vec4 pos = viewproj * m[3];
+    pos.w += (viewproj * vec4(r)).w;
+    if (pos.x < -pos.w || pos.x > pos.w)
+        return 0;
+    if (pos.y < -pos.w || pos.y > pos.w)
+        return 0;
+
+    return 1;
+}
@@ -0,0 +1,26 @@
+// Matrices de transformación (equivalentes a las de glm)
+
+mat4 translate(vec3 v) {
+    return mat4(1.0, 0.0, 0.0, 0.0,
+                0.0, 1.0, 0.0, 0.0,
+                0.0, 0.0, 1.0, 0.0,
+                v.x, v.y, v.z, 1.0);
+}
+
+mat4 scale(vec3 v) {
+    return mat4(v.x, 0.0, 0.0, 0.0,
+                0.0, v.y, 0.0, 0.0,
+                0.0, 0.0, v.z, 0.0,
+                0.0, 0.0, 0.0, 1.0);
+}
+
+mat4 rotate(float angle, vec3 v) {
+    float c = cos(angle);
+    float s = sin(angle);
+    float t = 1.0 - c;
+
+    return mat4(t * v.x * v.x + c,       t * v.x * v.y - s * v.z, t * v.x * v.z + s * v.y, 0.0,
+                t * v.x * v.y + s * v.z, t * v.y * v.y + c,       t * v.y * v.z - s * v.x, 0.0,
+                t * v.x * v.z - s * v.y, t * v.y * v.z + s * v.x, t * v.z * v.z + c,       0.0,
+                0.0,                     0.0,                     0.0,                     1.0);
+}
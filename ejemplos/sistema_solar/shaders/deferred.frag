@@ -1,16 +1,16 @@
 #version 330 core
 
 in vec2 uv;
+#ifdef BORDES
 in vec2 coords[9];
+#endif
 
+// G-buffer compacto (ver planetas.frag)
 uniform sampler2D color;
 uniform sampler2D normal;
-uniform sampler2D pos;
 uniform sampler2D depth;
 
-uniform vec3 viewpos;
-uniform float activar_bordes;
-uniform float activar_toon;
+#include "tofu/frame.glsl"
 
 out vec4 color_out;
 
@@ -23,22 +23,23 @@ const float brillo_especular = 8.0;
 const float num_colores = 3.0;
 const float saturacion = 0.8;
 
+#include "comun/color.glsl"
+
 // ---
 
-vec3 hsv_to_rgb(vec3 c) {
-    vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);
-    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);
-    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
+// Recuperar la normal guardada en coordenadas octaédricas
+vec3 desdeOctaedro(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
 }
 
-vec3 rgb_to_hsv(vec3 c) {
-    vec4 K = vec4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
-    vec4 p = mix(vec4(c.bg, K.wz), vec4(c.gb, K.xy), step(c.b, c.g));
-    vec4 q = mix(vec4(p.xyw, c.r), vec4(c.r, p.yzx), step(p.x, c.r));
-
-    float d = q.x - min(q.w, q.y);
-    float e = 1.0e-10;
-    return vec3(abs(q.z + (q.w - q.y) / (6.0 * d + e)), d / (q.x + e), q.x);
+// Reconstruir la posición en el mundo a partir de la profundidad y la inversa de viewproj
+vec3 posicion(vec2 coord) {
+    float d = texture(depth, coord).r;
+    vec4 p = invviewproj * vec4(coord * 2.0 - 1.0, d * 2.0 - 1.0, 1.0);
+    return p.xyz / p.w;
 }
 
 // ---
@@ -53,7 +54,7 @@ float iluminacion(vec3 normal, vec3 pos, float iluminar) {
     vec3 dir_luz = normalize(pos_luz - pos);
     float difusa = max(dot(normal, dir_luz) * 0.8 + 0.5, 0.0);
 
-    vec3 dir_view = normalize(viewpos - pos);
+    vec3 dir_view = normalize(viewpos.xyz - pos);
     vec3 dir_refl = reflect(-dir_luz, normal);
     float especular = pow(max(dot(dir_view, dir_refl), 0.0), brillo_especular) * fuerza_especular;
     
@@ -62,6 +63,8 @@ float iluminacion(vec3 normal, vec3 pos, float iluminar) {
 
 // ---
 
+// Detección de bordes con un filtro de Sobel sobre la profundidad (permutación BORDES)
+#ifdef BORDES
 float linearDepth(vec2 coord) {
     float d = length(texture(depth, coord).rgb);
     return (2.0 * near) / (far + near - d * (far - near));
@@ -76,23 +79,30 @@ void sobelKernel(inout float n[9]) {
     for (int i = 0; i < 9; i++)
         n[i] = linearDepth(coordenada(i));
 }
+#endif
 
 // ---
 
 void main() {
     vec4 c = texture(color, uv);
-    vec4 n = texture(normal, uv);
-    vec4 p = texture(pos, uv);
+    vec3 n = desdeOctaedro(texture(normal, uv).rg);
+    vec3 p = posicion(uv);
+
+    // El alfa del albedo indica si hay objeto y si se ilumina
+    float iluminar = float(c.a > 0.75);
+    c.a = float(c.a > 0.25);
 
     // Iluminación
     vec3 hsv = rgb_to_hsv(c.rgb);
-    float i = iluminacion(n.xyz, p.xyz, p.a);
-    if (activar_toon > 0.5)
-        i = (floor(i * num_colores) + 0.3) / num_colores;
+    float i = iluminacion(n, p, iluminar);
+    #ifdef TOON
+    i = (floor(i * num_colores) + 0.3) / num_colores;
+    #endif
     c.rgb = hsv_to_rgb(vec3(hsv.r, saturacion, i * (hsv.b * 0.5 + 0.5)));
 
     // Detección de ejes
-    if (activar_bordes > 0.5) {
+    #ifdef BORDES
+    {
         float n[9];
         sobelKernel(n);
         float sobel_h = n[2] + (2.0*n[5]) + n[8] - (n[0] + (2.0*n[3]) + n[6]);
@@ -110,7 +120,8 @@ void main() {
             cmix = vec3(borde) * vec3(1.0, 0.9, 0.5);
 
         color_out = vec4(cmix, 1.0);
-    } else {
-        color_out = c;
     }
+    #else
+    color_out = c;
+    #endif
 }
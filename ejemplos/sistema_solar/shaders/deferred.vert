@@ -1,9 +1,13 @@
 #version 330 core
 
-uniform vec2 tam_win;
+#include "tofu/frame.glsl"
+
+uniform sampler2D depth;
 
 out vec2 uv;
+#ifdef BORDES
 out vec2 coords[9];
+#endif
 
 const float grosor_linea = 1.0;
 
@@ -14,8 +18,13 @@ void main() {
     gl_Position = vec4(uv, 0.0, 1.0);
     uv = 0.5 * uv + vec2(0.5);
 
-    float w = grosor_linea / tam_win.x;
-    float h = grosor_linea / tam_win.y;
+    // Vecinos para la detección de bordes (permutación BORDES)
+    #ifdef BORDES
+
+    // El G-buffer puede ser más pequeño que la ventana con resolución dinámica
+    vec2 tam = vec2(textureSize(depth, 0));
+    float w = grosor_linea / tam.x;
+    float h = grosor_linea / tam.y;
     coords = vec2[9](
         vec2( -w, -h),
         vec2(0.0, -h),
@@ -27,4 +36,5 @@ void main() {
         vec2(0.0, h),
         vec2(  w, h)
     );
+    #endif
 }
@@ -2,33 +2,45 @@
 
 layout (location = 0) in vec3 in_pos;
 
-uniform float time;
-uniform mat4 viewproj;
+#if defined(ATRIBUTOS) && !defined(INDICES)
+layout (location = 1) in mat4 in_modelo;
+#endif
+
+#include "tofu/frame.glsl"
+#include "comun/aleatorio.glsl"
+
 uniform int baseins;
 
 uniform samplerBuffer bestrellas;
 
-out vec3 color;
+// Con la permutación INDICES el culling se hace en la CPU y cada instancia lee el índice de una estrella visible
+#ifdef INDICES
+uniform usamplerBuffer bvisibles;
+#endif
 
-// ---
-
-float rand(float n){
-    return fract(sin(n) * 43758.5453123);
-}
+out vec3 color;
 
 // ---
 
 void main() {
     // Numero de instancia
+    #ifdef INDICES
+    int ins = baseins + int(texelFetch(bvisibles, gl_InstanceID).r);
+    #else
     int ins = baseins + gl_InstanceID; 
+    #endif
 
     // Modelos
+    #if defined(ATRIBUTOS) && !defined(INDICES)
+    mat4 m = in_modelo;
+    #else
     mat4 m = mat4(
         texelFetch(bestrellas, ins * 4 + 0),
         texelFetch(bestrellas, ins * 4 + 1),
         texelFetch(bestrellas, ins * 4 + 2),
         texelFetch(bestrellas, ins * 4 + 3)
     );
+    #endif
     int id = int(m[0][3]);
     m[0][3] = 0.0;
 
@@ -2,7 +2,12 @@
 
 layout (location = 0) in vec3 in_pos;
 
-uniform mat4 viewproj;
+#ifdef ATRIBUTOS
+layout (location = 1) in mat4 in_modelo;
+#endif
+
+#include "tofu/frame.glsl"
+
 uniform int baseins;
 
 uniform samplerBuffer borbitas;
@@ -16,12 +21,16 @@ void main() {
     int ins = baseins + gl_InstanceID; 
 
     // Modelos
+    #ifdef ATRIBUTOS
+    mat4 m = in_modelo;
+    #else
     mat4 m = mat4(
         texelFetch(borbitas, ins * 4 + 0),
         texelFetch(borbitas, ins * 4 + 1),
         texelFetch(borbitas, ins * 4 + 2),
         texelFetch(borbitas, ins * 4 + 3)
     );
+    #endif
 
     gl_Position = viewproj * m * vec4(in_pos, 1.0);
     pos = in_pos;
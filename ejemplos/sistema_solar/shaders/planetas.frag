@@ -3,23 +3,34 @@
 in vec3 pos;
 in vec4 color;
 in vec3 normal;
-in vec4 frag_pos;
 in float iluminar;
 in float mat;
 
 uniform sampler2DArray albedo;
 
+// G-buffer compacto:
+// 0 - albedo (RGBA8), el alfa indica si hay objeto (> 0) y si se ilumina (1) o no (0.5)
+// 1 - normal en coordenadas octaédricas (RG16F)
+// La posición se reconstruye a partir de la profundidad en deferred.frag
 layout (location = 0) out vec4 color_out;
-layout (location = 1) out vec4 normal_out;
-layout (location = 2) out vec4 pos_out;
+layout (location = 1) out vec2 normal_out;
+
+// ---
+
+// Proyectar una normal sobre un octaedro y desplegarlo en un cuadrado [-1, 1]
+vec2 octaedro(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
 
 // ---
 
 void main() {
     vec3 x = texture(albedo, vec3(pos.zy, color.w)).rgb;
     vec3 z = texture(albedo, vec3(pos.xy, color.w)).rgb;
-    color_out = vec4((x + z) * 0.5 * color.rgb + 0.15, 1.0);
+    color_out = vec4((x + z) * 0.5 * color.rgb + 0.15, iluminar > 0.5 ? 1.0 : 0.5);
 
-    normal_out = vec4(normal, 1.0);
-    pos_out = vec4(frag_pos.xyz, iluminar);
+    normal_out = octaedro(normalize(normal));
 }
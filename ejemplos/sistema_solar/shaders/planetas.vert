@@ -2,9 +2,15 @@
 
 layout (location = 0) in vec3 in_pos;
 
+// Con la permutación ATRIBUTOS el modelo llega como atributo por instancia en vez de leerlo de bmodelos
+#ifdef ATRIBUTOS
+layout (location = 1) in mat4 in_modelo;
+#endif
+
+#include "tofu/frame.glsl"
+#include "comun/aleatorio.glsl"
+
 uniform int baseins;
-uniform mat4 viewproj;
-uniform float activar_luz;
 
 uniform samplerBuffer bmodelos;
 uniform samplerBuffer bcolor;
@@ -13,7 +19,6 @@ uniform samplerBuffer bmateriales;
 out vec3 pos;
 out vec4 color;
 out vec3 normal;
-out vec4 frag_pos;
 out float iluminar;
 out float mat;
 
@@ -21,11 +26,6 @@ out float mat;
 
 #define M_PI 3.14159265358979323846
 
-// Hashes pseudo-aleatorios
-float rand (vec2 co){return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);}
-float rand (vec2 co, float l) {return rand(vec2(rand(co), l));}
-float rand (vec2 co, float l, float t) {return rand(vec2(rand(co, l), t));}
-
 // Ruído Perlin
 float perlin(vec2 p, float dim, float time) {
 	vec2 pos = floor(p * dim);
@@ -55,27 +55,38 @@ void main() {
     int ins = baseins + gl_InstanceID;
 
     // Datos de la instancia de los buffers
+    #ifdef ATRIBUTOS
+    mat4 m = in_modelo;
+    #else
     mat4 m = mat4(
         texelFetch(bmodelos, ins * 4 + 0),
         texelFetch(bmodelos, ins * 4 + 1),
         texelFetch(bmodelos, ins * 4 + 2),
         texelFetch(bmodelos, ins * 4 + 3)
     );
+    #endif
     int id = int(m[0][3]);
+    bool uniforme = m[1][3] != 0.0;
     m[0][3] = 0.0;
+    m[1][3] = 0.0;
 
     // Outputs
     color = texelFetch(bcolor, id);
-    normal = mat3(transpose(inverse(m))) * in_pos;
+    // Con escala uniforme (marcado en calc_modelos) la matriz normal es la rotación del modelo
+    // Solo los modelos con escala no uniforme o cizalla necesitan la inversa
+    normal = uniforme ? mat3(m) * in_pos : transpose(inverse(mat3(m))) * in_pos;
     iluminar = float(m[3][0] != 0.0 || m[3][2] != 0.0);
 
     // Posición
     float disp = 1.0;
     if (iluminar > 0.5)
         disp = perlin(in_pos.xy, 4.0 / ceil(m[1][1] * 4.0), 0.0) * 0.1 + 0.9;
-    frag_pos = m * vec4(in_pos * disp, 1.0);
+    vec4 frag_pos = m * vec4(in_pos * disp, 1.0);
     gl_Position = viewproj * frag_pos;
     pos = in_pos * 0.5 + 0.5;
 
-    iluminar *= activar_luz;
+    // Sin la permutación LUZ todos los planetas se dibujan sin iluminar
+    #ifndef LUZ
+    iluminar = 0.0;
+    #endif
 }
@@ -9,10 +9,12 @@ using namespace tofu;
 
 #ifndef DISABLE_GUI
     #define DIBUJAR_SI(nombre, num, num_base, shader) \
-        if (sgui.dibujar[#nombre]) { dibujar(num, #shader); } \
+        if (sgui.dibujar[#nombre]) { dibujar(num, #shader ## _id); } \
         gl.instancia_base += num_base;
+    #define ACTIVO_SI(...) [](){ for (str n : { __VA_ARGS__ }) if (sgui.dibujar[n]) return true; return false; }
 #else
-    #define DIBUJAR_SI(nombre, num, shader) dibujar(num, #shader);
+    #define DIBUJAR_SI(nombre, num, shader) dibujar(num, #shader ## _id);
+    #define ACTIVO_SI(...) nullptr
 #endif
 
 // ---
@@ -32,6 +34,8 @@ inline struct SolarGui {
     bool activar_luz = true;
     bool activar_bordes = false;
     bool activar_toon = false;
+    bool atributos_instancia = false;
+    bool clusters = true;
 } sgui;
 #endif
 
@@ -83,21 +87,31 @@ inline void solar_gui() {
         ImGui::BeginDisabled(cam::modo != cam::CAMARA_LIBRE);
         if (ImGui::Checkbox("culling", &culling) and not culling)
             desactivarCulling();
+        if (ImGui::Checkbox("culling en la CPU", &culling_cpu))
+            cullingCPU(culling_cpu);
+        if (ImGui::Checkbox("culling por nodos (BVH)", &culling_bvh))
+            cullingBVH(culling_bvh);
+        if (ImGui::Checkbox("oclusión", &oclusion)) {
+            consulta::reiniciar("tf_asteroides"_id);
+            consulta::reiniciar("tf_estrellas"_id);
+        }
         ImGui::EndDisabled();
 
         // Iluminación y bordes
-        if (ImGui::Checkbox("iluminación", &sgui.activar_luz)) {
-            shader::usar("planetas");
-            shader::uniform("activar_luz", sgui.activar_luz ? 1.f : 0.f);
-        }
-        if (ImGui::Checkbox("bordes", &sgui.activar_bordes)) {
-            shader::usar("deferred");
-            shader::uniform("activar_bordes", sgui.activar_bordes ? 1.f : 0.f);
-        }
-        if (ImGui::Checkbox("toon shading", &sgui.activar_toon)) {
-            shader::usar("deferred");
-            shader::uniform("activar_toon", sgui.activar_toon ? 1.f : 0.f);
-        }
+        // Cada opción cambia a otra permutación de la shader
+        if (ImGui::Checkbox("iluminación", &sgui.activar_luz))
+            shader::definir("planetas", "LUZ", sgui.activar_luz);
+        if (ImGui::Checkbox("bordes", &sgui.activar_bordes))
+            shader::definir("deferred", "BORDES", sgui.activar_bordes);
+        if (ImGui::Checkbox("toon shading", &sgui.activar_toon))
+            shader::definir("deferred", "TOON", sgui.activar_toon);
+
+        // Modelos como atributos por instancia o leídos de un TexBuffer
+        if (ImGui::Checkbox("atributos por instancia", &sgui.atributos_instancia))
+            atributosInstancia(sgui.atributos_instancia);
+
+        // Dibujar el planeta de la cámara planeta por clusters, descartando los que no se ven
+        ImGui::Checkbox("clusters en modo planeta", &sgui.clusters);
 
         
         ImGui::End();
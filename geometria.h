@@ -4,7 +4,9 @@
 #include <vector>
 #include <array>
 #include <cmath>
-#include <stdint.h>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
 
 namespace tofu
 {
@@ -24,7 +26,33 @@ namespace tofu
                     std::cos(phi)};
         }
 
+        // Raíz cuadrada que también se puede evaluar al compilar (std::sqrt no es constexpr)
+        // En tiempo de ejecución usa std::sqrt, al compilar aproxima con el método de Newton
+        // Si el compilador no permite saber si se está evaluando al compilar, se usa siempre Newton
+        constexpr float raiz(float x) {
+            #if defined(__cpp_lib_is_constant_evaluated)
+            if (not std::is_constant_evaluated())
+                return std::sqrt(x);
+            #elif defined(__has_builtin)
+                #if __has_builtin(__builtin_is_constant_evaluated)
+                if (not __builtin_is_constant_evaluated())
+                    return std::sqrt(x);
+                #endif
+            #endif
+            if (x <= 0.f)
+                return 0.f;
+            double r = x > 1.f ? x : 1.0;
+            for (int i = 0; i < 64; i++) {
+                double s = 0.5 * (r + x / r);
+                if (s == r)
+                    break;
+                r = s;
+            }
+            return (float)r;
+        }
+
         // Slerp
+        // Ya no se usa para generar las esferas, se mantiene como referencia para comparar en herramientas/bench
         inline std::array<float, 3> slerp(std::array<float, 3> v1, std::array<float, 3> v2, float t) {
             float dot = v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2];
             float theta = std::acos(dot);
@@ -39,19 +67,19 @@ namespace tofu
         }
 
         // Puntos de un plano
-        const std::vector<float> plane_vert = {
+        constexpr std::array<float, 12> plane_vert = {
              1.f, 1.f, 0.f,
             -1.f, 1.f, 0.f,
             -1.f,-1.f, 0.f,
              1.f,-1.f, 0.f
         };
-        const std::vector<ui32> plane_ind = {
+        constexpr std::array<ui32, 6> plane_ind = {
             0, 2, 1,
             0, 3, 2
         };
 
         // Puntos de un cubo
-        const std::vector<float> cube_vert = {
+        constexpr std::array<float, 24> cube_vert = {
              1.f, 1.f, 1.f,
              1.f, 1.f,-1.f,
             -1.f, 1.f,-1.f,
@@ -61,7 +89,7 @@ namespace tofu
             -1.f,-1.f,-1.f,
             -1.f,-1.f, 1.f
         };
-        const std::vector<ui32> cube_ind = {
+        constexpr std::array<ui32, 36> cube_ind = {
             0, 2, 1, 0, 3, 2, // Arriba
             4, 5, 6, 4, 6, 7, // Abajo
             0, 1, 5, 0, 5, 4, // Frente
@@ -71,7 +99,7 @@ namespace tofu
         };
 
         // Puntos de un octaedro
-        const std::vector<float> oct_vert = {
+        constexpr std::array<float, 18> oct_vert = {
              0.f, 1.f, 0.f, // Arriba
              1.f, 0.f, 0.f,
              0.f, 0.f, 1.f,
@@ -79,171 +107,491 @@ namespace tofu
              0.f, 0.f,-1.f,
              0.f,-1.f, 0.f  // Abajo
         };
-    }
 
-    namespace geometria
-    {
-        // Plano
-        inline auto plano() {
-            return std::make_pair(detail::plane_vert, detail::plane_ind);
+        // Punto de la cara de un octaedro entre dos aristas, proyectado a la esfera
+        // a y b son los extremos de las aristas en este nivel (sin normalizar), t la posición entre ellos
+        // Interpolar en la cara plana y normalizar solo cuesta una raíz por vértice, frente a los acos y sin del slerp
+        // Los puntos quedan algo más juntos cerca de los vértices del octaedro, pero la diferencia no se aprecia
+        constexpr void proyectar(const float* a, const float* b, float t, float* out) {
+            float x = a[0] + (b[0] - a[0]) * t;
+            float y = a[1] + (b[1] - a[1]) * t;
+            float z = a[2] + (b[2] - a[2]) * t;
+            float inv = 1.f / raiz(x * x + y * y + z * z);
+            out[0] = x * inv;
+            out[1] = y * inv;
+            out[2] = z * inv;
         }
 
-        // Cubo
-        inline auto cubo() {
-            return std::make_pair(detail::cube_vert, detail::cube_ind);
-        }
+        // Triangulación de una de las mitades de la esfera
+        // Recorre horizontalmente los niveles desde un polo hasta el ecuador, arriba se avanza en los índices y abajo se retrocede
+        constexpr ui32* triangularEsferaOct(ui32 n, ui32* out, ui32 vert_acc, ui32 vert_anterior, bool arriba) {
+            ui32 ind[3] = {0, 0, 0};
+            for (ui32 i = 1; i < n+1; i++) {
+                ui32 tri = (2 * (i-1) + 1) * 4;
+                ui32 vert = i * 4;
+                ui32 primer_vertice = arriba ? vert_acc + i-1 : vert_acc;
 
-        // Circulo
-        // Lineas en vez de triágulos, no índices
-        inline auto circulo(ui32 n) {
-            std::vector<float> vertices;
+                // Iniciamos los primeros índices
+                ind[0] = primer_vertice;
+                ind[1] = vert_anterior;
+                ind[2] = arriba ? ind[0] + 1 : ind[0] - 1;
 
-            for (ui32 i = 0; i <= n; i++) {
-                float theta = 2.f * M_PI * i / n;
-                vertices.push_back(std::cos(theta));
-                vertices.push_back(0.f);
-                vertices.push_back(std::sin(theta));
-            }
+                // Recorremos cada triángulo que hay que crear
+                for (ui32 j = 0; j < tri; j++) {
+                    // Corregimos e insertamos los índices
+                    bool girar = arriba ? ind[0] > ind[1] : ind[0] < ind[1];
+                    *out++ = girar ? ind[1] : ind[0];
+                    *out++ = girar ? ind[0] : ind[1];
+                    *out++ = ind[2];
 
-            return vertices;
+                    // Actualizamos los índices
+                    if ((j+1) % (tri/4) == 0) { // Caso borde
+                        ind[0] = ind[2];
+                    } else {
+                        ind[0] = ind[1];
+                        ind[1] = ind[2];
+                    }
+                    ind[2] = arriba ? ind[0] + 1 : ind[0] - 1;
+
+                    // Repetición circular
+                    if (arriba) {
+                        if (ind[2] == vert_acc) ind[2] = vert_anterior - (i-2);
+                        if (ind[2] == vert_acc + i*4) ind[2] = vert_acc;
+                    } else {
+                        if (ind[2] == vert_acc) ind[2] = vert_anterior;
+                        if (ind[2] == vert_acc - i*4) ind[2] = vert_acc;
+                    }
+                }
+
+                vert_acc = arriba ? vert_acc + vert : vert_acc - vert;
+                vert_anterior = primer_vertice;
+            }
+            return out;
         }
 
-        // Esfera a partir de octaedro
+        // Esfera a partir de octaedro, con la proyección de la cara plana a la esfera indicada
         // Creamos las subdivisiones dividiendo cada arista n veces, no como se hace tradicionalmente, para tener más control sobre la división
-        inline auto esferaOct(ui32 n) {
-            using V = std::array<float, 3>;
-            using I = std::array<ui32, 3>;
-            auto& ov = detail::oct_vert;
-            std::vector<float> vertices;
-            std::vector<ui32> indices;
+        template <typename P>
+        constexpr void esferaOct(ui32 n, float* vertices, ui32* indices, P proyectar) {
+            const float* ov = oct_vert.data();
+            const float* arriba = ov;
+            const float* abajo = ov + 15;
+            float* v = vertices;
 
             // Primer punto
-            V v0 = {ov[0], ov[1], ov[2]};
-            vertices.insert(vertices.end(), v0.begin(), v0.end());
-            //log::info("v0[{}] {} {} {}", vertices.size() / 3 - 1, v0[0], v0[1], v0[2]);
+            for (ui32 c = 0; c < 3; c++)
+                *v++ = arriba[c];
 
             // Iteramos por cada subdivisión del eje
             for (ui32 i = 1; i < 2*n; i++) {
+                // En la mitad de arriba las aristas van del polo al ecuador, en la de abajo del ecuador al otro polo
+                float t = (i <= n) ? (float)i / n : (float)(i - n) / n;
+                ui32 ii = (i < n) ? i : 2*n - i;
+
                 // Ahora iteramos por cada punto intermedio (1-4)
                 for (ui32 j = 1; j <= 4; j++) {
-                    // Eje 0 - j
-                    V v1 = {ov[j * 3], ov[j * 3 + 1], ov[j * 3 + 2]};
-                    // Eje 0 - (j-1)
+                    // Eje 0 - j y eje 0 - (j-1)
                     ui32 k = (j == 1) ? 4 : j - 1;
-                    V v2 = {ov[k * 3], ov[k * 3 + 1], ov[k * 3 + 2]};
-                    // Punto intermedio de este eje
-                    auto va = detail::slerp(v0, v1, (float)i / n);
-
-                    // Punto intermedio del eje anterior
-                    auto vb = detail::slerp(v0, v2, (float)i / n);
+                    const float* e1 = ov + j * 3;
+                    const float* e2 = ov + k * 3;
+
+                    // Punto de este eje y del anterior en el octaedro plano
+                    float va[3] = {}, vb[3] = {};
+                    for (ui32 c = 0; c < 3; c++) {
+                        va[c] = (i <= n) ? arriba[c] + (e1[c] - arriba[c]) * t : e1[c] + (abajo[c] - e1[c]) * t;
+                        vb[c] = (i <= n) ? arriba[c] + (e2[c] - arriba[c]) * t : e2[c] + (abajo[c] - e2[c]) * t;
+                    }
 
                     // Añadimos las subdivisiones entre los dos ejes
-                    int ii = (i < n) ? i : 2*n - i;
                     for (ui32 l = 1; l < ii; l++) {
-                        auto vc = detail::slerp(va, vb, (float)(ii-l) / ii);
-                        vertices.insert(vertices.end(), vc.begin(), vc.end());
-                        // log::info("vs[{}] {} {} {}", vertices.size() / 3 - 1, vc[0], vc[1], vc[2]);
+                        proyectar(va, vb, (float)(ii-l) / ii, v);
+                        v += 3;
                     }
 
                     // Y finalmente la subdivisión de este eje
-                    vertices.insert(vertices.end(), va.begin(), va.end());
-                    // log::info("v{}[{}] {} {} {}", j, vertices.size() / 3 - 1, va[0], va[1], va[2]);
+                    proyectar(va, va, 0.f, v);
+                    v += 3;
                 }
             }
 
             // Ultimo punto
-            V vn = {ov[15], ov[16], ov[17]};
-            vertices.insert(vertices.end(), vn.begin(), vn.end());
-            // log::info("vn[{}] {} {} {}", vertices.size() / 3 - 1, vn[0], vn[1], vn[2]);
-
-            // Triangulación
-            // Recorremos horizontalmente los niveles
-            ui32 vert_acc = 1;
-            ui32 vert_anterior = 0;
-            I ind = {0, 0, 0}, ind_ccw = {0, 0, 0};
-            for (ui32 i = 1; i < n+1; i++) {
-                ui32 tri = (2 * (i-1) + 1) * 4;
-                ui32 vert = i * 4;
-                ui32 primer_vertice = vert_acc + i-1;
+            for (ui32 c = 0; c < 3; c++)
+                *v++ = abajo[c];
 
-                // Iniciamos los primeros índices
-                ind[0] = primer_vertice;
-                ind[1] = vert_anterior;
-                ind[2] = ind[0] + 1;
+            // Triangulación, primero la mitad de arriba y luego la de abajo
+            ui32* ind = triangularEsferaOct(n, indices, 1, 0, true);
+            ui32 vert_acc = 0;
+            for (ui32 i = 1; i < 2*n; i++)
+                vert_acc += ((i < n) ? i : 2*n - i) * 4;
+            triangularEsferaOct(n, ind, vert_acc, vert_acc + 1, false);
+        }
 
-                // Recorremos cada triángulo que hay que crear
-                for (ui32 j = 0; j < tri; j++) {
-                    //log::info("{} - {} {} {}", j, ind[0], ind[1], ind[2]);
+        // Proyección del octaedro a la esfera que conserva el área (Clarberg, "Fast equal-area mapping of the (hemi)sphere using SIMD")
+        // Los triángulos iguales de la cara plana quedan con la misma área en la esfera, en vez de encogerse cerca de los vértices
+        // El polo está en el eje y, r es la distancia al polo en el octaedro (|x| + |z| = 1 - |y|)
+        inline void proyectarArea(const float* a, const float* b, float t, float* out) {
+            float x = a[0] + (b[0] - a[0]) * t;
+            float y = a[1] + (b[1] - a[1]) * t;
+            float z = a[2] + (b[2] - a[2]) * t;
+            float r = std::abs(x) + std::abs(z);
+            float phi = r > 0.f ? ((std::abs(z) - std::abs(x)) / r + 1.f) * (float)M_PI * 0.25f : 0.f;
+            float s = r * std::sqrt(std::max(2.f - r * r, 0.f));
+            out[0] = std::copysign(std::cos(phi) * s, x);
+            out[1] = std::copysign(1.f - r * r, y);
+            out[2] = std::copysign(std::sin(phi) * s, z);
+        }
 
-                    // Corregimos e insertamos los índices
-                    ind_ccw = ind;
-                    if (ind[0] > ind[1])
-                        std::swap(ind_ccw[0], ind_ccw[1]);
-                    indices.insert(indices.end(), ind_ccw.begin(), ind_ccw.end());
+        // Icosaedro (sin normalizar, se proyectan todos los puntos al subdividir)
+        constexpr float aureo = 1.6180339887498949f;  // Número áureo
+        constexpr std::array<float, 36> ico_vert = {
+            -1.f, aureo, 0.f,    1.f, aureo, 0.f,   -1.f,-aureo, 0.f,    1.f,-aureo, 0.f,
+             0.f,-1.f, aureo,    0.f, 1.f, aureo,    0.f,-1.f,-aureo,    0.f, 1.f,-aureo,
+             aureo, 0.f,-1.f,    aureo, 0.f, 1.f,   -aureo, 0.f,-1.f,   -aureo, 0.f, 1.f
+        };
+        constexpr std::array<ui32, 60> ico_caras = {
+            0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+            1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+            3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+            4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+        };
 
-                    // Actualizamos los índices
-                    if ((j+1) % (tri/4) == 0) { // Caso borde
-                        ind[0] = ind[2];
-                    } else {
-                        ind[0] = ind[1];
-                        ind[1] = ind[2];
-                    }
-                    ind[2] = ind[0] + 1;
+        // Caras del cubo como cuadriláteros, en el mismo orden que cube_ind
+        constexpr std::array<ui32, 24> cubo_caras = {
+            0, 3, 2, 1,     // Arriba
+            4, 5, 6, 7,     // Abajo
+            0, 1, 5, 4,     // Frente
+            3, 7, 6, 2,     // Atrás
+            0, 4, 7, 3,     // Izquierda
+            1, 2, 6, 5      // Derecha
+        };
 
-                    // Repetición circular
-                    if (ind[2] == vert_acc) ind[2] = vert_anterior - (i-2);
-                    if (ind[2] == vert_acc + i*4) ind[2] = vert_acc;
-                }
+        // Vértices compartidos de un poliedro con cada arista dividida n veces
+        // Primero van las esquinas, después los puntos de dentro de cada arista y al final los del interior de las caras,
+        // así cada punto tiene un solo índice aunque lo usen varias caras
+        // Las posiciones se calculan siempre desde los extremos ordenados de la arista, para que salgan idénticas
+        template <size_t E>
+        struct Poliedro {
+            ui32 n;
+            const float* esquinas;
+            ui32 num_esquinas;
+            float* vertices;
+            std::array<ui32, E * 2> aristas = {};
+            ui32 num_aristas = 0;
+
+            constexpr void escribir(ui32 i, float x, float y, float z) {
+                float inv = 1.f / raiz(x * x + y * y + z * z);
+                vertices[i * 3] = x * inv;
+                vertices[i * 3 + 1] = y * inv;
+                vertices[i * 3 + 2] = z * inv;
+            }
 
-                vert_acc += vert;
-                vert_anterior = primer_vertice;
+            constexpr ui32 esquina(ui32 a) {
+                escribir(a, esquinas[a * 3], esquinas[a * 3 + 1], esquinas[a * 3 + 2]);
+                return a;
             }
 
-            // Recorremos los niveles inferiores
-            vert_acc = 0;
-            for (ui32 i = 1; i < 2*n; i++)
-                vert_acc += ((i < n) ? i : 2*n - i) * 4;
-            vert_anterior = vert_acc + 1;
+            // Punto k (de 0 a n) de la arista que va de a a b
+            constexpr ui32 arista(ui32 a, ui32 b, ui32 k) {
+                if (k == 0) return esquina(a);
+                if (k == n) return esquina(b);
+                if (a > b) {
+                    ui32 c = a; a = b; b = c;
+                    k = n - k;
+                }
+                ui32 e = 0;
+                while (e < num_aristas and (aristas[e * 2] != a or aristas[e * 2 + 1] != b))
+                    e++;
+                if (e == num_aristas) {
+                    aristas[e * 2] = a;
+                    aristas[e * 2 + 1] = b;
+                    num_aristas++;
+                }
+                float t = (float)k / n;
+                const float* pa = esquinas + a * 3;
+                const float* pb = esquinas + b * 3;
+                ui32 i = num_esquinas + e * (n - 1) + k - 1;
+                escribir(i, pa[0] + (pb[0] - pa[0]) * t, pa[1] + (pb[1] - pa[1]) * t, pa[2] + (pb[2] - pa[2]) * t);
+                return i;
+            }
 
-            for (ui32 i = 1; i < n+1; i++) {
-                ui32 tri = (2 * (i-1) + 1) * 4;
-                ui32 vert = i * 4;
-                ui32 primer_vertice = vert_acc;
+            // Primer índice del interior de las caras
+            constexpr ui32 interior() const { return num_esquinas + E * (n - 1); }
+        };
+    }
 
-                // Iniciamos los primeros índices
-                ind[0] = primer_vertice;
-                ind[1] = vert_anterior;
-                ind[2] = ind[0] - 1;
+    namespace geometria
+    {
+        // Tamaño de una esfera a partir de octaedro con n subdivisiones por arista
+        // Los vértices son puntos (3 floats cada uno), para reservar la memoria exacta antes de generarla
+        constexpr ui32 verticesEsferaOct(ui32 n) { return 4 * n * n + 2; }
+        constexpr ui32 indicesEsferaOct(ui32 n) { return 24 * n * n; }
 
-                // Recorremos cada triángulo que hay que crear
-                for (ui32 j = 0; j < tri; j++) {
-                    //log::info("{} - {} {} {}", j, ind[0], ind[1], ind[2]);
+        // Esfera a partir de octaedro
+        // Escribe directamente en la memoria indicada, que tiene que tener sitio para verticesEsferaOct(n) * 3 floats
+        // e indicesEsferaOct(n) índices (por ejemplo, un buffer de la GPU mapeado, ver buffer::generarVert)
+        constexpr void esferaOct(ui32 n, float* vertices, ui32* indices) {
+            detail::esferaOct(n, vertices, indices, detail::proyectar);
+        }
 
-                    // Corregimos e insertamos los índices
-                    ind_ccw = ind;
-                    if (ind[0] < ind[1])
-                        std::swap(ind_ccw[0], ind_ccw[1]);
-                    indices.insert(indices.end(), ind_ccw.begin(), ind_ccw.end());
+        inline auto esferaOct(ui32 n) {
+            std::vector<float> vertices(verticesEsferaOct(n) * 3);
+            std::vector<ui32> indices(indicesEsferaOct(n));
+            esferaOct(n, vertices.data(), indices.data());
+            return std::make_pair(std::move(vertices), std::move(indices));
+        }
 
-                    // Actualizamos los índices
-                    if ((j+1) % (tri/4) == 0) { // Caso borde
-                        ind[0] = ind[2];
-                    } else {
-                        ind[0] = ind[1];
-                        ind[1] = ind[2];
+        // Esfera con un número de subdivisiones fijo, generada al compilar
+        // Para las esferas pequeñas, que así no cuestan nada al iniciar
+        template <ui32 N>
+        constexpr auto esferaOctFija() {
+            std::array<float, verticesEsferaOct(N) * 3> vertices = {};
+            std::array<ui32, indicesEsferaOct(N)> indices = {};
+            esferaOct(N, vertices.data(), indices.data());
+            return std::make_pair(vertices, indices);
+        }
+
+        // ---
+        // Otras teselaciones de la esfera
+        // esferaOct tiene los triángulos de distinto tamaño (más pequeños cerca de los vértices del octaedro),
+        // así que para un mismo error en la silueta necesita más vértices que una división más uniforme
+        // Con errorSilueta se puede elegir la que llega a un error con menos vértices (ver mejorEsfera)
+
+        // Icosaedro con cada arista dividida en n partes (frecuencia n, no solo potencias de 2)
+        constexpr ui32 verticesIcosfera(ui32 n) { return 10 * n * n + 2; }
+        constexpr ui32 indicesIcosfera(ui32 n) { return 60 * n * n; }
+
+        constexpr void icosfera(ui32 n, float* vertices, ui32* indices) {
+            detail::Poliedro<30> p { n, detail::ico_vert.data(), 12, vertices };
+            ui32 interior = p.interior();
+            ui32 por_cara = n > 1 ? (n - 1) * (n - 2) / 2 : 0;
+
+            for (ui32 f = 0; f < 20; f++) {
+                ui32 a = detail::ico_caras[f * 3], b = detail::ico_caras[f * 3 + 1], c = detail::ico_caras[f * 3 + 2];
+                const float* pa = detail::ico_vert.data() + a * 3;
+                const float* pb = detail::ico_vert.data() + b * 3;
+                const float* pc = detail::ico_vert.data() + c * 3;
+
+                // Punto (i, j) de la cara: i avanza de a hacia la arista bc, j de b hacia c
+                auto punto = [&](ui32 i, ui32 j) -> ui32 {
+                    if (j == 0) return p.arista(a, b, i);
+                    if (j == i) return p.arista(a, c, i);
+                    if (i == n) return p.arista(b, c, j);
+                    ui32 k = interior + f * por_cara + (i - 1) * (i - 2) / 2 + j - 1;
+                    float wa = (float)(n - i) / n, wb = (float)(i - j) / n, wc = (float)j / n;
+                    p.escribir(k, pa[0] * wa + pb[0] * wb + pc[0] * wc, pa[1] * wa + pb[1] * wb + pc[1] * wc, pa[2] * wa + pb[2] * wb + pc[2] * wc);
+                    return k;
+                };
+
+                // Mismo sentido de giro que esferaOct y el cubo
+                for (ui32 i = 0; i < n; i++) {
+                    for (ui32 j = 0; j <= i; j++) {
+                        *indices++ = punto(i, j);
+                        *indices++ = punto(i + 1, j + 1);
+                        *indices++ = punto(i + 1, j);
+                        if (j < i) {
+                            *indices++ = punto(i, j);
+                            *indices++ = punto(i, j + 1);
+                            *indices++ = punto(i + 1, j + 1);
+                        }
                     }
-                    ind[2] = ind[0] - 1;
+                }
+            }
+        }
 
-                    // Repetición circular
-                    if (ind[2] == vert_acc) ind[2] = vert_anterior;
-                    if (ind[2] == vert_acc - i*4) ind[2] = vert_acc;
+        // Cubo normalizado, con cada cara dividida en n x n cuadrados
+        constexpr ui32 verticesEsferaCubo(ui32 n) { return 6 * n * n + 2; }
+        constexpr ui32 indicesEsferaCubo(ui32 n) { return 36 * n * n; }
+
+        constexpr void esferaCubo(ui32 n, float* vertices, ui32* indices) {
+            detail::Poliedro<12> p { n, detail::cube_vert.data(), 8, vertices };
+            ui32 interior = p.interior();
+
+            for (ui32 f = 0; f < 6; f++) {
+                const ui32* q = detail::cubo_caras.data() + f * 4;
+                const float* pa = detail::cube_vert.data() + q[0] * 3;
+                const float* pb = detail::cube_vert.data() + q[1] * 3;
+                const float* pd = detail::cube_vert.data() + q[3] * 3;
+
+                // Punto (u, v) de la cara: u avanza de la esquina 0 a la 1, v de la 0 a la 3
+                auto punto = [&](ui32 u, ui32 v) -> ui32 {
+                    if (v == 0) return p.arista(q[0], q[1], u);
+                    if (u == n) return p.arista(q[1], q[2], v);
+                    if (v == n) return p.arista(q[3], q[2], u);
+                    if (u == 0) return p.arista(q[0], q[3], v);
+                    ui32 k = interior + f * (n - 1) * (n - 1) + (v - 1) * (n - 1) + u - 1;
+                    float tu = (float)u / n, tv = (float)v / n;
+                    p.escribir(k, pa[0] + (pb[0] - pa[0]) * tu + (pd[0] - pa[0]) * tv,
+                                  pa[1] + (pb[1] - pa[1]) * tu + (pd[1] - pa[1]) * tv,
+                                  pa[2] + (pb[2] - pa[2]) * tu + (pd[2] - pa[2]) * tv);
+                    return k;
+                };
+
+                for (ui32 v = 0; v < n; v++) {
+                    for (ui32 u = 0; u < n; u++) {
+                        ui32 i00 = punto(u, v), i10 = punto(u + 1, v), i11 = punto(u + 1, v + 1), i01 = punto(u, v + 1);
+                        *indices++ = i00; *indices++ = i10; *indices++ = i11;
+                        *indices++ = i00; *indices++ = i11; *indices++ = i01;
+                    }
                 }
-               
-                vert_acc -= vert;
-                vert_anterior = primer_vertice;
             }
+        }
+
+        // Octaedro con la proyección que conserva el área
+        // Mismos vértices e índices que esferaOct, pero todos los triángulos tienen la misma área en la esfera
+        // Usa seno y coseno, así que no se puede generar al compilar
+        inline void esferaOctArea(ui32 n, float* vertices, ui32* indices) {
+            detail::esferaOct(n, vertices, indices, detail::proyectarArea);
+        }
+
+        enum Teselado {
+            OCTAEDRO,           // esferaOct
+            OCTAEDRO_AREA,      // esferaOctArea
+            ICOSAEDRO,          // icosfera
+            CUBO                // esferaCubo
+        };
+        constexpr Teselado teselados[] = { OCTAEDRO, OCTAEDRO_AREA, ICOSAEDRO, CUBO };
+
+        constexpr ui32 verticesEsfera(Teselado t, ui32 n) {
+            switch (t) {
+                case ICOSAEDRO: return verticesIcosfera(n);
+                case CUBO: return verticesEsferaCubo(n);
+                default: return verticesEsferaOct(n);
+            }
+        }
+
+        constexpr ui32 indicesEsfera(Teselado t, ui32 n) {
+            switch (t) {
+                case ICOSAEDRO: return indicesIcosfera(n);
+                case CUBO: return indicesEsferaCubo(n);
+                default: return indicesEsferaOct(n);
+            }
+        }
+
+        inline void esfera(Teselado t, ui32 n, float* vertices, ui32* indices) {
+            switch (t) {
+                case OCTAEDRO: esferaOct(n, vertices, indices); break;
+                case OCTAEDRO_AREA: esferaOctArea(n, vertices, indices); break;
+                case ICOSAEDRO: icosfera(n, vertices, indices); break;
+                case CUBO: esferaCubo(n, vertices, indices); break;
+            }
+        }
 
+        inline auto esfera(Teselado t, ui32 n) {
+            std::vector<float> vertices(verticesEsfera(t, n) * 3);
+            std::vector<ui32> indices(indicesEsfera(t, n));
+            esfera(t, n, vertices.data(), indices.data());
+            return std::make_pair(std::move(vertices), std::move(indices));
+        }
+
+        template <ui32 N>
+        constexpr auto icosferaFija() {
+            std::array<float, verticesIcosfera(N) * 3> vertices = {};
+            std::array<ui32, indicesIcosfera(N)> indices = {};
+            icosfera(N, vertices.data(), indices.data());
+            return std::make_pair(vertices, indices);
+        }
+
+        template <ui32 N>
+        constexpr auto esferaCuboFija() {
+            std::array<float, verticesEsferaCubo(N) * 3> vertices = {};
+            std::array<ui32, indicesEsferaCubo(N)> indices = {};
+            esferaCubo(N, vertices.data(), indices.data());
             return std::make_pair(vertices, indices);
         }
+
+        // ---
+        // Nivel de detalle
+
+        // Error de la silueta de una esfera de radio 1 teselada
+        // Es la mayor distancia entre la esfera y el plano de un triángulo, que es lo que se separa el borde de la figura
+        // del círculo real. Se mide sobre el plano del triángulo, así que nunca es menor que el error real
+        inline float errorSilueta(const float* vertices, const ui32* indices, ui32 num_ind) {
+            double error = 0.0;
+            for (ui32 i = 0; i + 2 < num_ind; i += 3) {
+                const float* a = vertices + indices[i] * 3;
+                const float* b = vertices + indices[i + 1] * 3;
+                const float* c = vertices + indices[i + 2] * 3;
+                double u[3] = { (double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2] };
+                double v[3] = { (double)c[0] - a[0], (double)c[1] - a[1], (double)c[2] - a[2] };
+                double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+                double l = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (l > 0.0)
+                    error = std::max(error, 1.0 - std::abs(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]) / l);
+            }
+            return (float)error;
+        }
+
+        inline float errorSilueta(Teselado t, ui32 n) {
+            auto [v, i] = esfera(t, n);
+            return errorSilueta(v.data(), i.data(), i.size());
+        }
+
+        // Error en píxeles que corresponde a un error relativo al radio, para una esfera a una distancia de la cámara
+        inline float errorPantalla(float error, float radio, float distancia, float fov_y, float alto_px) {
+            return error * radio / (distancia * 2.f * std::tan(fov_y * 0.5f)) * alto_px;
+        }
+
+        // Menor número de subdivisiones con un error de silueta (relativo al radio) que no supera el indicado
+        // El error baja con n (aproximadamente con 1 / n²), así que se busca de forma binaria
+        inline ui32 subdivisionesEsfera(Teselado t, float error, ui32 n_max = 256) {
+            ui32 lo = 1, hi = n_max;
+            while (lo < hi) {
+                ui32 mid = (lo + hi) / 2;
+                if (errorSilueta(t, mid) <= error)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            return lo;
+        }
+
+        struct NivelEsfera {
+            Teselado teselado;
+            ui32 n;
+            ui32 vertices;
+            float error;
+        };
+
+        // Teselado y subdivisiones que llegan a un error con el menor número de vértices
+        // Se puede usar para las tablas de nivel de detalle, combinándolo con errorPantalla
+        inline NivelEsfera mejorEsfera(float error, ui32 n_max = 256) {
+            NivelEsfera mejor = { OCTAEDRO, 0, ~0u, 0.f };
+            for (Teselado t : teselados) {
+                ui32 n = subdivisionesEsfera(t, error, n_max);
+                if (verticesEsfera(t, n) < mejor.vertices)
+                    mejor = { t, n, verticesEsfera(t, n), errorSilueta(t, n) };
+            }
+            return mejor;
+        }
+
+        // Plano
+        constexpr auto plano() {
+            return std::make_pair(detail::plane_vert, detail::plane_ind);
+        }
+
+        // Cubo
+        constexpr auto cubo() {
+            return std::make_pair(detail::cube_vert, detail::cube_ind);
+        }
+
+        // Octaedro (la esfera sin subdividir)
+        constexpr auto octaedro() {
+            return esferaOctFija<1>();
+        }
+
+        // Circulo
+        // Lineas en vez de triágulos, no índices
+        inline auto circulo(ui32 n) {
+            std::vector<float> vertices((n + 1) * 3);
+
+            for (ui32 i = 0; i <= n; i++) {
+                float theta = 2.f * M_PI * i / n;
+                vertices[i * 3] = std::cos(theta);
+                vertices[i * 3 + 1] = 0.f;
+                vertices[i * 3 + 2] = std::sin(theta);
+            }
+
+            return vertices;
+        }
     }
 }
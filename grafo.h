@@ -0,0 +1,328 @@
+// Grafo de renderizado
+// Cada paso declara los recursos (render targets) que lee y escribe, y el grafo se encarga de:
+// - Ordenar los pasos para que todos los que escriben un recurso vayan antes de los que lo leen
+// - Saltar los pasos desactivados, los que leen recursos que nadie produce y los que escriben algo que nadie usa
+//   Los pasos que no escriben ningún recurso (por ejemplo, la pirámide de profundidad de hiz.h) guardan sus resultados
+//   fuera del grafo, así que se ejecutan siempre que puedan leer lo que necesitan
+// - Asignar texturas a los recursos temporales, compartiendo la misma textura entre recursos cuyas vidas no se solapan
+// Se vuelve a compilar solo cuando cambian los pasos activos, el tamaño de la ventana o la escala de resolución
+#pragma once
+
+#include <algorithm>
+#include <set>
+
+#include "buffers.h"
+
+namespace tofu
+{
+    namespace grafo
+    {
+        // Recurso especial que representa el framebuffer por defecto
+        // Los pasos que escriben en él (o en algo que acaba en él) son los que se ejecutan
+        inline const str pantalla = "pantalla";
+
+        // Declarar un recurso temporal con un formato y un tamaño relativo a la ventana
+        // Los recursos dinámicos siguen además la escala de resolución dinámica (ver resolucion.h)
+        inline void recurso(str nombre, ui32 formato, float escala = 1.f, bool dinamico = false, glm::vec4 clear = glm::vec4(0.f)) {
+            gl.grafo.recursos[nombre] = { .formato = formato, .escala = escala, .dinamico = dinamico, .clear = clear };
+            gl.grafo.compilado = false;
+        }
+
+        // Añadir un paso al grafo
+        // Si tiene función de activación, se salta cuando devuelve false
+        inline void paso(str nombre, std::vector<str> lee, std::vector<str> escribe, update_fun_t ejecutar, std::function<bool()> activo = nullptr) {
+            for (auto& r : escribe)
+                if (r == pantalla and escribe.size() > 1) {
+                    log::error("El paso '{}' no puede escribir a la vez en la pantalla y en otros recursos", nombre);
+                    std::exit(-1);
+                }
+            gl.grafo.pasos.push_back({ nombre, lee, escribe, ejecutar, activo });
+            gl.grafo.compilado = false;
+        }
+
+        namespace detail
+        {
+            inline bool existe(const str& r) {
+                if (r == pantalla or gl.grafo.recursos.count(r))
+                    return true;
+                log::error("El recurso '{}' no está declarado en el grafo", r);
+                std::exit(-1);
+            }
+
+            // Orden topológico de los pasos activos
+            // Los que escriben un recurso van antes que los que lo leen, y varias escrituras respetan el orden de declaración
+            // Si hay varias opciones, se elige primero el paso declarado antes
+            inline std::vector<ui32> ordenar(const std::vector<bool>& activo) {
+                Grafo& g = gl.grafo;
+                ui32 n = g.pasos.size();
+                std::vector<std::set<ui32>> siguientes(n);
+                std::vector<ui32> entradas(n, 0);
+                auto arista = [&](ui32 a, ui32 b) {
+                    if (a != b and siguientes[a].insert(b).second)
+                        entradas[b]++;
+                };
+
+                std::unordered_map<str, std::vector<ui32>> escritores;
+                for (ui32 i = 0; i < n; i++)
+                    if (activo[i])
+                        for (auto& w : g.pasos[i].escribe) {
+                            auto& e = escritores[w];
+                            if (not e.empty())
+                                arista(e.back(), i);
+                            e.push_back(i);
+                        }
+                for (ui32 i = 0; i < n; i++)
+                    if (activo[i])
+                        for (auto& r : g.pasos[i].lee)
+                            for (ui32 w : escritores[r])
+                                arista(w, i);
+
+                std::set<ui32> listos;
+                for (ui32 i = 0; i < n; i++)
+                    if (activo[i] and entradas[i] == 0)
+                        listos.insert(i);
+
+                std::vector<ui32> orden;
+                while (not listos.empty()) {
+                    ui32 i = *listos.begin();
+                    listos.erase(listos.begin());
+                    orden.push_back(i);
+                    for (ui32 s : siguientes[i])
+                        if (--entradas[s] == 0)
+                            listos.insert(s);
+                }
+
+                if (orden.size() != (ui32)std::count(activo.begin(), activo.end(), true)) {
+                    log::error("El grafo de renderizado tiene un ciclo");
+                    std::exit(-1);
+                }
+                return orden;
+            }
+
+            // Eliminar las texturas físicas y los framebuffers de la compilación anterior
+            inline void liberar(std::vector<ui32>& texturas) {
+                for (ui32 t : texturas) {
+                    textura::liberarUnidad(t);
+                    textura::detail::olvidar(gl.texturas[t].textura);
+                    glDeleteTextures(1, &gl.texturas[t].textura);
+                    gl.texturas.erase(t);
+                }
+                texturas.clear();
+            }
+        }
+
+        // Compilar el grafo con los pasos activos indicados
+        inline void compilar(const std::vector<bool>& activos) {
+            Grafo& g = gl.grafo;
+            ui32 n = g.pasos.size();
+            std::vector<bool> activo = activos;
+
+            // Los pasos que leen recursos que no produce ningún paso activo tampoco se pueden ejecutar
+            for (bool cambio = true; cambio;) {
+                cambio = false;
+                std::unordered_set<str> producidos;
+                for (ui32 i = 0; i < n; i++)
+                    if (activo[i])
+                        for (auto& w : g.pasos[i].escribe)
+                            producidos.insert(w);
+                for (ui32 i = 0; i < n; i++)
+                    if (activo[i])
+                        for (auto& r : g.pasos[i].lee)
+                            if (detail::existe(r) and not producidos.count(r)) {
+                                activo[i] = false;
+                                cambio = true;
+                                break;
+                            }
+            }
+
+            // Recorremos el orden al revés para quedarnos solo con los pasos que acaban llegando a la pantalla
+            std::vector<ui32> orden = detail::ordenar(activo);
+            std::unordered_set<str> usados = { pantalla };
+            std::vector<ui32> necesarios;
+            for (auto it = orden.rbegin(); it != orden.rend(); it++) {
+                PasoGrafo& p = g.pasos[*it];
+                bool necesario = p.escribe.empty() or std::any_of(p.escribe.begin(), p.escribe.end(), [&](const str& w) { return detail::existe(w) and usados.count(w); });
+                if (not necesario)
+                    continue;
+                necesarios.push_back(*it);
+                for (auto& r : p.lee)
+                    usados.insert(r);
+            }
+            g.orden.assign(necesarios.rbegin(), necesarios.rend());
+
+            // Vida de cada recurso temporal
+            for (auto& [nombre, r] : g.recursos)
+                r.primero = r.ultimo = -1;
+            for (int i = 0; i < (int)g.orden.size(); i++) {
+                PasoGrafo& p = g.pasos[g.orden[i]];
+                for (auto lista : { &p.lee, &p.escribe })
+                    for (auto& nombre : *lista) {
+                        if (nombre == pantalla)
+                            continue;
+                        RecursoGrafo& r = g.recursos[nombre];
+                        if (r.primero < 0)
+                            r.primero = i;
+                        r.ultimo = std::max(r.ultimo, i);
+                    }
+            }
+
+            // Asignamos texturas físicas por orden de primer uso
+            // Un recurso reutiliza una textura del mismo formato y tamaño si el anterior dueño ya no se usa
+            // Las texturas de la compilación anterior se reaprovechan si coinciden, el resto se eliminan
+            std::vector<ui32> anteriores;
+            std::swap(anteriores, g.fisicas);
+            std::vector<int> libre_desde;
+            std::vector<RecursoGrafo*> por_uso;
+            for (auto& [nombre, r] : g.recursos)
+                if (r.primero >= 0)
+                    por_uso.push_back(&r);
+            std::sort(por_uso.begin(), por_uso.end(), [](auto a, auto b) { return a->primero < b->primero; });
+
+            g.tam = gl.tam_win;
+            g.escala = gl.resolucion.escala;
+            g.memoria_sin_alias = g.memoria = 0;
+            for (RecursoGrafo* r : por_uso) {
+                float escala = r->escala * (r->dinamico ? g.escala : 1.f);
+                glm::ivec2 tam = glm::max(glm::ivec2(glm::vec2(g.tam) * escala), glm::ivec2(1));
+                ui64 bytes = (ui64)tam.x * tam.y * textura::bytesPixel(r->formato);
+                g.memoria_sin_alias += bytes;
+
+                int elegida = -1;
+                for (ui32 f = 0; f < g.fisicas.size(); f++) {
+                    Textura& t = gl.texturas[g.fisicas[f]];
+                    if (t.formato == r->formato and t.tam == tam and libre_desde[f] < r->primero) {
+                        elegida = f;
+                        break;
+                    }
+                }
+
+                if (elegida < 0) {
+                    auto it = std::find_if(anteriores.begin(), anteriores.end(), [&](ui32 t) {
+                        return gl.texturas[t].formato == r->formato and gl.texturas[t].tam == tam;
+                    });
+                    ui32 id;
+                    if (it != anteriores.end()) {
+                        id = *it;
+                        anteriores.erase(it);
+                    } else {
+                        id = textura::crear(GL_TEXTURE_2D, r->formato, 0, 0, tam);
+                        Textura& t = gl.texturas[id];
+                        bool profundidad = textura::esProfundidad(r->formato);
+                        t.sampler = sampler::obtener(profundidad ? GL_NEAREST : GL_LINEAR, profundidad ? GL_NEAREST : GL_LINEAR);
+                        textura::detail::vincularCarga(t);
+                        glTexImage2D(GL_TEXTURE_2D, 0, r->formato, tam.x, tam.y, 0, textura::fi_a_formato(r->formato), textura::fi_a_tipo(r->formato), nullptr);
+                    }
+                    elegida = g.fisicas.size();
+                    g.fisicas.push_back(id);
+                    libre_desde.push_back(-1);
+                    g.memoria += bytes;
+                }
+                libre_desde[elegida] = r->ultimo;
+                r->textura = g.fisicas[elegida];
+            }
+            detail::liberar(anteriores);
+
+            // Framebuffer de cada paso con los recursos que escribe
+            for (auto& p : g.pasos) {
+                if (p.fbo != 0)
+                    glDeleteFramebuffers(1, &p.fbo);
+                p.fbo = 0;
+                p.tam = gl.tam_fb;
+            }
+            for (ui32 i : g.orden) {
+                PasoGrafo& p = g.pasos[i];
+                if (p.escribe.empty() or p.escribe[0] == pantalla)
+                    continue;
+
+                glGenFramebuffers(1, &p.fbo);
+                glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+                std::vector<ui32> color;
+                for (auto& w : p.escribe) {
+                    RecursoGrafo& r = g.recursos[w];
+                    Textura& t = gl.texturas[r.textura];
+                    p.tam = t.tam;
+                    ui32 att = GL_COLOR_ATTACHMENT0 + color.size();
+                    if (r.formato == GL_DEPTH24_STENCIL8 or r.formato == GL_DEPTH32F_STENCIL8)
+                        att = GL_DEPTH_STENCIL_ATTACHMENT;
+                    else if (textura::esProfundidad(r.formato))
+                        att = GL_DEPTH_ATTACHMENT;
+                    else
+                        color.push_back(att);
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, att, GL_TEXTURE_2D, t.textura, 0);
+                }
+                glDrawBuffers(color.size(), color.data());
+                if (color.empty())
+                    glReadBuffer(GL_NONE);
+
+                if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                    log::error("No se pudo crear el framebuffer del paso '{}'", p.nombre);
+                    std::exit(-1);
+                }
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            g.activos = activos;
+            g.compilado = true;
+            debug::gl();
+
+            log::info("Grafo: {} de {} pasos, {} texturas para {} recursos, {} KiB ({} KiB sin compartir)",
+                      g.orden.size(), n, g.fisicas.size(), por_uso.size(), g.memoria / 1024, g.memoria_sin_alias / 1024);
+        }
+
+        // Ejecutar los pasos necesarios
+        // Cada recurso se limpia en el primer paso que lo escribe, así solo se limpia lo que se va a usar
+        inline void ejecutar() {
+            Grafo& g = gl.grafo;
+            std::vector<bool>& activos = g.activos_frame;
+            activos.resize(g.pasos.size());
+            for (ui32 i = 0; i < g.pasos.size(); i++)
+                activos[i] = not g.pasos[i].activo or g.pasos[i].activo();
+            if (not g.compilado or activos != g.activos or g.tam != gl.tam_win or g.escala != gl.resolucion.escala)
+                compilar(activos);
+
+            g.ejecuciones++;
+            g.ejecutando = true;
+            for (int i = 0; i < (int)g.orden.size(); i++) {
+                PasoGrafo& p = g.pasos[g.orden[i]];
+                glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+                glViewport(0, 0, p.tam.x, p.tam.y);
+
+                int color = 0;
+                for (auto& w : p.escribe) {
+                    if (w == pantalla)
+                        continue;
+                    RecursoGrafo& r = g.recursos[w];
+                    bool profundidad = textura::esProfundidad(r.formato);
+                    if (r.primero == i) {
+                        if (r.formato == GL_DEPTH24_STENCIL8 or r.formato == GL_DEPTH32F_STENCIL8)
+                            glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.f, 0);
+                        else if (profundidad)
+                            glClearBufferfv(GL_DEPTH, 0, glm::value_ptr(glm::vec4(1.f)));
+                        else
+                            glClearBufferfv(GL_COLOR, color, glm::value_ptr(r.clear));
+                    }
+                    if (not profundidad)
+                        color++;
+                }
+
+                p.ejecutar();
+            }
+            g.ejecutando = false;
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, gl.tam_fb.x, gl.tam_fb.y);
+            debug::gl();
+        }
+
+        // Vincular la textura de un recurso para leerlo en una shader
+        // Devuelve la unidad de textura para asignarla al uniform del sampler
+        inline int vincular(const str& nombre) {
+            RecursoGrafo& r = gl.grafo.recursos.at(nombre);
+            if (r.primero < 0) {
+                log::error("El recurso '{}' no se usa en el grafo", nombre);
+                std::exit(-1);
+            }
+            return textura::vincular(r.textura);
+        }
+    }
+}
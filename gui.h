@@ -17,6 +17,13 @@
 
 namespace tofu
 {
+    // Definidas en resolucion.h, que se incluye después (depende de core.h, que incluye este archivo)
+    namespace resolucion
+    {
+        inline void activar(float objetivo, float minima, float maxima);
+        inline void desactivar();
+    }
+
     // Estructura para almacenar la información necesaria de ImGui
     // (Separada de la estructura principal para permitir deshabilitarlo fácilmente)
     struct GuiData {
@@ -104,6 +111,32 @@ namespace tofu
                 ImGui::Text("objetos:    %21d", debug::num_instancias);
                 ImGui::Text("triangulos: %21d", debug::num_triangulos);
                 ImGui::Text("vertices:   %21d", debug::num_vertices);
+                ImGui::Text("vinculos:   %21d", debug::num_vinculos);
+                ImGui::Text("clusters:   %12d / %6d", debug::clusters_visibles, debug::num_clusters);
+                ImGui::Text("new:        %8d frame %6d rendr", debug::asignaciones_frame, debug::asignaciones_render);
+
+                // Caché de texturas
+                CacheImagenes& cache = gl.cache_imagenes;
+                ImGui::Text("texturas:   %9d ok %7d fallo", cache.aciertos, cache.fallos);
+                ImGui::Text("ahorrado:   %18d KiB", (int)(cache.bytes_ahorrados / 1024));
+
+                // Caché de binarios de shaders
+                CacheShaders& cs = gl.cache_shaders;
+                ImGui::Text("shaders:    %9d ok %7d fallo", cs.aciertos, cs.fallos);
+
+                // Streaming de mipmaps
+                Streaming& st = gl.streaming;
+                ImGui::Text("residente:  %10d / %6d KiB", (int)(st.residente / 1024), (int)(st.presupuesto / 1024));
+                ImGui::Text("niveles:    %9d sub %6d exp", st.subidos, st.expulsados);
+
+                // Grafo de renderizado
+                Grafo& g = gl.grafo;
+                ImGui::Text("pasos:      %18d / %d", (int)g.orden.size(), (int)g.pasos.size());
+                ImGui::Text("targets:    %10d / %6d KiB", (int)(g.memoria / 1024), (int)(g.memoria_sin_alias / 1024));
+
+                // Resolución dinámica
+                Resolucion& res = gl.resolucion;
+                ImGui::Text("resolucion: %8.0f%% %8.2f ms", res.escala * 100.f, res.tiempo);
         
                 // ---
                 // Ajustes
@@ -123,6 +156,23 @@ namespace tofu
                 //       Al no tener contadores de la GPU tampoco podemos medir lo que tardan en ejecutarse las shaders, algo que sería útil.
                 ImGui::Checkbox("usar instancias", &debug::usar_instancias);
 
+                // Presupuesto de memoria para el streaming de texturas
+                int presupuesto = gl.streaming.presupuesto >> 20;
+                if (ImGui::SliderInt("presupuesto (MiB)", &presupuesto, 1, 512))
+                    gl.streaming.presupuesto = (ui64)presupuesto << 20;
+
+                // Resolución dinámica
+                // Se pasa por activar y desactivar para que no se ajuste con tiempos de cuando estaba activa
+                bool dinamica = gl.resolucion.activa;
+                if (ImGui::Checkbox("resolucion dinamica", &dinamica)) {
+                    if (dinamica)
+                        resolucion::activar(gl.resolucion.objetivo, gl.resolucion.minima, gl.resolucion.maxima);
+                    else
+                        resolucion::desactivar();
+                }
+                ImGui::SliderFloat("objetivo (ms)", &gl.resolucion.objetivo, 4.f, 50.f);
+                ImGui::SliderFloat("nitidez", &gl.resolucion.nitidez, 0.f, 1.f);
+
                 #else
 
                 ImGui::Text("activa el modo debug para ver este panel");
@@ -0,0 +1,93 @@
+// Funciones hash
+#pragma once
+
+#include <cstring>
+
+#include "tipos.h"
+
+namespace tofu::hash
+{
+    namespace detail
+    {
+        constexpr ui64 P1 = 0x9E3779B185EBCA87ULL;
+        constexpr ui64 P2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr ui64 P3 = 0x165667B19E3779F9ULL;
+        constexpr ui64 P4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr ui64 P5 = 0x27D4EB2F165667C5ULL;
+
+        inline ui64 rotl(ui64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        inline ui64 leer64(const ui8* p) { ui64 v; std::memcpy(&v, p, 8); return v; }
+        inline ui32 leer32(const ui8* p) { ui32 v; std::memcpy(&v, p, 4); return v; }
+
+        inline ui64 ronda(ui64 acc, ui64 v) {
+            acc += v * P2;
+            acc = rotl(acc, 31);
+            return acc * P1;
+        }
+
+        inline ui64 mezclar(ui64 acc, ui64 v) {
+            acc ^= ronda(0, v);
+            return acc * P1 + P4;
+        }
+    }
+
+    // xxHash64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md)
+    // Mucho más rápido que std::hash para bloques grandes como el contenido de un archivo
+    inline ui64 xxh64(const void* datos, size_t len, ui64 semilla = 0) {
+        using namespace detail;
+        const ui8* p = (const ui8*)datos;
+        const ui8* fin = p + len;
+        ui64 h;
+
+        // Bloques de 32 bytes con cuatro acumuladores
+        if (len >= 32) {
+            ui64 v1 = semilla + P1 + P2;
+            ui64 v2 = semilla + P2;
+            ui64 v3 = semilla;
+            ui64 v4 = semilla - P1;
+            for (; p + 32 <= fin; p += 32) {
+                v1 = ronda(v1, leer64(p));
+                v2 = ronda(v2, leer64(p + 8));
+                v3 = ronda(v3, leer64(p + 16));
+                v4 = ronda(v4, leer64(p + 24));
+            }
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = mezclar(h, v1);
+            h = mezclar(h, v2);
+            h = mezclar(h, v3);
+            h = mezclar(h, v4);
+        } else {
+            h = semilla + P5;
+        }
+        h += len;
+
+        // Resto de bytes
+        for (; p + 8 <= fin; p += 8) {
+            h ^= ronda(0, leer64(p));
+            h = rotl(h, 27) * P1 + P4;
+        }
+        if (p + 4 <= fin) {
+            h ^= (ui64)leer32(p) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < fin; p++) {
+            h ^= (*p) * P5;
+            h = rotl(h, 11) * P1;
+        }
+
+        // Avalancha final
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // Combinar dos hashes (por ejemplo, contenido y parámetros de carga)
+    inline ui64 combinar(ui64 a, ui64 b) {
+        return detail::mezclar(a, b);
+    }
+}
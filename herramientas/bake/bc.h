@@ -0,0 +1,246 @@
+// Compresores por bloques (BC1, BC3, BC4, BC5 y BC7 modo 6)
+// Priorizan la sencillez frente a la calidad máxima: ejes principales, sin búsqueda exhaustiva
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+#include "ktx.h"
+
+namespace bc
+{
+    using namespace tofu;
+
+    // Bloque de 4x4 píxeles RGBA8
+    using Bloque = std::array<ui8, 64>;
+
+    namespace detail
+    {
+        inline ui16 a565(const float* c) {
+            ui32 r = std::clamp((int)std::round(c[0] * 31.f / 255.f), 0, 31);
+            ui32 g = std::clamp((int)std::round(c[1] * 63.f / 255.f), 0, 63);
+            ui32 b = std::clamp((int)std::round(c[2] * 31.f / 255.f), 0, 31);
+            return (r << 11) | (g << 5) | b;
+        }
+
+        // Eje principal de los colores del bloque (iteración de potencia sobre la covarianza)
+        // Devuelve los extremos proyectados sobre el eje
+        template <int N>
+        inline void extremos(const Bloque& b, float* e0, float* e1) {
+            float media[N] = {};
+            for (int i = 0; i < 16; i++)
+                for (int k = 0; k < N; k++)
+                    media[k] += b[i * 4 + k] / 16.f;
+
+            float cov[N][N] = {};
+            for (int i = 0; i < 16; i++)
+                for (int j = 0; j < N; j++)
+                    for (int k = 0; k < N; k++)
+                        cov[j][k] += (b[i * 4 + j] - media[j]) * (b[i * 4 + k] - media[k]);
+
+            float eje[N];
+            for (int k = 0; k < N; k++)
+                eje[k] = 1.f;
+            for (int it = 0; it < 8; it++) {
+                float nuevo[N] = {};
+                float len = 0.f;
+                for (int j = 0; j < N; j++) {
+                    for (int k = 0; k < N; k++)
+                        nuevo[j] += cov[j][k] * eje[k];
+                    len += nuevo[j] * nuevo[j];
+                }
+                if (len < 1e-6f)
+                    break;
+                len = std::sqrt(len);
+                for (int k = 0; k < N; k++)
+                    eje[k] = nuevo[k] / len;
+            }
+
+            float tmin = 1e9f, tmax = -1e9f;
+            for (int i = 0; i < 16; i++) {
+                float t = 0.f;
+                for (int k = 0; k < N; k++)
+                    t += (b[i * 4 + k] - media[k]) * eje[k];
+                tmin = std::min(tmin, t);
+                tmax = std::max(tmax, t);
+            }
+            for (int k = 0; k < N; k++) {
+                e0[k] = std::clamp(media[k] + eje[k] * tmax, 0.f, 255.f);
+                e1[k] = std::clamp(media[k] + eje[k] * tmin, 0.f, 255.f);
+            }
+        }
+
+        // Índice de la entrada más cercana de una paleta
+        template <int N>
+        inline ui32 cercano(const ui8* p, const float (*paleta)[4], int n) {
+            ui32 mejor = 0;
+            float dmin = 1e30f;
+            for (int j = 0; j < n; j++) {
+                float d = 0.f;
+                for (int k = 0; k < N; k++)
+                    d += (p[k] - paleta[j][k]) * (p[k] - paleta[j][k]);
+                if (d < dmin) {
+                    dmin = d;
+                    mejor = j;
+                }
+            }
+            return mejor;
+        }
+
+        // Escritor de bits (de menor a mayor)
+        struct Bits {
+            ui8* b;
+            ui32 pos = 0;
+            void escribir(ui32 v, ui32 n) {
+                for (ui32 i = 0; i < n; i++, pos++)
+                    b[pos / 8] |= ((v >> i) & 1) << (pos % 8);
+            }
+        };
+    }
+
+    // Bloque de color BC1 (también se usa en la parte de color de BC3)
+    inline void color(const Bloque& b, ui8* salida) {
+        float e0[3], e1[3];
+        detail::extremos<3>(b, e0, e1);
+        ui16 c0 = detail::a565(e0), c1 = detail::a565(e1);
+
+        // Siempre usamos el modo de 4 colores (c0 > c1)
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        float paleta[4][4] = {};
+        ui8 rgb[3];
+        ktx::detail::color565(c0, rgb);
+        for (int k = 0; k < 3; k++) paleta[0][k] = rgb[k];
+        ktx::detail::color565(c1, rgb);
+        for (int k = 0; k < 3; k++) paleta[1][k] = rgb[k];
+        for (int k = 0; k < 3; k++) {
+            paleta[2][k] = (2.f * paleta[0][k] + paleta[1][k]) / 3.f;
+            paleta[3][k] = (paleta[0][k] + 2.f * paleta[1][k]) / 3.f;
+        }
+
+        ui32 ind = 0;
+        if (c0 != c1)
+            for (int i = 0; i < 16; i++)
+                ind |= detail::cercano<3>(&b[i * 4], paleta, 4) << (2 * i);
+
+        salida[0] = c0 & 0xFF; salida[1] = c0 >> 8;
+        salida[2] = c1 & 0xFF; salida[3] = c1 >> 8;
+        std::memcpy(salida + 4, &ind, 4);
+    }
+
+    // Bloque de un canal (alfa de BC3, BC4 y cada canal de BC5)
+    inline void canal(const Bloque& b, int k, ui8* salida) {
+        ui8 a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; i++) {
+            a0 = std::max(a0, b[i * 4 + k]);
+            a1 = std::min(a1, b[i * 4 + k]);
+        }
+
+        // Modo de 8 valores interpolados (a0 > a1)
+        float v[8] = { (float)a0, (float)a1 };
+        for (int i = 1; i < 7; i++)
+            v[i + 1] = ((7 - i) * a0 + i * a1) / 7.f;
+
+        uint64_t ind = 0;
+        if (a0 != a1)
+            for (int i = 0; i < 16; i++) {
+                ui32 mejor = 0;
+                for (ui32 j = 1; j < 8; j++)
+                    if (std::abs(b[i * 4 + k] - v[j]) < std::abs(b[i * 4 + k] - v[mejor]))
+                        mejor = j;
+                ind |= (uint64_t)mejor << (3 * i);
+            }
+
+        salida[0] = a0;
+        salida[1] = a1;
+        for (int i = 0; i < 6; i++)
+            salida[2 + i] = (ind >> (8 * i)) & 0xFF;
+    }
+
+    // Bloque BC7 en modo 6: una partición, RGBA con extremos de 7 bits + bit p e índices de 4 bits
+    inline void bc7(const Bloque& b, ui8* salida) {
+        float e[2][4];
+        detail::extremos<4>(b, e[0], e[1]);
+
+        // Cuantizamos los extremos eligiendo el bit p con menos error
+        ui32 q[2][4], p[2];
+        for (int j = 0; j < 2; j++) {
+            float err[2] = { 0.f, 0.f };
+            ui32 qp[2][4];
+            for (ui32 pb = 0; pb < 2; pb++)
+                for (int k = 0; k < 4; k++) {
+                    int v = std::clamp((int)std::round((e[j][k] - pb) / 2.f), 0, 127);
+                    qp[pb][k] = v;
+                    float r = (v << 1) | pb;
+                    err[pb] += (r - e[j][k]) * (r - e[j][k]);
+                }
+            p[j] = err[1] < err[0] ? 1 : 0;
+            std::memcpy(q[j], qp[p[j]], sizeof(q[j]));
+        }
+
+        // Paleta de 16 colores interpolados
+        float paleta[16][4];
+        for (int i = 0; i < 16; i++) {
+            ui32 w = ktx::detail::pesos_bc7[i];
+            for (int k = 0; k < 4; k++) {
+                ui32 a = (q[0][k] << 1) | p[0], c = (q[1][k] << 1) | p[1];
+                paleta[i][k] = ((64 - w) * a + w * c + 32) >> 6;
+            }
+        }
+        ui32 ind[16];
+        for (int i = 0; i < 16; i++)
+            ind[i] = detail::cercano<4>(&b[i * 4], paleta, 16);
+
+        // El primer índice tiene que tener el bit alto a 0, si no intercambiamos los extremos
+        if (ind[0] & 8) {
+            std::swap(q[0], q[1]);
+            std::swap(p[0], p[1]);
+            for (auto& i : ind)
+                i = 15 - i;
+        }
+
+        std::memset(salida, 0, 16);
+        detail::Bits bits { salida };
+        bits.escribir(0x40, 7);
+        for (int k = 0; k < 4; k++)
+            for (int j = 0; j < 2; j++)
+                bits.escribir(q[j][k], 7);
+        bits.escribir(p[0], 1);
+        bits.escribir(p[1], 1);
+        for (int i = 0; i < 16; i++)
+            bits.escribir(ind[i], i == 0 ? 3 : 4);
+    }
+
+    // Comprimir una imagen RGBA8 completa en el formato indicado
+    inline std::vector<ui8> comprimir(ui32 formato, ui32 w, ui32 h, const ui8* rgba) {
+        ui32 bytes = ktx::bytesBloque(formato);
+        if (bytes == 0)
+            return std::vector<ui8>(rgba, rgba + w * h * 4);
+
+        ui32 bw = (w + 3) / 4, bh = (h + 3) / 4;
+        std::vector<ui8> salida(bw * bh * bytes);
+        Bloque b;
+        for (ui32 by = 0; by < bh; by++) {
+            for (ui32 bx = 0; bx < bw; bx++) {
+                // Copiamos el bloque repitiendo el borde si la imagen no es múltiplo de 4
+                for (ui32 y = 0; y < 4; y++)
+                    for (ui32 x = 0; x < 4; x++) {
+                        ui32 px = std::min(bx * 4 + x, w - 1), py = std::min(by * 4 + y, h - 1);
+                        std::memcpy(&b[(y * 4 + x) * 4], rgba + (py * w + px) * 4, 4);
+                    }
+
+                ui8* s = salida.data() + (by * bw + bx) * bytes;
+                switch (formato) {
+                    case ktx::BC1: color(b, s); break;
+                    case ktx::BC3: canal(b, 3, s); color(b, s + 8); break;
+                    case ktx::BC4: canal(b, 0, s); break;
+                    case ktx::BC5: canal(b, 0, s); canal(b, 1, s + 8); break;
+                    case ktx::BC7: bc7(b, s); break;
+                }
+            }
+        }
+        return salida;
+    }
+}
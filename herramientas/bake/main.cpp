@@ -0,0 +1,154 @@
+// Herramienta: tofu-bake
+// José Pazos Pérez
+
+// Convierte imágenes PNG en texturas KTX con mipmaps precalculados y compresión por bloques
+// Así la aplicación no tiene que decodificar ni generar nada al iniciar, y la textura ocupa de 4 a 8 veces menos en la GPU
+//
+// Uso:
+//   tofu-bake [-f rgba8|bc1|bc3|bc4|bc5|bc7] [-o salida.ktx] [--sin-mips] [--lineal] entrada.png [entrada2.png ...]
+// Si se indican varias imágenes se guardan como capas de un array de texturas (en el mismo orden)
+// Los nombres de las entradas se guardan en la clave "tofu.capas" del archivo
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "ktx.h"
+#include "bc.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <map>
+#include <string>
+
+namespace fs = std::filesystem;
+using namespace tofu;
+
+// ---
+
+const std::map<std::string, ui32> formatos = {
+    { "rgba8", ktx::RGBA8 },
+    { "bc1", ktx::BC1 },
+    { "bc3", ktx::BC3 },
+    { "bc4", ktx::BC4 },
+    { "bc5", ktx::BC5 },
+    { "bc7", ktx::BC7 },
+};
+
+// Conversiones de gamma para filtrar en espacio lineal
+inline float aLineal(ui8 v) { return std::pow(v / 255.f, 2.2f); }
+inline ui8 aGamma(float v) { return (ui8)std::clamp((int)std::round(std::pow(v, 1.f / 2.2f) * 255.f), 0, 255); }
+
+// Reducir una imagen a la mitad con un filtro de caja 2x2
+// Si el tamaño es impar se repite el último píxel
+std::vector<ui8> reducir(const std::vector<ui8>& img, ui32 w, ui32 h, bool lineal) {
+    ui32 nw = std::max(w / 2, 1u), nh = std::max(h / 2, 1u);
+    std::vector<ui8> salida(nw * nh * 4);
+
+    for (ui32 y = 0; y < nh; y++) {
+        for (ui32 x = 0; x < nw; x++) {
+            for (ui32 k = 0; k < 4; k++) {
+                float suma = 0.f;
+                for (ui32 dy = 0; dy < 2; dy++)
+                    for (ui32 dx = 0; dx < 2; dx++) {
+                        ui32 px = std::min(x * 2 + dx, w - 1), py = std::min(y * 2 + dy, h - 1);
+                        ui8 v = img[(py * w + px) * 4 + k];
+                        suma += (lineal or k == 3) ? v / 255.f : aLineal(v);
+                    }
+                suma *= 0.25f;
+                salida[(y * nw + x) * 4 + k] = (lineal or k == 3) ? (ui8)std::round(suma * 255.f) : aGamma(suma);
+            }
+        }
+    }
+    return salida;
+}
+
+int main(int argc, char** argv) {
+    ui32 formato = ktx::BC7;
+    std::string salida;
+    bool mips = true, lineal = false;
+    std::vector<std::string> entradas;
+
+    // Argumentos
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "-f" and i + 1 < argc) {
+            auto it = formatos.find(argv[++i]);
+            if (it == formatos.end()) {
+                std::cerr << "formato no soportado: " << argv[i] << std::endl;
+                return -1;
+            }
+            formato = it->second;
+        } else if (a == "-o" and i + 1 < argc) {
+            salida = argv[++i];
+        } else if (a == "--sin-mips") {
+            mips = false;
+        } else if (a == "--lineal") {
+            lineal = true;
+        } else {
+            entradas.push_back(a);
+        }
+    }
+    if (entradas.empty()) {
+        std::cerr << "uso: tofu-bake [-f rgba8|bc1|bc3|bc4|bc5|bc7] [-o salida.ktx] [--sin-mips] [--lineal] entrada.png [...]" << std::endl;
+        return -1;
+    }
+    if (salida.empty())
+        salida = fs::path(entradas[0]).replace_extension(".ktx").string();
+
+    // Cargamos las imágenes (volteadas igual que en textura::cargar)
+    int w = 0, h = 0, ch;
+    stbi_set_flip_vertically_on_load(true);
+    std::vector<std::vector<ui8>> capas;
+    for (auto& e : entradas) {
+        int iw, ih;
+        ui8* d = stbi_load(e.c_str(), &iw, &ih, &ch, 4);
+        if (not d) {
+            std::cerr << "no se pudo cargar la imagen: " << e << std::endl;
+            return -1;
+        }
+        if (not capas.empty() and (iw != w or ih != h)) {
+            std::cerr << "todas las imágenes tienen que tener el mismo tamaño: " << e << std::endl;
+            return -1;
+        }
+        w = iw; h = ih;
+        capas.emplace_back(d, d + w * h * 4);
+        stbi_image_free(d);
+    }
+
+    // Generamos la cadena de mipmaps y comprimimos cada nivel
+    // Los niveles guardan todas las capas seguidas, como pide KTX
+    ui32 num_niveles = mips ? ktx::numNiveles(w, h) : 1;
+    std::vector<std::vector<ui8>> niveles(num_niveles);
+    size_t bytes_rgba = 0;
+    ui32 lw = w, lh = h;
+    for (ui32 n = 0; n < num_niveles; n++) {
+        for (auto& c : capas) {
+            auto comprimido = bc::comprimir(formato, lw, lh, c.data());
+            niveles[n].insert(niveles[n].end(), comprimido.begin(), comprimido.end());
+            bytes_rgba += c.size();
+
+            if (n + 1 < num_niveles)
+                c = reducir(c, lw, lh, lineal);
+        }
+        lw = std::max(lw / 2, 1u);
+        lh = std::max(lh / 2, 1u);
+    }
+
+    // Guardamos el archivo
+    // Con los nombres de las entradas, para que la aplicación pueda comprobar el orden de las capas
+    std::string nombres;
+    for (auto& e : entradas)
+        nombres += (nombres.empty() ? "" : "\n") + e;
+    auto archivo = ktx::escribir(formato, w, h, capas.size(), niveles, { { ktx::clave_capas, nombres } });
+    std::ofstream out(salida, std::ios::binary);
+    if (not out.is_open()) {
+        std::cerr << "no se pudo escribir el archivo: " << salida << std::endl;
+        return -1;
+    }
+    out.write((const char*)archivo.data(), archivo.size());
+
+    std::cout << salida << ": " << w << "x" << h << ", " << capas.size() << " capas, " << num_niveles << " niveles, "
+              << archivo.size() / 1024 << " KiB (" << bytes_rgba / 1024 << " KiB en rgba8)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Herramienta: tofu-bench
+// José Pazos Pérez
+
+// Mide el tiempo de generar las figuras de geometria.h
+// Compara la esfera a partir de octaedro con la versión anterior (slerp por vértice y vectores sin reservar),
+// con la que devuelve vectores y con la que escribe en memoria ya reservada (como un buffer mapeado de la GPU)
+// También compara cuántos vértices necesita cada teselado de la esfera para llegar a un error de silueta
+//
+// Uso:
+//   tofu-bench [n_max]
+// Por defecto llega hasta esferaOct(512)
+
+#include "geometria.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+using namespace tofu;
+
+// ---
+
+// Esfera como se generaba antes, para comparar
+// Mismo orden de vértices e índices, pero con slerp y haciendo crecer los vectores
+std::pair<std::vector<float>, std::vector<ui32>> referencia(ui32 n) {
+    using V = std::array<float, 3>;
+    auto& ov = detail::oct_vert;
+    std::vector<float> vertices;
+    std::vector<ui32> indices;
+
+    V v0 = {ov[0], ov[1], ov[2]};
+    vertices.insert(vertices.end(), v0.begin(), v0.end());
+    for (ui32 i = 1; i < 2*n; i++) {
+        for (ui32 j = 1; j <= 4; j++) {
+            ui32 k = (j == 1) ? 4 : j - 1;
+            auto va = detail::slerp(v0, {ov[j * 3], ov[j * 3 + 1], ov[j * 3 + 2]}, (float)i / n);
+            auto vb = detail::slerp(v0, {ov[k * 3], ov[k * 3 + 1], ov[k * 3 + 2]}, (float)i / n);
+            ui32 ii = (i < n) ? i : 2*n - i;
+            for (ui32 l = 1; l < ii; l++) {
+                auto vc = detail::slerp(va, vb, (float)(ii-l) / ii);
+                vertices.insert(vertices.end(), vc.begin(), vc.end());
+            }
+            vertices.insert(vertices.end(), va.begin(), va.end());
+        }
+    }
+    V vn = {ov[15], ov[16], ov[17]};
+    vertices.insert(vertices.end(), vn.begin(), vn.end());
+
+    // Triangulación original, índice a índice y sin reservar memoria
+    using I = std::array<ui32, 3>;
+    I ind = {0, 0, 0}, ind_ccw = {0, 0, 0};
+    ui32 vert_acc = 1;
+    ui32 vert_anterior = 0;
+    for (ui32 i = 1; i < n+1; i++) {
+        ui32 tri = (2 * (i-1) + 1) * 4;
+        ui32 primer_vertice = vert_acc + i-1;
+        ind = {primer_vertice, vert_anterior, primer_vertice + 1};
+        for (ui32 j = 0; j < tri; j++) {
+            ind_ccw = ind;
+            if (ind[0] > ind[1])
+                std::swap(ind_ccw[0], ind_ccw[1]);
+            indices.insert(indices.end(), ind_ccw.begin(), ind_ccw.end());
+            if ((j+1) % (tri/4) == 0) {
+                ind[0] = ind[2];
+            } else {
+                ind[0] = ind[1];
+                ind[1] = ind[2];
+            }
+            ind[2] = ind[0] + 1;
+            if (ind[2] == vert_acc) ind[2] = vert_anterior - (i-2);
+            if (ind[2] == vert_acc + i*4) ind[2] = vert_acc;
+        }
+        vert_acc += i * 4;
+        vert_anterior = primer_vertice;
+    }
+
+    vert_acc = 0;
+    for (ui32 i = 1; i < 2*n; i++)
+        vert_acc += ((i < n) ? i : 2*n - i) * 4;
+    vert_anterior = vert_acc + 1;
+    for (ui32 i = 1; i < n+1; i++) {
+        ui32 tri = (2 * (i-1) + 1) * 4;
+        ui32 primer_vertice = vert_acc;
+        ind = {primer_vertice, vert_anterior, primer_vertice - 1};
+        for (ui32 j = 0; j < tri; j++) {
+            ind_ccw = ind;
+            if (ind[0] < ind[1])
+                std::swap(ind_ccw[0], ind_ccw[1]);
+            indices.insert(indices.end(), ind_ccw.begin(), ind_ccw.end());
+            if ((j+1) % (tri/4) == 0) {
+                ind[0] = ind[2];
+            } else {
+                ind[0] = ind[1];
+                ind[1] = ind[2];
+            }
+            ind[2] = ind[0] - 1;
+            if (ind[2] == vert_acc) ind[2] = vert_anterior;
+            if (ind[2] == vert_acc - i*4) ind[2] = vert_acc;
+        }
+        vert_acc -= i * 4;
+        vert_anterior = primer_vertice;
+    }
+
+    return std::make_pair(vertices, indices);
+}
+
+// Repetir una función hasta llenar un tiempo mínimo y devolver los ms por llamada
+template <typename F>
+double medir(F f) {
+    using reloj = std::chrono::steady_clock;
+    ui32 repeticiones = 0;
+    auto inicio = reloj::now();
+    std::chrono::duration<double, std::milli> total;
+    do {
+        f();
+        repeticiones++;
+        total = reloj::now() - inicio;
+    } while (total.count() < 200.0);
+    return total.count() / repeticiones;
+}
+
+// Las esferas fijas se generan al compilar, aquí solo se comprueba que existen
+constexpr auto esfera_fija = geometria::esferaOctFija<8>();
+static_assert(esfera_fija.first.size() == geometria::verticesEsferaOct(8) * 3);
+
+// ---
+
+int main(int argc, char** argv) {
+    ui32 n_max = argc > 1 ? std::stoi(argv[1]) : 512;
+
+    std::printf("esferaOct        vértices   referencia      vector     memoria  (ms, Mvért/s con memoria)\n");
+    std::vector<float> vertices;
+    std::vector<ui32> indices;
+    volatile float sumidero = 0.f;
+
+    for (ui32 n = 1; n <= n_max; n *= 2) {
+        ui32 nv = geometria::verticesEsferaOct(n);
+        vertices.resize(nv * 3);
+        indices.resize(geometria::indicesEsferaOct(n));
+
+        double ms_ref = medir([&]{ sumidero = sumidero + referencia(n).first[3]; });
+        double ms_vec = medir([&]{ sumidero = sumidero + geometria::esferaOct(n).first[3]; });
+        double ms_mem = medir([&]{ geometria::esferaOct(n, vertices.data(), indices.data()); sumidero = sumidero + vertices[3]; });
+
+        std::printf("n = %-4d %16d %12.3f %11.3f %11.3f  %6.1fx %8.1f\n", n, nv, ms_ref, ms_vec, ms_mem, ms_ref / ms_mem, nv / ms_mem / 1e3);
+    }
+
+    std::printf("esferaOctFija<8>: %d vértices generados al compilar\n", (int)esfera_fija.first.size() / 3);
+
+    // Teselados para un mismo error de silueta (relativo al radio)
+    const char* nombres[] = { "octaedro", "oct. area", "icosaedro", "cubo" };
+    std::printf("\nerror silueta    octaedro   oct. area   icosaedro        cubo  (vértices, n)  mejor\n");
+    for (float error : { 1e-1f, 3e-2f, 1e-2f, 3e-3f, 1e-3f, 1e-4f }) {
+        std::printf("%-14g", error);
+        for (auto t : geometria::teselados) {
+            ui32 n = geometria::subdivisionesEsfera(t, error);
+            std::printf(" %7d %3d", geometria::verticesEsfera(t, n), n);
+        }
+        std::printf("  %s\n", nombres[geometria::mejorEsfera(error).teselado]);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Herramienta: tofu-pack
+// José Pazos Pérez
+
+// Junta las shaders, texturas y figuras de un proyecto en un paquete de recursos (ver paquete.h)
+// La aplicación lo abre con paquete::abrir y lo mapea en memoria, así no tiene que abrir cada archivo por separado
+// ni generar las figuras al iniciar
+//
+// Uso:
+//   tofu-pack [-o salida.tofu] [-c] [-m nombre=figura[:n] ...] carpeta|archivo [...]
+// Los archivos se guardan con su ruta relativa a la carpeta actual (por ejemplo, shaders/planetas.vert)
+// Figuras: esfera:n (esferaOct), esfera_area:n (esferaOctArea), icosfera:n, esfera_cubo:n, circulo:n, cubo, plano, octaedro
+// Con -c las figuras de triángulos que van detrás se guardan agrupadas en clusters (ver clusters.h)
+
+#include "paquete.h"
+#include "geometria.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace fs = std::filesystem;
+using namespace tofu;
+
+// ---
+
+// Generadores de las figuras que se pueden guardar
+// Reciben el número de subdivisiones (0 si no se indica)
+using Figura = std::function<std::vector<ui8>(ui32)>;
+
+// Agrupar en clusters las figuras siguientes (-c)
+bool agrupar = false;
+
+template <typename V, typename I>
+std::vector<ui8> malla(const V& vertices, const I& indices, ui32 tipo = paquete::TRIANGULOS) {
+    if (not agrupar or tipo != paquete::TRIANGULOS or indices.size() == 0)
+        return paquete::malla(vertices.data(), vertices.size(), indices.data(), indices.size(), tipo);
+
+    // Todas las figuras tienen solo la posición en cada vértice
+    std::vector<ui32> ind(indices.begin(), indices.end());
+    auto c = clusters::agrupar(vertices.data(), vertices.size(), 3, ind.data(), ind.size());
+    return paquete::malla(vertices.data(), vertices.size(), ind.data(), ind.size(), tipo, c.data(), c.size());
+}
+
+const std::map<std::string, Figura> figuras = {
+    { "esfera", [](ui32 n) { auto [v, i] = geometria::esferaOct(std::max(n, 1u)); return malla(v, i); } },
+    { "esfera_area", [](ui32 n) { auto [v, i] = geometria::esfera(geometria::OCTAEDRO_AREA, std::max(n, 1u)); return malla(v, i); } },
+    { "icosfera", [](ui32 n) { auto [v, i] = geometria::esfera(geometria::ICOSAEDRO, std::max(n, 1u)); return malla(v, i); } },
+    { "esfera_cubo", [](ui32 n) { auto [v, i] = geometria::esfera(geometria::CUBO, std::max(n, 1u)); return malla(v, i); } },
+    { "circulo", [](ui32 n) { return malla(geometria::circulo(std::max(n, 3u)), std::vector<ui32>{}, paquete::LINEAS_CONTINUAS); } },
+    { "cubo", [](ui32) { auto [v, i] = geometria::cubo(); return malla(v, i); } },
+    { "plano", [](ui32) { auto [v, i] = geometria::plano(); return malla(v, i); } },
+    { "octaedro", [](ui32) { auto [v, i] = geometria::octaedro(); return malla(v, i); } },
+};
+
+// Leer un archivo completo
+bool leer(const fs::path& ruta, std::vector<ui8>& datos) {
+    std::ifstream in(ruta, std::ios::binary);
+    if (not in.is_open())
+        return false;
+    datos.resize(fs::file_size(ruta));
+    in.read((char*)datos.data(), datos.size());
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string salida = "datos.tofu";
+    std::vector<std::string> entradas;
+    std::vector<paquete::Recurso> recursos;
+
+    // Argumentos
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "-o" and i + 1 < argc) {
+            salida = argv[++i];
+        } else if (a == "-c") {
+            agrupar = true;
+        } else if (a == "-m" and i + 1 < argc) {
+            // nombre=figura[:n]
+            std::string m = argv[++i];
+            size_t igual = m.find('='), dos_puntos = m.find(':');
+            std::string nombre = m.substr(0, igual);
+            std::string figura = igual == std::string::npos ? "" : m.substr(igual + 1, dos_puntos - igual - 1);
+            ui32 n = dos_puntos == std::string::npos ? 0 : std::stoi(m.substr(dos_puntos + 1));
+            auto it = figuras.find(figura);
+            if (it == figuras.end()) {
+                std::cerr << "figura no soportada: " << m << std::endl;
+                return -1;
+            }
+            recursos.push_back({ nombre, paquete::MALLA, it->second(n) });
+        } else {
+            entradas.push_back(a);
+        }
+    }
+    if (entradas.empty() and recursos.empty()) {
+        std::cerr << "uso: tofu-pack [-o salida.tofu] [-c] [-m nombre=esfera:n|icosfera:n|circulo:n|cubo|... ...] carpeta|archivo [...]" << std::endl;
+        return -1;
+    }
+
+    // Archivos, recorriendo las carpetas en orden para que el paquete sea siempre igual
+    std::vector<fs::path> archivos;
+    for (auto& e : entradas) {
+        if (fs::is_directory(e)) {
+            for (auto& f : fs::recursive_directory_iterator(e))
+                if (f.is_regular_file())
+                    archivos.push_back(f.path());
+        } else if (fs::is_regular_file(e)) {
+            archivos.push_back(e);
+        } else {
+            std::cerr << "no existe: " << e << std::endl;
+            return -1;
+        }
+    }
+    std::sort(archivos.begin(), archivos.end());
+
+    for (auto& a : archivos) {
+        paquete::Recurso r { a.lexically_normal().generic_string(), paquete::ARCHIVO, {} };
+        if (not leer(a, r.datos)) {
+            std::cerr << "no se pudo leer el archivo: " << a.string() << std::endl;
+            return -1;
+        }
+        recursos.push_back(std::move(r));
+    }
+
+    // Guardamos el paquete
+    size_t num = recursos.size();
+    auto archivo = paquete::escribir(std::move(recursos));
+    if (archivo.empty()) {
+        std::cerr << "hay recursos con el mismo nombre (o con el mismo hash)" << std::endl;
+        return -1;
+    }
+    std::ofstream out(salida, std::ios::binary);
+    if (not out.is_open()) {
+        std::cerr << "no se pudo escribir el archivo: " << salida << std::endl;
+        return -1;
+    }
+    out.write((const char*)archivo.data(), archivo.size());
+
+    std::cout << salida << ": " << num << " recursos, " << archivo.size() / 1024 << " KiB" << std::endl;
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Oclusión con una pirámide de profundidad (Hi-Z)
+// Un paso del grafo reduce la profundidad del frame a una cadena de niveles en la que cada texel guarda la profundidad
+// más lejana de los que cubre. Las shaders de culling incluyen "tofu/hiz.glsl", proyectan la caja de cada instancia,
+// eligen el nivel en el que ocupa como mucho 2x2 texels y la descartan si su punto más cercano queda detrás de los cuatro
+// La pirámide se usa en el frame siguiente al que se dibujó, así que lo que sale de detrás de otro objeto aparece con un
+// frame de retraso. Solo tapan los objetos que escriben en la profundidad que se reduce
+#pragma once
+
+#include <cmath>
+
+#include "grafo.h"
+
+namespace tofu
+{
+    namespace hiz
+    {
+        namespace detail
+        {
+            // Shader de reducción
+            // Con copiar, el nivel 0 es la profundidad original. Si no, cada texel es el máximo de los 2x2 del nivel anterior,
+            // y si ese nivel tiene un tamaño impar el último texel también cubre la fila o columna que sobra
+            inline const str reduccion_vert = R"(#version 330 core
+void main() {
+    vec2 pos = vec2[3](vec2(-1,-1), vec2(3,-1), vec2(-1, 3))[gl_VertexID];
+    gl_Position = vec4(pos, 0.0, 1.0);
+})";
+            inline const str reduccion_frag = R"(#version 330 core
+uniform sampler2D origen;
+uniform int copiar;
+out float profundidad;
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    if (copiar != 0) {
+        profundidad = texelFetch(origen, p, 0).r;
+        return;
+    }
+    ivec2 tam = textureSize(origen, 0);
+    ivec2 q = p * 2;
+    ivec2 fin = q + 1 + ivec2(equal(q + 2, tam - 1));
+    float d = 0.0;
+    for (int y = q.y; y <= fin.y; y++)
+        for (int x = q.x; x <= fin.x; x++)
+            d = max(d, texelFetch(origen, min(ivec2(x, y), tam - 1), 0).r);
+    profundidad = d;
+})";
+
+            inline glm::ivec2 tamNivel(glm::ivec2 tam, ui32 nivel) {
+                return glm::max(glm::ivec2(tam.x >> nivel, tam.y >> nivel), glm::ivec2(1));
+            }
+
+            inline void liberar() {
+                PiramideProfundidad& h = gl.hiz;
+                if (h.textura >= 0) {
+                    textura::liberarUnidad(h.textura);
+                    textura::detail::olvidar(gl.texturas[h.textura].textura);
+                    glDeleteTextures(1, &gl.texturas[h.textura].textura);
+                    gl.texturas.erase(h.textura);
+                }
+                if (not h.fbos.empty())
+                    glDeleteFramebuffers(h.fbos.size(), h.fbos.data());
+                h = {};
+            }
+
+            // Crear la textura con todos sus niveles y un framebuffer para escribir en cada uno
+            inline void crear(glm::ivec2 tam) {
+                liberar();
+                PiramideProfundidad& h = gl.hiz;
+                h.tam = tam;
+                h.niveles = (ui32)std::floor(std::log2((float)std::max(tam.x, tam.y))) + 1;
+
+                h.textura = textura::crear(GL_TEXTURE_2D, GL_R32F, 0, 0, tam);
+                Textura& t = gl.texturas[h.textura];
+                t.sampler = sampler::obtener(GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST);
+                textura::detail::vincularCarga(t);
+                for (ui32 i = 0; i < h.niveles; i++) {
+                    glm::ivec2 n = tamNivel(tam, i);
+                    glTexImage2D(GL_TEXTURE_2D, i, GL_R32F, n.x, n.y, 0, GL_RED, GL_FLOAT, nullptr);
+                }
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, h.niveles - 1);
+
+                h.fbos.resize(h.niveles);
+                glGenFramebuffers(h.niveles, h.fbos.data());
+                for (ui32 i = 0; i < h.niveles; i++) {
+                    glBindFramebuffer(GL_FRAMEBUFFER, h.fbos[i]);
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t.textura, i);
+                    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                        log::error("No se pudo crear el framebuffer del nivel {} de la pirámide de profundidad", i);
+                        std::exit(-1);
+                    }
+                }
+                debug::gl();
+                log::info("Pirámide de profundidad de {}x{} con {} niveles", tam.x, tam.y, h.niveles);
+            }
+
+            // Reducir la profundidad a la pirámide, nivel a nivel
+            inline void construir(const str& profundidad) {
+                PiramideProfundidad& h = gl.hiz;
+                glm::ivec2 tam = gl.texturas[gl.grafo.recursos.at(profundidad).textura].tam;
+                if (tam != h.tam)
+                    crear(tam);
+                Textura& t = gl.texturas[h.textura];
+
+                shader::usar("tofu_hiz"_id);
+                for (ui32 i = 0; i < h.niveles; i++) {
+                    glm::ivec2 n = tamNivel(tam, i);
+                    glBindFramebuffer(GL_FRAMEBUFFER, h.fbos[i]);
+                    glViewport(0, 0, n.x, n.y);
+
+                    if (i == 0) {
+                        shader::uniform("origen"_id, grafo::vincular(profundidad));
+                        shader::uniform("copiar"_id, 1);
+                    } else {
+                        // Solo se puede leer el nivel anterior, así no se lee y escribe a la vez el mismo nivel
+                        textura::detail::vincularCarga(t);
+                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, i - 1);
+                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, i - 1);
+                        shader::uniform("origen"_id, textura::vincular(h.textura));
+                        shader::uniform("copiar"_id, 0);
+                    }
+                    glDrawArrays(GL_TRIANGLES, 0, 3);
+                }
+
+                textura::detail::vincularCarga(t);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, h.niveles - 1);
+
+                h.viewproj = gl.proj * gl.view;
+                h.ejecucion = gl.grafo.ejecuciones;
+                debug::gl();
+            }
+        }
+
+        // Añadir al grafo el paso que construye la pirámide a partir de un recurso de profundidad
+        // No escribe en ningún recurso, así que el grafo lo ejecuta siempre que alguien produzca la profundidad
+        inline void paso(str profundidad, std::function<bool()> activo = nullptr) {
+            if (not gl.VAOs.count("tofu_vacio"_id))
+                buffer::iniciarVAO({}, "tofu_vacio"_id);
+            if (not gl.shaders.count("tofu_hiz"_id))
+                shader::cargarFuente("tofu_hiz"_id, detail::reduccion_vert, detail::reduccion_frag, "tofu_vacio"_id, 0, { .blend = false, .depth = false, .cull = false });
+
+            grafo::paso("hiz", { profundidad }, {}, [profundidad](){
+                detail::construir(profundidad);
+            }, activo);
+        }
+
+        // La pirámide es válida si se construyó en la última ejecución del grafo
+        // Si el paso se ha saltado (por ejemplo, porque no se ha dibujado la profundidad) no se debe descartar nada
+        inline bool valida() {
+            return gl.hiz.textura >= 0 and gl.hiz.ejecucion == gl.grafo.ejecuciones;
+        }
+
+        // Pasar la pirámide a la shader actual (uniforms de "tofu/hiz.glsl")
+        // Sin una pirámide válida se pasan 0 niveles y la shader no descarta nada
+        inline void uniforms() {
+            bool v = valida();
+            shader::uniform("tofu_hiz_niveles"_id, v ? (int)gl.hiz.niveles : 0);
+            if (not v)
+                return;
+            shader::uniform("tofu_hiz"_id, textura::vincular(gl.hiz.textura));
+            shader::uniform("tofu_hiz_viewproj"_id, gl.hiz.viewproj);
+        }
+    }
+}
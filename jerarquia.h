@@ -0,0 +1,108 @@
+// Jerarquía de transformaciones aplanada
+// Los nodos se guardan en arrays separados (SoA) en orden topológico: cada padre va antes que sus hijos, así las
+// matrices del mundo se calculan en una sola pasada lineal sin recorrer la cadena de padres de cada nodo
+// Solo se recalculan los nodos cuya transformación local, o la de alguno de sus antecesores, ha cambiado, y se apuntan
+// los rangos que han cambiado para subir solo esos trozos al buffer de la GPU
+#pragma once
+
+#include "buffers.h"
+
+namespace tofu
+{
+    struct Jerarquia {
+        std::vector<int> padre;             // Índice del padre, siempre menor que el del hijo (-1 en las raíces)
+        std::vector<glm::mat4> local;       // Transformación respecto al padre
+        std::vector<glm::mat4> mundo;       // Transformación final
+        std::vector<ui8> sucio;             // La transformación local ha cambiado desde la última actualización
+        std::vector<glm::uvec2> cambios;    // Rangos (inicio y número) de mundo que han cambiado y no se han subido
+    };
+
+    namespace jerarquia
+    {
+        namespace detail
+        {
+            // Solo se junta con los rangos de esta pasada (desde primero), los anteriores ya tienen sus nodos limpios
+            inline void apuntar(std::vector<glm::uvec2>& cambios, ui32 primero, ui32 i) {
+                if (cambios.size() > primero and cambios.back().x + cambios.back().y == i)
+                    cambios.back().y++;
+                else
+                    cambios.push_back(glm::uvec2(i, 1));
+            }
+        }
+
+        // Añadir un nodo, que tiene que ir después de su padre
+        // Devuelve su índice, que es también su posición en el buffer de la GPU
+        inline ui32 insertar(Jerarquia& j, int padre, const glm::mat4& local = glm::mat4(1.f)) {
+            ui32 id = j.padre.size();
+            if (padre >= (int)id) {
+                log::error("El padre de un nodo de la jerarquía tiene que insertarse antes ({} no es menor que {})", padre, id);
+                std::exit(-1);
+            }
+            j.padre.push_back(padre);
+            j.local.push_back(local);
+            j.mundo.push_back(glm::mat4(1.f));
+            j.sucio.push_back(true);
+            return id;
+        }
+
+        // Cambiar la transformación local de un nodo
+        // Si es igual a la que tenía no se marca, así se puede llamar cada frame con todos los nodos
+        inline void cambiar(Jerarquia& j, ui32 nodo, const glm::mat4& local) {
+            if (j.local[nodo] == local)
+                return;
+            j.local[nodo] = local;
+            j.sucio[nodo] = true;
+        }
+
+        // Recalcular las matrices del mundo de los nodos marcados y de sus descendientes
+        // Como los padres van antes, al llegar a un nodo ya se sabe si el suyo ha cambiado en esta pasada
+        inline void actualizar(Jerarquia& j) {
+            ui32 n = j.padre.size();
+            ui32 primero = j.cambios.size();
+            for (ui32 i = 0; i < n; i++) {
+                int p = j.padre[i];
+                if (p >= 0 and j.sucio[p])
+                    j.sucio[i] = true;
+                if (not j.sucio[i])
+                    continue;
+                j.mundo[i] = p >= 0 ? j.mundo[p] * j.local[i] : j.local[i];
+                detail::apuntar(j.cambios, primero, i);
+            }
+
+            // Solo se limpian los que han cambiado en esta pasada
+            for (ui32 c = primero; c < j.cambios.size(); c++)
+                std::fill_n(j.sucio.begin() + j.cambios[c].x, j.cambios[c].y, 0);
+        }
+
+        // Subir al buffer los nodos [ini, ini + num) que han cambiado, a partir de la posición pos del buffer
+        // Sirve para subir solo una parte de la jerarquía (por ejemplo, sin los nodos intermedios que no se dibujan)
+        // Solo se quitan de los cambios los nodos subidos, así se pueden subir otras partes a otros buffers
+        inline void subir(Jerarquia& j, ui32 buffer, ui32 ini, ui32 num, ui32 pos = 0) {
+            ui32 fin = ini + num;
+            std::vector<glm::uvec2> quedan;
+            for (const glm::uvec2& c : j.cambios) {
+                ui32 a = std::max(c.x, ini), b = std::min(c.x + c.y, fin);
+                if (a >= b) {
+                    quedan.push_back(c);
+                    continue;
+                }
+                buffer::cargar(buffer, j.mundo.data() + a, b - a, pos + a - ini);
+                if (c.x < a)
+                    quedan.push_back(glm::uvec2(c.x, a - c.x));
+                if (b < c.x + c.y)
+                    quedan.push_back(glm::uvec2(b, c.x + c.y - b));
+            }
+            j.cambios = std::move(quedan);
+        }
+
+        inline void subir(Jerarquia& j, ui32 buffer) {
+            subir(j, buffer, 0, j.padre.size());
+        }
+
+        // Olvidar los cambios que quedan sin subir (los de los nodos que no se usan en la GPU)
+        // Si no, se acumulan en cada actualización
+        inline void descartar(Jerarquia& j) {
+            j.cambios.clear();
+        }
+    }
+}
@@ -0,0 +1,336 @@
+// Contenedor de texturas KTX 1.1 y formatos comprimidos por bloques
+// No depende de OpenGL para poder utilizarlo también desde herramientas externas (tofu-bake)
+// https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace tofu
+{
+    using ui32 = std::uint32_t;
+    using ui16 = std::uint16_t;
+    using ui8 = std::uint8_t;
+
+    namespace ktx
+    {
+        // Formatos internos soportados (mismos valores que los enums de OpenGL)
+        constexpr ui32 RGBA8 = 0x8058; // GL_RGBA8
+        constexpr ui32 BC1 = 0x83F1;   // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        constexpr ui32 BC3 = 0x83F3;   // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+        constexpr ui32 BC4 = 0x8DBB;   // GL_COMPRESSED_RED_RGTC1
+        constexpr ui32 BC5 = 0x8DBD;   // GL_COMPRESSED_RG_RGTC2
+        constexpr ui32 BC7 = 0x8E8C;   // GL_COMPRESSED_RGBA_BPTC_UNORM_ARB
+
+        constexpr ui32 FORMATO_RGBA = 0x1908;   // GL_RGBA
+        constexpr ui32 TIPO_UBYTE = 0x1401;     // GL_UNSIGNED_BYTE
+
+        // Clave con los nombres de las capas de un array, separados por saltos de línea
+        // La escribe tofu-bake con las imágenes de entrada, para poder comprobar el orden al cargarlo
+        constexpr const char* clave_capas = "tofu.capas";
+
+        constexpr std::array<ui8, 12> identificador = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+        struct Cabecera {
+            ui8 identificador[12];
+            ui32 endianness;
+            ui32 gl_type, gl_type_size, gl_format;
+            ui32 gl_internal_format, gl_base_internal_format;
+            ui32 ancho, alto, profundidad;
+            ui32 capas, caras, niveles;
+            ui32 bytes_kv;
+        };
+        static_assert(sizeof(Cabecera) == 64, "La cabecera KTX tiene que ocupar 64 bytes");
+
+        // Nivel de mipmap (contiene todas las capas seguidas)
+        struct Nivel {
+            ui32 ancho, alto;
+            ui32 bytes_capa;
+            const ui8* datos;
+        };
+
+        // Bytes de un bloque de 4x4 píxeles (0 si no es un formato por bloques)
+        inline ui32 bytesBloque(ui32 formato) {
+            switch (formato) {
+                case BC1: case BC4: return 8;
+                case BC3: case BC5: case BC7: return 16;
+                default: return 0;
+            }
+        }
+
+        // Bytes que ocupa una capa de un nivel
+        inline ui32 bytesNivel(ui32 formato, ui32 w, ui32 h) {
+            ui32 b = bytesBloque(formato);
+            if (b == 0)
+                return w * h * 4;
+            return ((w + 3) / 4) * ((h + 3) / 4) * b;
+        }
+
+        // Número de niveles de una cadena de mipmaps completa
+        inline ui32 numNiveles(ui32 w, ui32 h) {
+            ui32 n = 1;
+            while (w > 1 or h > 1) {
+                w = std::max(w / 2, 1u);
+                h = std::max(h / 2, 1u);
+                n++;
+            }
+            return n;
+        }
+
+        // Interpretar un archivo KTX en memoria
+        // Los niveles apuntan directamente a los datos del archivo, no se copian
+        inline bool leer(const ui8* archivo, size_t tam_archivo, Cabecera& cab, std::vector<Nivel>& niveles) {
+            if (tam_archivo < sizeof(Cabecera))
+                return false;
+            std::memcpy(&cab, archivo, sizeof(Cabecera));
+            if (std::memcmp(cab.identificador, identificador.data(), identificador.size()) != 0)
+                return false;
+            if (cab.endianness != 0x04030201 or cab.caras > 1 or cab.profundidad > 1)
+                return false;
+
+            size_t pos = sizeof(Cabecera) + cab.bytes_kv;
+            ui32 w = cab.ancho, h = std::max(cab.alto, 1u);
+            ui32 capas = std::max(cab.capas, 1u);
+            ui32 formato = cab.gl_type == 0 ? cab.gl_internal_format : RGBA8;
+
+            niveles.clear();
+            for (ui32 i = 0; i < std::max(cab.niveles, 1u); i++) {
+                if (pos + 4 > tam_archivo)
+                    return false;
+                ui32 tam;
+                std::memcpy(&tam, archivo + pos, 4);
+                pos += 4;
+
+                ui32 bytes_capa = bytesNivel(formato, w, h);
+                if (tam != bytes_capa * capas or pos + tam > tam_archivo)
+                    return false;
+                niveles.push_back({ w, h, bytes_capa, archivo + pos });
+
+                pos += (tam + 3) & ~3u;
+                w = std::max(w / 2, 1u);
+                h = std::max(h / 2, 1u);
+            }
+            return true;
+        }
+
+        inline bool leer(const std::vector<ui8>& archivo, Cabecera& cab, std::vector<Nivel>& niveles) {
+            return leer(archivo.data(), archivo.size(), cab, niveles);
+        }
+
+        // Buscar el valor de una clave en los datos clave/valor de un archivo KTX
+        // Devuelve una cadena vacía si no está
+        inline std::string valor(const ui8* archivo, size_t tam_archivo, const std::string& clave) {
+            if (tam_archivo < sizeof(Cabecera))
+                return "";
+            Cabecera cab;
+            std::memcpy(&cab, archivo, sizeof(Cabecera));
+            size_t pos = sizeof(Cabecera), fin = std::min(pos + cab.bytes_kv, tam_archivo);
+            while (pos + 4 <= fin) {
+                ui32 tam;
+                std::memcpy(&tam, archivo + pos, 4);
+                pos += 4;
+                if (pos + tam > fin)
+                    return "";
+                const char* kv = (const char*)archivo + pos;
+                size_t largo_clave = std::find(kv, kv + tam, '\0') - kv;
+                if (largo_clave < tam and clave.compare(0, std::string::npos, kv, largo_clave) == 0) {
+                    std::string v(kv + largo_clave + 1, tam - largo_clave - 1);
+                    while (not v.empty() and v.back() == '\0')
+                        v.pop_back();
+                    return v;
+                }
+                pos += (tam + 3) & ~3u;
+            }
+            return "";
+        }
+
+        // Nombres de las capas guardados por tofu-bake (vacío si el archivo no los tiene)
+        inline std::vector<std::string> capas(const ui8* archivo, size_t tam_archivo) {
+            std::vector<std::string> nombres;
+            std::string v = valor(archivo, tam_archivo, clave_capas);
+            for (size_t ini = 0; ini < v.size();) {
+                size_t fin = std::min(v.find('\n', ini), v.size());
+                nombres.push_back(v.substr(ini, fin - ini));
+                ini = fin + 1;
+            }
+            return nombres;
+        }
+
+        // Escribir un archivo KTX (todos los niveles con todas sus capas)
+        // Los pares clave/valor se guardan como texto terminado en \0
+        inline std::vector<ui8> escribir(ui32 formato, ui32 w, ui32 h, ui32 capas, const std::vector<std::vector<ui8>>& niveles,
+                                         const std::vector<std::pair<std::string, std::string>>& claves = {}) {
+            bool comprimido = bytesBloque(formato) > 0;
+            Cabecera cab {};
+            std::memcpy(cab.identificador, identificador.data(), identificador.size());
+            cab.endianness = 0x04030201;
+            cab.gl_type = comprimido ? 0 : TIPO_UBYTE;
+            cab.gl_type_size = 1;
+            cab.gl_format = comprimido ? 0 : FORMATO_RGBA;
+            cab.gl_internal_format = formato;
+            cab.gl_base_internal_format = FORMATO_RGBA;
+            cab.ancho = w;
+            cab.alto = h;
+            cab.capas = capas > 1 ? capas : 0;
+            cab.caras = 1;
+            cab.niveles = niveles.size();
+
+            std::vector<ui8> archivo(sizeof(Cabecera));
+            for (auto& [k, v] : claves) {
+                ui32 tam = k.size() + v.size() + 2;
+                archivo.insert(archivo.end(), (ui8*)&tam, (ui8*)&tam + 4);
+                archivo.insert(archivo.end(), k.begin(), k.end());
+                archivo.push_back(0);
+                archivo.insert(archivo.end(), v.begin(), v.end());
+                archivo.push_back(0);
+                archivo.resize((archivo.size() + 3) & ~size_t(3), 0);
+            }
+            cab.bytes_kv = archivo.size() - sizeof(Cabecera);
+            std::memcpy(archivo.data(), &cab, sizeof(Cabecera));
+            for (auto& n : niveles) {
+                ui32 tam = n.size();
+                archivo.insert(archivo.end(), (ui8*)&tam, (ui8*)&tam + 4);
+                archivo.insert(archivo.end(), n.begin(), n.end());
+                archivo.resize((archivo.size() + 3) & ~size_t(3), 0);
+            }
+            return archivo;
+        }
+
+        // ---
+
+        // Decodificadores por bloques
+        // Se utilizan cuando la GPU no soporta el formato comprimido y hay que subir la textura en RGBA8
+        namespace detail
+        {
+            inline void color565(ui16 c, ui8* rgb) {
+                ui8 r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+                rgb[0] = (r << 3) | (r >> 2);
+                rgb[1] = (g << 2) | (g >> 4);
+                rgb[2] = (b << 3) | (b >> 2);
+            }
+
+            // Bloque de color de BC1/BC3 (8 bytes)
+            inline void bloqueColor(const ui8* b, ui8* rgba, bool bc1) {
+                ui16 c0 = b[0] | (b[1] << 8), c1 = b[2] | (b[3] << 8);
+                ui8 paleta[4][4];
+                color565(c0, paleta[0]);
+                color565(c1, paleta[1]);
+                paleta[0][3] = paleta[1][3] = paleta[2][3] = paleta[3][3] = 255;
+                for (int k = 0; k < 3; k++) {
+                    if (c0 > c1 or not bc1) {
+                        paleta[2][k] = (2 * paleta[0][k] + paleta[1][k]) / 3;
+                        paleta[3][k] = (paleta[0][k] + 2 * paleta[1][k]) / 3;
+                    } else {
+                        paleta[2][k] = (paleta[0][k] + paleta[1][k]) / 2;
+                        paleta[3][k] = 0;
+                    }
+                }
+                if (c0 <= c1 and bc1)
+                    paleta[3][3] = 0;
+
+                ui32 ind = b[4] | (b[5] << 8) | (b[6] << 16) | ((ui32)b[7] << 24);
+                for (int i = 0; i < 16; i++)
+                    std::memcpy(rgba + i * 4, paleta[(ind >> (2 * i)) & 3], 4);
+            }
+
+            // Bloque de un canal de BC3/BC4/BC5 (8 bytes)
+            inline void bloqueCanal(const ui8* b, ui8* rgba, int canal) {
+                ui8 v[8];
+                v[0] = b[0];
+                v[1] = b[1];
+                if (v[0] > v[1]) {
+                    for (int i = 1; i < 7; i++)
+                        v[i + 1] = ((7 - i) * v[0] + i * v[1]) / 7;
+                } else {
+                    for (int i = 1; i < 5; i++)
+                        v[i + 1] = ((5 - i) * v[0] + i * v[1]) / 5;
+                    v[6] = 0;
+                    v[7] = 255;
+                }
+
+                uint64_t ind = 0;
+                for (int i = 0; i < 6; i++)
+                    ind |= (uint64_t)b[2 + i] << (8 * i);
+                for (int i = 0; i < 16; i++)
+                    rgba[i * 4 + canal] = v[(ind >> (3 * i)) & 7];
+            }
+
+            // Lector de bits (de menor a mayor)
+            struct Bits {
+                const ui8* b;
+                ui32 pos = 0;
+                ui32 leer(ui32 n) {
+                    ui32 v = 0;
+                    for (ui32 i = 0; i < n; i++, pos++)
+                        v |= ((b[pos / 8] >> (pos % 8)) & 1) << i;
+                    return v;
+                }
+            };
+
+            constexpr std::array<ui32, 16> pesos_bc7 = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+            // Bloque BC7 (16 bytes)
+            // Solo decodificamos el modo 6 (una partición, RGBA, índices de 4 bits), que es el que genera tofu-bake
+            inline bool bloqueBC7(const ui8* b, ui8* rgba) {
+                Bits bits { b };
+                if (bits.leer(7) != 0x40)
+                    return false;
+
+                ui32 e[2][4];
+                for (int k = 0; k < 4; k++)
+                    for (int j = 0; j < 2; j++)
+                        e[j][k] = bits.leer(7) << 1;
+                for (int j = 0; j < 2; j++) {
+                    ui32 p = bits.leer(1);
+                    for (int k = 0; k < 4; k++)
+                        e[j][k] |= p;
+                }
+
+                for (int i = 0; i < 16; i++) {
+                    ui32 w = pesos_bc7[bits.leer(i == 0 ? 3 : 4)];
+                    for (int k = 0; k < 4; k++)
+                        rgba[i * 4 + k] = ((64 - w) * e[0][k] + w * e[1][k] + 32) >> 6;
+                }
+                return true;
+            }
+        }
+
+        // Decodificar una capa de un nivel a RGBA8
+        inline bool decodificar(ui32 formato, ui32 w, ui32 h, const ui8* datos, ui8* salida) {
+            ui32 bytes = bytesBloque(formato);
+            ui32 bw = (w + 3) / 4, bh = (h + 3) / 4;
+
+            ui8 bloque[64];
+            for (ui32 by = 0; by < bh; by++) {
+                for (ui32 bx = 0; bx < bw; bx++) {
+                    const ui8* b = datos + (by * bw + bx) * bytes;
+                    std::fill(bloque, bloque + 64, 255);
+
+                    switch (formato) {
+                        case BC1: detail::bloqueColor(b, bloque, true); break;
+                        case BC3: detail::bloqueColor(b + 8, bloque, false); detail::bloqueCanal(b, bloque, 3); break;
+                        case BC4: detail::bloqueCanal(b, bloque, 0); break;
+                        case BC5: detail::bloqueCanal(b, bloque, 0); detail::bloqueCanal(b + 8, bloque, 1); break;
+                        case BC7: if (not detail::bloqueBC7(b, bloque)) return false; break;
+                        default: return false;
+                    }
+                    if (formato == BC4 or formato == BC5)
+                        for (int i = 0; i < 16; i++) {
+                            bloque[i * 4 + 2] = 0;
+                            if (formato == BC4) bloque[i * 4 + 1] = 0;
+                        }
+
+                    // Copiamos los píxeles que caen dentro de la imagen
+                    for (ui32 y = 0; y < 4 and by * 4 + y < h; y++)
+                        for (ui32 x = 0; x < 4 and bx * 4 + x < w; x++)
+                            std::memcpy(salida + ((by * 4 + y) * w + bx * 4 + x) * 4, bloque + (y * 4 + x) * 4, 4);
+                }
+            }
+            return true;
+        }
+    }
+}
@@ -0,0 +1,588 @@
+// Carga de modelos (OBJ y glTF binario)
+// El archivo se mapea en memoria (o se lee directamente del paquete) y se interpreta sin copiarlo
+// Los OBJ se dividen en trozos por líneas que se procesan en paralelo, y después se eliminan los vértices repetidos
+// El resultado se escribe directamente en los buffers del VAO con buffer::generarVert
+#pragma once
+
+#include <thread>
+#include <array>
+
+#include "debug.h"
+#include "archivos.h"
+#include "buffers.h"
+
+namespace tofu
+{
+    namespace modelo
+    {
+        // Vértice completo, antes de adaptarlo a los atributos del VAO
+        struct Vertice {
+            glm::vec3 pos = glm::vec3(0.f);
+            glm::vec3 normal = glm::vec3(0.f);
+            glm::vec2 uv = glm::vec2(0.f);
+        };
+
+        struct Malla {
+            std::vector<Vertice> vertices;
+            std::vector<ui32> indices;
+            bool normales = false, uvs = false;
+        };
+
+        namespace detail
+        {
+            // ---
+            // Lectura de texto
+
+            inline const char* saltarEspacios(const char* p, const char* fin) {
+                while (p < fin and (*p == ' ' or *p == '\t' or *p == '\r'))
+                    p++;
+                return p;
+            }
+
+            inline const char* siguienteLinea(const char* p, const char* fin) {
+                const char* n = (const char*)std::memchr(p, '\n', fin - p);
+                return n ? n + 1 : fin;
+            }
+
+            // Más rápido que strtod, no depende del locale y no necesita que el texto termine en \0
+            // Los enteros son exactos hasta 2^53, así que sirve para los offsets y tamaños de glTF grandes
+            inline const char* leerDouble(const char* p, const char* fin, double& out) {
+                p = saltarEspacios(p, fin);
+                bool negativo = p < fin and *p == '-';
+                if (p < fin and (*p == '-' or *p == '+'))
+                    p++;
+
+                double v = 0.0;
+                while (p < fin and *p >= '0' and *p <= '9')
+                    v = v * 10.0 + (*p++ - '0');
+                if (p < fin and *p == '.') {
+                    double f = 0.1;
+                    for (p++; p < fin and *p >= '0' and *p <= '9'; p++, f *= 0.1)
+                        v += (*p - '0') * f;
+                }
+                if (p < fin and (*p == 'e' or *p == 'E')) {
+                    p++;
+                    bool exp_negativo = p < fin and *p == '-';
+                    if (p < fin and (*p == '-' or *p == '+'))
+                        p++;
+                    int e = 0;
+                    while (p < fin and *p >= '0' and *p <= '9')
+                        e = e * 10 + (*p++ - '0');
+                    v *= std::pow(10.0, exp_negativo ? -e : e);
+                }
+
+                out = negativo ? -v : v;
+                return p;
+            }
+
+            inline const char* leerFloat(const char* p, const char* fin, float& out) {
+                double v;
+                p = leerDouble(p, fin, v);
+                out = (float)v;
+                return p;
+            }
+
+            inline const char* leerEntero(const char* p, const char* fin, long long& out) {
+                bool negativo = p < fin and *p == '-';
+                if (p < fin and (*p == '-' or *p == '+'))
+                    p++;
+                long long v = 0;
+                while (p < fin and *p >= '0' and *p <= '9')
+                    v = v * 10 + (*p++ - '0');
+                out = negativo ? -v : v;
+                return p;
+            }
+
+            // ---
+            // OBJ
+
+            constexpr ui32 sin_indice = (ui32)-1;
+
+            // Trozo del archivo procesado por un hilo
+            // Los índices de las caras ya son globales, ya que antes se cuenta cuántos elementos hay en cada trozo
+            struct TrozoObj {
+                const char *ini, *fin;
+                ui64 num_pos = 0, num_uv = 0, num_normal = 0;       // Elementos en el trozo
+                ui64 off_pos = 0, off_uv = 0, off_normal = 0;       // Elementos en los trozos anteriores
+                std::vector<std::array<ui32, 3>> esquinas;          // Posición, uv y normal de cada esquina
+                std::vector<ui32> caras;                            // Número de esquinas de cada cara
+            };
+
+            // Primera pasada: contar los elementos de cada tipo para saber dónde va a escribir cada trozo
+            inline void contarObj(TrozoObj& t) {
+                for (const char* p = t.ini; p < t.fin; p = siguienteLinea(p, t.fin)) {
+                    p = saltarEspacios(p, t.fin);
+                    if (t.fin - p < 2 or p[0] != 'v')
+                        continue;
+                    if (p[1] == ' ' or p[1] == '\t') t.num_pos++;
+                    else if (p[1] == 't') t.num_uv++;
+                    else if (p[1] == 'n') t.num_normal++;
+                }
+            }
+
+            // Segunda pasada: leer los elementos en su posición final y las caras
+            // Los índices negativos del OBJ son relativos al último elemento leído
+            inline void leerObj(TrozoObj& t, std::vector<glm::vec3>& pos, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normales) {
+                ui64 ip = t.off_pos, iu = t.off_uv, in = t.off_normal;
+                auto indice = [](long long i, ui64 actual, ui64 total) -> ui32 {
+                    if (i == 0)
+                        return sin_indice;
+                    long long r = i > 0 ? i - 1 : (long long)actual + i;
+                    return r >= 0 and (ui64)r < total ? (ui32)r : sin_indice;
+                };
+
+                for (const char* p = t.ini; p < t.fin; p = siguienteLinea(p, t.fin)) {
+                    p = saltarEspacios(p, t.fin);
+                    if (t.fin - p < 2)
+                        continue;
+
+                    if (p[0] == 'v') {
+                        float* v = nullptr;
+                        ui32 n = 0;
+                        if (p[1] == ' ' or p[1] == '\t') { v = &pos[ip++].x; n = 3; p += 1; }
+                        else if (p[1] == 't') { v = &uvs[iu++].x; n = 2; p += 2; }
+                        else if (p[1] == 'n') { v = &normales[in++].x; n = 3; p += 2; }
+                        for (ui32 i = 0; i < n; i++)
+                            p = leerFloat(p, t.fin, v[i]);
+                    }
+                    else if (p[0] == 'f' and (p[1] == ' ' or p[1] == '\t')) {
+                        ui32 esquinas = 0;
+                        for (p += 1; ; esquinas++) {
+                            p = saltarEspacios(p, t.fin);
+                            if (p >= t.fin or *p == '\n' or *p == '#')
+                                break;
+
+                            std::array<ui32, 3> e = { sin_indice, sin_indice, sin_indice };
+                            long long i = 0;
+                            p = leerEntero(p, t.fin, i);
+                            e[0] = indice(i, ip, pos.size());
+                            if (p < t.fin and *p == '/') {
+                                p++;
+                                if (p < t.fin and *p != '/') {
+                                    p = leerEntero(p, t.fin, i);
+                                    e[1] = indice(i, iu, uvs.size());
+                                }
+                                if (p < t.fin and *p == '/') {
+                                    p = leerEntero(p + 1, t.fin, i);
+                                    e[2] = indice(i, in, normales.size());
+                                }
+                            }
+                            if (e[0] == sin_indice)
+                                break;
+                            t.esquinas.push_back(e);
+                            while (p < t.fin and *p != ' ' and *p != '\t' and *p != '\r' and *p != '\n')
+                                p++;
+                        }
+                        if (esquinas > 0)
+                            t.caras.push_back(esquinas);
+                    }
+                }
+            }
+
+            struct HashEsquina {
+                size_t operator()(const std::array<ui32, 3>& e) const {
+                    ui64 h = (ui64)e[0] * 0x9E3779B97F4A7C15ULL;
+                    h ^= (ui64)e[1] * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+                    h ^= (ui64)e[2] * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+                    return h;
+                }
+            };
+
+            inline Malla obj(const ui8* datos, size_t tam) {
+                const char* ini = (const char*)datos;
+                const char* fin = ini + tam;
+
+                // Dividimos el archivo en trozos de al menos 1 MiB, cortando siempre al final de una línea
+                #ifdef EMSCRIPTEN
+                ui32 num_hilos = 1;
+                #else
+                ui32 num_hilos = std::clamp<ui32>(tam >> 20, 1, std::max(1u, std::thread::hardware_concurrency()));
+                #endif
+                std::vector<TrozoObj> trozos(num_hilos);
+                const char* p = ini;
+                for (ui32 i = 0; i < num_hilos; i++) {
+                    trozos[i].ini = p;
+                    p = i + 1 == num_hilos ? fin : siguienteLinea(std::max(p, ini + tam * (i + 1) / num_hilos), fin);
+                    trozos[i].fin = p;
+                }
+
+                auto paralelo = [&](auto f) {
+                    std::vector<std::thread> hilos;
+                    for (ui32 i = 1; i < num_hilos; i++)
+                        hilos.emplace_back(f, std::ref(trozos[i]));
+                    f(trozos[0]);
+                    for (auto& h : hilos)
+                        h.join();
+                };
+
+                // Contamos y calculamos dónde empieza cada trozo
+                paralelo(contarObj);
+                ui64 num_pos = 0, num_uv = 0, num_normal = 0;
+                for (auto& t : trozos) {
+                    t.off_pos = num_pos; num_pos += t.num_pos;
+                    t.off_uv = num_uv; num_uv += t.num_uv;
+                    t.off_normal = num_normal; num_normal += t.num_normal;
+                }
+
+                // Leemos los datos
+                std::vector<glm::vec3> pos(num_pos), normales(num_normal);
+                std::vector<glm::vec2> uvs(num_uv);
+                paralelo([&](TrozoObj& t) { leerObj(t, pos, uvs, normales); });
+
+                // Eliminamos los vértices repetidos y triangulamos las caras en abanico
+                Malla m;
+                m.uvs = num_uv > 0;
+                m.normales = num_normal > 0;
+                ui64 num_esquinas = 0;
+                for (auto& t : trozos)
+                    num_esquinas += t.esquinas.size();
+                std::unordered_map<std::array<ui32, 3>, ui32, HashEsquina> unicos;
+                unicos.reserve(num_esquinas);
+                m.vertices.reserve(num_esquinas / 2);
+                m.indices.reserve(num_esquinas * 3 / 2);
+
+                auto vertice = [&](const std::array<ui32, 3>& e) {
+                    auto [it, nuevo] = unicos.try_emplace(e, (ui32)m.vertices.size());
+                    if (nuevo) {
+                        Vertice v;
+                        v.pos = pos[e[0]];
+                        if (e[1] != sin_indice) v.uv = uvs[e[1]];
+                        if (e[2] != sin_indice) v.normal = normales[e[2]];
+                        else m.normales = false;
+                        m.vertices.push_back(v);
+                    }
+                    return it->second;
+                };
+
+                for (auto& t : trozos) {
+                    const std::array<ui32, 3>* e = t.esquinas.data();
+                    for (ui32 n : t.caras) {
+                        ui32 a = vertice(e[0]);
+                        for (ui32 i = 2; i < n; i++) {
+                            m.indices.push_back(a);
+                            m.indices.push_back(vertice(e[i - 1]));
+                            m.indices.push_back(vertice(e[i]));
+                        }
+                        e += n;
+                    }
+                }
+                return m;
+            }
+
+            // ---
+            // JSON (solo lo necesario para la cabecera de glTF)
+
+            struct Json {
+                enum Tipo { NULO, BOOLEANO, NUMERO, TEXTO, LISTA, OBJETO } tipo = NULO;
+                double numero = 0.0;
+                str texto;
+                std::vector<Json> lista;
+                std::vector<std::pair<str, Json>> objeto;
+
+                const Json* buscar(const str& clave) const {
+                    for (auto& [k, v] : objeto)
+                        if (k == clave)
+                            return &v;
+                    return nullptr;
+                }
+
+                const Json& operator[](const str& clave) const {
+                    static const Json nulo;
+                    const Json* v = buscar(clave);
+                    return v ? *v : nulo;
+                }
+
+                const Json& operator[](size_t i) const {
+                    static const Json nulo;
+                    return i < lista.size() ? lista[i] : nulo;
+                }
+
+                double num(double defecto = 0.0) const { return tipo == NUMERO ? numero : defecto; }
+            };
+
+            inline const char* leerJson(const char* p, const char* fin, Json& j);
+
+            inline const char* leerTextoJson(const char* p, const char* fin, str& s) {
+                for (p++; p < fin and *p != '"'; p++) {
+                    if (*p == '\\' and p + 1 < fin) {
+                        p++;
+                        switch (*p) {
+                            case 'n': s += '\n'; break;
+                            case 't': s += '\t'; break;
+                            case 'u': s += '?'; p = std::min(p + 4, fin - 1); break;    // Los nombres no nos interesan
+                            default: s += *p;
+                        }
+                    } else {
+                        s += *p;
+                    }
+                }
+                return p + 1;
+            }
+
+            inline const char* saltarEspaciosJson(const char* p, const char* fin) {
+                while (p < fin and (*p == ' ' or *p == '\t' or *p == '\r' or *p == '\n' or *p == ','))
+                    p++;
+                return p;
+            }
+
+            inline const char* leerJson(const char* p, const char* fin, Json& j) {
+                p = saltarEspaciosJson(p, fin);
+                if (p >= fin)
+                    return fin;
+
+                if (*p == '{') {
+                    j.tipo = Json::OBJETO;
+                    for (p = saltarEspaciosJson(p + 1, fin); p < fin and *p != '}'; p = saltarEspaciosJson(p, fin)) {
+                        if (*p != '"')
+                            return fin;
+                        auto& [k, v] = j.objeto.emplace_back();
+                        p = saltarEspaciosJson(leerTextoJson(p, fin, k), fin);
+                        if (p >= fin or *p != ':')
+                            return fin;
+                        p = leerJson(p + 1, fin, v);
+                    }
+                    return p + 1;
+                }
+                if (*p == '[') {
+                    j.tipo = Json::LISTA;
+                    for (p = saltarEspaciosJson(p + 1, fin); p < fin and *p != ']'; p = saltarEspaciosJson(p, fin))
+                        p = leerJson(p, fin, j.lista.emplace_back());
+                    return p + 1;
+                }
+                if (*p == '"') {
+                    j.tipo = Json::TEXTO;
+                    return leerTextoJson(p, fin, j.texto);
+                }
+                if (*p == 't' or *p == 'f') {
+                    j.tipo = Json::BOOLEANO;
+                    j.numero = *p == 't';
+                    return p + (*p == 't' ? 4 : 5);
+                }
+                if (*p == 'n')
+                    return p + 4;
+
+                j.tipo = Json::NUMERO;
+                return leerDouble(p, fin, j.numero);
+            }
+
+            // ---
+            // glTF binario (.glb)
+
+            constexpr ui32 glb_magia = 0x46546C67;     // "glTF"
+            constexpr ui32 glb_json = 0x4E4F534A;      // "JSON"
+            constexpr ui32 glb_bin = 0x004E4942;       // "BIN\0"
+
+            // Vista de los datos de un accessor dentro del bloque binario
+            struct Accessor {
+                const ui8* datos = nullptr;
+                ui32 num = 0, stride = 0, componentes = 0, tipo = 0;
+                bool ok = false;
+            };
+
+            inline Accessor accessor(const Json& gltf, const Json& indice, const ui8* bin, ui64 tam_bin) {
+                Accessor a;
+                if (indice.tipo != Json::NUMERO)
+                    return a;
+                const Json& acc = gltf["accessors"][(size_t)indice.numero];
+                const Json& vista = gltf["bufferViews"][(size_t)acc["bufferView"].num(-1)];
+                if (vista.tipo != Json::OBJETO or vista["buffer"].num() != 0)
+                    return a;
+
+                static const std::unordered_map<str, ui32> componentes = { {"SCALAR", 1}, {"VEC2", 2}, {"VEC3", 3}, {"VEC4", 4} };
+                auto c = componentes.find(acc["type"].texto);
+                if (c == componentes.end())
+                    return a;
+                a.componentes = c->second;
+                a.tipo = (ui32)acc["componentType"].num();
+                a.num = (ui32)acc["count"].num();
+
+                ui32 bytes = a.tipo == GL_FLOAT or a.tipo == GL_UNSIGNED_INT ? 4 : a.tipo == GL_UNSIGNED_SHORT ? 2 : 1;
+                a.stride = (ui32)vista["byteStride"].num(bytes * a.componentes);
+                ui64 offset = (ui64)vista["byteOffset"].num() + (ui64)acc["byteOffset"].num();
+                ui64 fin = offset + (a.num > 0 ? (ui64)(a.num - 1) * a.stride + bytes * a.componentes : 0);
+                if (fin > (ui64)vista["byteOffset"].num() + (ui64)vista["byteLength"].num() or fin > tam_bin)
+                    return a;
+                a.datos = bin + offset;
+                a.ok = true;
+                return a;
+            }
+
+            // Los datos del bloque binario no tienen por qué estar alineados
+            inline void copiarFloats(const Accessor& a, ui32 i, float* out, ui32 n) {
+                std::memcpy(out, a.datos + (ui64)i * a.stride, n * sizeof(float));
+            }
+
+            inline ui32 leerIndice(const Accessor& a, ui32 i) {
+                const ui8* p = a.datos + (ui64)i * a.stride;
+                if (a.tipo == GL_UNSIGNED_BYTE) return *p;
+                if (a.tipo == GL_UNSIGNED_SHORT) { ui16 v; std::memcpy(&v, p, 2); return v; }
+                ui32 v; std::memcpy(&v, p, 4); return v;
+            }
+
+            // Se juntan todas las primitivas de triángulos de todas las mallas en una sola geometría
+            // Las transformaciones de los nodos se ignoran, los vértices quedan en el espacio de cada malla
+            inline std::optional<Malla> glb(const ui8* datos, size_t tam) {
+                ui32 cab[5];
+                if (tam < sizeof(cab))
+                    return std::nullopt;
+                std::memcpy(cab, datos, sizeof(cab));
+                if (cab[0] != glb_magia or cab[1] != 2 or cab[2] > tam or cab[4] != glb_json or 20 + (ui64)cab[3] > cab[2])
+                    return std::nullopt;
+
+                Json gltf;
+                leerJson((const char*)datos + 20, (const char*)datos + 20 + cab[3], gltf);
+
+                const ui8* bin = nullptr;
+                ui64 tam_bin = 0;
+                ui64 pos_bin = 20 + (((ui64)cab[3] + 3) & ~3ULL);
+                if (pos_bin + 8 <= cab[2]) {
+                    ui32 trozo[2];
+                    std::memcpy(trozo, datos + pos_bin, sizeof(trozo));
+                    if (trozo[1] == glb_bin and pos_bin + 8 + trozo[0] <= cab[2]) {
+                        bin = datos + pos_bin + 8;
+                        tam_bin = trozo[0];
+                    }
+                }
+
+                Malla m;
+                m.normales = m.uvs = true;
+                for (const Json& malla : gltf["meshes"].lista) {
+                    for (const Json& prim : malla["primitives"].lista) {
+                        if (prim["mode"].num(GL_TRIANGLES) != GL_TRIANGLES)
+                            continue;
+                        const Json& attr = prim["attributes"];
+                        Accessor pos = accessor(gltf, attr["POSITION"], bin, tam_bin);
+                        if (not pos.ok or pos.tipo != GL_FLOAT or pos.componentes != 3)
+                            continue;
+                        Accessor normal = accessor(gltf, attr["NORMAL"], bin, tam_bin);
+                        Accessor uv = accessor(gltf, attr["TEXCOORD_0"], bin, tam_bin);
+                        normal.ok &= normal.tipo == GL_FLOAT and normal.componentes == 3 and normal.num == pos.num;
+                        uv.ok &= uv.tipo == GL_FLOAT and uv.componentes == 2 and uv.num == pos.num;
+                        m.normales &= normal.ok;
+                        m.uvs &= uv.ok;
+
+                        // glTF ya tiene los vértices indexados, no hace falta buscar repetidos
+                        ui32 base = m.vertices.size();
+                        m.vertices.resize(base + pos.num);
+                        for (ui32 i = 0; i < pos.num; i++) {
+                            Vertice& v = m.vertices[base + i];
+                            copiarFloats(pos, i, &v.pos.x, 3);
+                            if (normal.ok) copiarFloats(normal, i, &v.normal.x, 3);
+                            if (uv.ok) {
+                                copiarFloats(uv, i, &v.uv.x, 2);
+                                v.uv.y = 1.f - v.uv.y;      // glTF tiene el origen de las texturas arriba
+                            }
+                        }
+
+                        Accessor ind = accessor(gltf, prim["indices"], bin, tam_bin);
+                        if (ind.ok and ind.componentes == 1) {
+                            for (ui32 i = 0; i < ind.num; i++) {
+                                ui32 j = leerIndice(ind, i);
+                                m.indices.push_back(base + (j < pos.num ? j : 0));
+                            }
+                        } else {
+                            for (ui32 i = 0; i < pos.num; i++)
+                                m.indices.push_back(base + i);
+                        }
+                    }
+                }
+                if (m.vertices.empty())
+                    m.normales = m.uvs = false;
+                return m;
+            }
+
+            // ---
+
+            // Normales suavizadas a partir de las caras, para los modelos que no las incluyen
+            inline void calcularNormales(Malla& m) {
+                for (auto& v : m.vertices)
+                    v.normal = glm::vec3(0.f);
+                for (size_t i = 0; i + 2 < m.indices.size(); i += 3) {
+                    Vertice &a = m.vertices[m.indices[i]], &b = m.vertices[m.indices[i + 1]], &c = m.vertices[m.indices[i + 2]];
+                    glm::vec3 n = glm::cross(b.pos - a.pos, c.pos - a.pos);     // Sin normalizar, pondera por el área
+                    a.normal += n; b.normal += n; c.normal += n;
+                }
+                for (auto& v : m.vertices) {
+                    float l = glm::length(v.normal);
+                    v.normal = l > 0.f ? v.normal / l : glm::vec3(0.f, 1.f, 0.f);
+                }
+                m.normales = true;
+            }
+        }
+
+        // Leer un modelo en memoria, elegiendo el formato por la extensión
+        inline std::optional<Malla> leer(const ui8* datos, size_t tam, const str& extension) {
+            if (extension == ".obj")
+                return detail::obj(datos, tam);
+            if (extension == ".glb")
+                return detail::glb(datos, tam);
+            return std::nullopt;
+        }
+
+        // Cargar un modelo y subirlo al VAO indicado como una geometría
+        // El primer atributo del VAO es la posición (3), y de los siguientes el primero de 3 floats es la normal y el primero
+        // de 2 las coordenadas de textura. Los que sobren se dejan a 0. Si el VAO tiene normales y el modelo no, se calculan
+        inline void cargar(GeomId nombre, const fs::path& ruta, VaoId vao = "main"_id) {
+            // Si está en el paquete lo usamos directamente, si no mapeamos el archivo
+            Mapeo mapeo;
+            std::optional<Archivo> del_paquete = paquete::leer(tofu::detail::nombrePaquete(ruta));
+            if (del_paquete) {
+                mapeo.datos = del_paquete->datos;
+                mapeo.tam = del_paquete->tam;
+            } else if (not tofu::detail::mapear(ruta, mapeo)) {
+                log::error("No se ha podido abrir el modelo {}", ruta.string());
+                std::exit(-1);
+            }
+
+            double t_ini = debug::time();
+            std::optional<Malla> m = leer(mapeo.datos, mapeo.tam, ruta.extension().string());
+            double t_leer = debug::time() - t_ini;
+            size_t tam = mapeo.tam;
+            if (not del_paquete)
+                tofu::detail::desmapear(mapeo);
+
+            if (not m or m->indices.empty()) {
+                log::error("El modelo {} no es válido o no tiene triángulos", ruta.string());
+                std::exit(-1);
+            }
+
+            const std::vector<ui32>& attr = gl.VAOs[vao].atributos;
+            if (attr.empty() or attr[0] != 3) {
+                log::error("El VAO {} tiene que empezar por la posición (3 floats) para cargar modelos", vao);
+                std::exit(-1);
+            }
+            // Después de la posición, la normal es el primer atributo de 3 floats y las uvs el primero de 2
+            // Cada uno se escribe en su offset dentro del vértice, sumando los tamaños de los anteriores
+            int off_normal = -1, off_uv = -1;
+            for (ui32 a = 1, off = attr[0]; a < attr.size(); off += attr[a++]) {
+                if (attr[a] == 3 and off_normal < 0)
+                    off_normal = off;
+                else if (attr[a] == 2 and off_uv < 0)
+                    off_uv = off;
+            }
+            bool con_normales = off_normal >= 0;
+            bool con_uvs = off_uv >= 0;
+            if (con_normales and not m->normales)
+                detail::calcularNormales(*m);
+            if (con_uvs and not m->uvs)
+                log::warn("El modelo {} no tiene coordenadas de textura", ruta.string());
+
+            // Escribimos los vértices con el formato del VAO directamente en la GPU
+            ui32 stride = std::accumulate(attr.begin(), attr.end(), 0);
+            buffer::generarVert(nombre, m->vertices.size() * stride, m->indices.size(), [&](float* v, ui32* i) {
+                std::fill(v, v + m->vertices.size() * stride, 0.f);
+                for (const Vertice& x : m->vertices) {
+                    std::memcpy(v, &x.pos, sizeof(glm::vec3));
+                    if (con_normales) std::memcpy(v + off_normal, &x.normal, sizeof(glm::vec3));
+                    if (con_uvs) std::memcpy(v + off_uv, &x.uv, sizeof(glm::vec2));
+                    v += stride;
+                }
+                std::memcpy(i, m->indices.data(), m->indices.size() * sizeof(ui32));
+            }, vao);
+
+            double mb = tam / (1024.0 * 1024.0);
+            log::info("Modelo {}: {} vértices, {} triángulos, {} KiB leídos a {} MB/s", ruta.string(), m->vertices.size(), m->indices.size() / 3,
+                      tam / 1024, t_leer > 0.0 ? (ui32)(mb / t_leer) : 0);
+        }
+    }
+}
@@ -0,0 +1,251 @@
+// Oclusión por software en la CPU
+// Unos pocos oclusores grandes y simplificados (por ejemplo, una esfera de pocos triángulos inscrita en el Sol) se
+// rasterizan a un buffer de profundidad pequeño, y después se comprueba si la caja de cada instancia queda detrás
+// La imagen se divide en tiles: cada triángulo se apunta en los tiles que toca y cada hilo rasteriza los suyos, 8 píxeles
+// a la vez con AVX2 o 4 con SSE. Cada tile guarda además su profundidad más lejana, así la mayoría de comprobaciones
+// se resuelven sin mirar los píxeles
+// Sirve para quitar de la lista de visibilidad::frustum las instancias tapadas sin leer nada de la GPU
+// Los oclusores tienen que quedar dentro del objeto que representan, y a esta resolución sus bordes pueden tapar
+// hasta un píxel del buffer de más, así que conviene que sean algo más pequeños que el objeto
+#pragma once
+
+#include "visibilidad.h"
+
+namespace tofu
+{
+    namespace oclusores
+    {
+        constexpr ui32 ancho = 256, alto = 128;
+        constexpr ui32 tile_ancho = 32, tile_alto = 16;
+        constexpr ui32 tiles_x = ancho / tile_ancho, tiles_y = alto / tile_alto;
+        static_assert(tile_ancho % 8 == 0, "Los tiles se rasterizan de 8 en 8 píxeles");
+
+        // Con menos triángulos o instancias por hilo no compensa crearlo
+        constexpr ui32 min_triangulos_hilo = 256;
+        constexpr ui32 min_por_hilo = 1 << 12;
+
+        // Triángulo preparado para rasterizar
+        // Un píxel está dentro si a·x + b·y + c >= 0 para las tres aristas, y su profundidad es zx·x + zy·y + z0
+        struct Triangulo {
+            float a[3], b[3], c[3];
+            float zx, zy, z0;
+            ui32 x0, y0, x1, y1;    // Píxeles que ocupa, incluidos los extremos
+        };
+
+        struct Buffer {
+            std::vector<float> profundidad = std::vector<float>(ancho * alto, 1.f);
+            std::array<float, tiles_x * tiles_y> lejana = {};                   // Profundidad más lejana de cada tile
+            std::array<std::vector<ui32>, tiles_x * tiles_y> tiles;             // Triángulos que toca cada tile
+            std::vector<Triangulo> triangulos;
+            std::vector<glm::vec4> proyectados;
+            glm::mat4 viewproj = glm::mat4(1.f);
+        };
+
+        namespace detail
+        {
+            // Rasterizar la parte de un triángulo que cae en un tile, quedándose con la profundidad más cercana
+            inline void rasterizar(Buffer& o, const Triangulo& t, ui32 tx, ui32 ty) {
+                ui32 x0 = std::max(t.x0, tx), x1 = std::min(t.x1, tx + tile_ancho - 1);
+                ui32 y0 = std::max(t.y0, ty), y1 = std::min(t.y1, ty + tile_alto - 1);
+
+                for (ui32 y = y0; y <= y1; y++) {
+                    float py = y + 0.5f;
+                    float c0 = t.b[0] * py + t.c[0], c1 = t.b[1] * py + t.c[1], c2 = t.b[2] * py + t.c[2];
+                    float cz = t.zy * py + t.z0;
+                    float* fila = o.profundidad.data() + y * ancho;
+                    ui32 x = x0;
+
+                    // Los píxeles de fuera del triángulo los descartan las aristas, así se puede empezar alineado a 8 (o 4)
+                    #if defined(__AVX2__)
+                    const __m256 desp = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+                    const __m256 a0 = _mm256_set1_ps(t.a[0]), a1 = _mm256_set1_ps(t.a[1]), a2 = _mm256_set1_ps(t.a[2]), zx = _mm256_set1_ps(t.zx);
+                    const __m256 e0 = _mm256_set1_ps(c0), e1 = _mm256_set1_ps(c1), e2 = _mm256_set1_ps(c2), ez = _mm256_set1_ps(cz);
+                    const __m256 cero = _mm256_setzero_ps();
+                    for (x = x0 & ~7u; x <= x1; x += 8) {
+                        __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), desp);
+                        #ifdef __FMA__
+                        __m256 d0 = _mm256_fmadd_ps(a0, px, e0), d1 = _mm256_fmadd_ps(a1, px, e1), d2 = _mm256_fmadd_ps(a2, px, e2);
+                        __m256 z = _mm256_fmadd_ps(zx, px, ez);
+                        #else
+                        __m256 d0 = _mm256_add_ps(_mm256_mul_ps(a0, px), e0), d1 = _mm256_add_ps(_mm256_mul_ps(a1, px), e1);
+                        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(a2, px), e2), z = _mm256_add_ps(_mm256_mul_ps(zx, px), ez);
+                        #endif
+                        __m256 dentro = _mm256_and_ps(_mm256_cmp_ps(d0, cero, _CMP_GE_OQ),
+                                        _mm256_and_ps(_mm256_cmp_ps(d1, cero, _CMP_GE_OQ), _mm256_cmp_ps(d2, cero, _CMP_GE_OQ)));
+                        __m256 actual = _mm256_loadu_ps(fila + x);
+                        _mm256_storeu_ps(fila + x, _mm256_blendv_ps(actual, _mm256_min_ps(actual, z), dentro));
+                    }
+                    #elif defined(__SSE2__) or defined(_M_X64)
+                    const __m128 desp = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                    const __m128 a0 = _mm_set1_ps(t.a[0]), a1 = _mm_set1_ps(t.a[1]), a2 = _mm_set1_ps(t.a[2]), zx = _mm_set1_ps(t.zx);
+                    const __m128 e0 = _mm_set1_ps(c0), e1 = _mm_set1_ps(c1), e2 = _mm_set1_ps(c2), ez = _mm_set1_ps(cz);
+                    const __m128 cero = _mm_setzero_ps();
+                    for (x = x0 & ~3u; x <= x1; x += 4) {
+                        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), desp);
+                        __m128 d0 = _mm_add_ps(_mm_mul_ps(a0, px), e0), d1 = _mm_add_ps(_mm_mul_ps(a1, px), e1);
+                        __m128 d2 = _mm_add_ps(_mm_mul_ps(a2, px), e2), z = _mm_add_ps(_mm_mul_ps(zx, px), ez);
+                        __m128 dentro = _mm_and_ps(_mm_cmpge_ps(d0, cero), _mm_and_ps(_mm_cmpge_ps(d1, cero), _mm_cmpge_ps(d2, cero)));
+                        __m128 actual = _mm_loadu_ps(fila + x);
+                        _mm_storeu_ps(fila + x, _mm_or_ps(_mm_and_ps(dentro, _mm_min_ps(actual, z)), _mm_andnot_ps(dentro, actual)));
+                    }
+                    #endif
+
+                    // Sin SIMD, píxel a píxel
+                    for (; x <= x1; x++) {
+                        float px = x + 0.5f;
+                        if (t.a[0] * px + c0 >= 0.f and t.a[1] * px + c1 >= 0.f and t.a[2] * px + c2 >= 0.f)
+                            fila[x] = std::min(fila[x], t.zx * px + cz);
+                    }
+                }
+            }
+        }
+
+        // Empezar un frame de oclusión con la cámara indicada, olvidando los oclusores anteriores
+        inline void empezar(Buffer& o, const glm::mat4& viewproj) {
+            o.viewproj = viewproj;
+            o.triangulos.clear();
+            for (auto& t : o.tiles)
+                t.clear();
+        }
+
+        // Añadir un oclusor: proyectar sus triángulos, prepararlos y apuntarlos en los tiles que tocan
+        // Los vértices son como en buffer::cargarVert (num_vert floats, stride floats por vértice con la posición primero)
+        // Los triángulos que cruzan el plano cercano se ignoran, así el oclusor tapa menos pero nunca de más
+        // Se rasterizan las dos caras, no hace falta que los triángulos tengan un orden concreto
+        inline void oclusor(Buffer& o, const float* vertices, ui32 num_vert, ui32 stride, const ui32* indices, ui32 num_ind, const glm::mat4& modelo) {
+            glm::mat4 m = o.viewproj * modelo;
+            ui32 nv = num_vert / stride;
+            o.proyectados.resize(nv);
+            for (ui32 i = 0; i < nv; i++) {
+                const float* v = vertices + (size_t)i * stride;
+                o.proyectados[i] = m * glm::vec4(v[0], v[1], v[2], 1.f);
+            }
+
+            for (ui32 i = 0; i + 2 < num_ind; i += 3) {
+                glm::vec3 p[3];
+                bool cortado = false;
+                for (ui32 k = 0; k < 3; k++) {
+                    const glm::vec4& c = o.proyectados[indices[i + k]];
+                    cortado |= c.w <= 0.f or c.z < -c.w;
+                    p[k] = glm::vec3((c.x / c.w * 0.5f + 0.5f) * ancho, (c.y / c.w * 0.5f + 0.5f) * alto, c.z / c.w * 0.5f + 0.5f);
+                }
+                if (cortado)
+                    continue;
+
+                // Con el área positiva, dentro es el lado positivo de las tres aristas
+                float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+                if (area == 0.f)
+                    continue;
+                if (area < 0.f) {
+                    std::swap(p[1], p[2]);
+                    area = -area;
+                }
+
+                // Píxeles cuyo centro puede estar dentro
+                float min_x = std::min({ p[0].x, p[1].x, p[2].x }), max_x = std::max({ p[0].x, p[1].x, p[2].x });
+                float min_y = std::min({ p[0].y, p[1].y, p[2].y }), max_y = std::max({ p[0].y, p[1].y, p[2].y });
+                int x0 = std::max((int)std::ceil(min_x - 0.5f), 0), x1 = std::min((int)std::floor(max_x - 0.5f), (int)ancho - 1);
+                int y0 = std::max((int)std::ceil(min_y - 0.5f), 0), y1 = std::min((int)std::floor(max_y - 0.5f), (int)alto - 1);
+                if (x0 > x1 or y0 > y1)
+                    continue;
+
+                Triangulo t;
+                for (ui32 k = 0; k < 3; k++) {
+                    const glm::vec3& a = p[k];
+                    const glm::vec3& b = p[(k + 1) % 3];
+                    t.a[k] = a.y - b.y;
+                    t.b[k] = b.x - a.x;
+                    t.c[k] = -(t.a[k] * a.x + t.b[k] * a.y);
+                }
+                float dx1 = p[1].x - p[0].x, dy1 = p[1].y - p[0].y, dz1 = p[1].z - p[0].z;
+                float dx2 = p[2].x - p[0].x, dy2 = p[2].y - p[0].y, dz2 = p[2].z - p[0].z;
+                t.zx = (dz1 * dy2 - dz2 * dy1) / area;
+                t.zy = (dx1 * dz2 - dx2 * dz1) / area;
+                t.z0 = p[0].z - t.zx * p[0].x - t.zy * p[0].y;
+                t.x0 = x0; t.x1 = x1; t.y0 = y0; t.y1 = y1;
+
+                ui32 id = o.triangulos.size();
+                o.triangulos.push_back(t);
+                for (ui32 ty = y0 / tile_alto; ty <= y1 / tile_alto; ty++)
+                    for (ui32 tx = x0 / tile_ancho; tx <= x1 / tile_ancho; tx++)
+                        o.tiles[ty * tiles_x + tx].push_back(id);
+            }
+        }
+
+        // Rasterizar los oclusores añadidos
+        // Cada tile es independiente, así que los hilos se los reparten sin sincronizarse
+        // hilos = 0 usa todos los disponibles
+        inline void rasterizar(Buffer& o, ui32 hilos = 0) {
+            hilos = visibilidad::detail::hilos(hilos, o.triangulos.size(), min_triangulos_hilo);
+            visibilidad::detail::repartir(hilos, [&](ui32 h) {
+                for (ui32 t = h; t < tiles_x * tiles_y; t += hilos) {
+                    ui32 tx = (t % tiles_x) * tile_ancho, ty = (t / tiles_x) * tile_alto;
+                    for (ui32 y = ty; y < ty + tile_alto; y++)
+                        std::fill_n(o.profundidad.data() + y * ancho + tx, tile_ancho, 1.f);
+                    for (ui32 i : o.tiles[t])
+                        detail::rasterizar(o, o.triangulos[i], tx, ty);
+
+                    float lejana = 0.f;
+                    for (ui32 y = ty; y < ty + tile_alto; y++)
+                        for (ui32 x = tx; x < tx + tile_ancho; x++)
+                            lejana = std::max(lejana, o.profundidad[y * ancho + x]);
+                    o.lejana[t] = lejana;
+                }
+            });
+        }
+
+        // Comprobar si una esfera se ve, usando la caja que la envuelve
+        // Es visible si algún píxel que ocupa su rectángulo en pantalla tiene un oclusor más lejos que su punto más cercano
+        // Lo que está fuera de la pantalla o cruza el plano cercano se da por visible (eso lo decide el frustum culling)
+        inline bool visible(const Buffer& o, glm::vec3 centro, float radio) {
+            // Las esquinas se proyectan sumando al centro proyectado las columnas de la matriz por el radio
+            glm::vec4 c = o.viewproj * glm::vec4(centro, 1.f);
+            glm::vec4 ex = o.viewproj[0] * radio, ey = o.viewproj[1] * radio, ez = o.viewproj[2] * radio;
+            glm::vec3 minimo = glm::vec3(INFINITY), maximo = glm::vec3(-INFINITY);
+            for (ui32 i = 0; i < 8; i++) {
+                glm::vec4 p = c + (i & 1 ? ex : -ex) + (i & 2 ? ey : -ey) + (i & 4 ? ez : -ez);
+                if (p.w <= 0.f or p.z < -p.w)
+                    return true;
+                minimo = glm::min(minimo, glm::vec3(p) / p.w);
+                maximo = glm::max(maximo, glm::vec3(p) / p.w);
+            }
+            if (maximo.x < -1.f or minimo.x > 1.f or maximo.y < -1.f or minimo.y > 1.f)
+                return true;
+
+            float z = minimo.z * 0.5f + 0.5f;
+            int x0 = std::clamp((int)((minimo.x * 0.5f + 0.5f) * ancho), 0, (int)ancho - 1);
+            int x1 = std::clamp((int)((maximo.x * 0.5f + 0.5f) * ancho), 0, (int)ancho - 1);
+            int y0 = std::clamp((int)((minimo.y * 0.5f + 0.5f) * alto), 0, (int)alto - 1);
+            int y1 = std::clamp((int)((maximo.y * 0.5f + 0.5f) * alto), 0, (int)alto - 1);
+
+            for (int ty = y0 / tile_alto; ty <= y1 / (int)tile_alto; ty++)
+                for (int tx = x0 / tile_ancho; tx <= x1 / (int)tile_ancho; tx++) {
+                    // Si todo el tile está delante no hace falta mirar sus píxeles
+                    if (o.lejana[ty * tiles_x + tx] < z)
+                        continue;
+                    int ax = std::max(x0, tx * (int)tile_ancho), bx = std::min(x1, (tx + 1) * (int)tile_ancho - 1);
+                    int ay = std::max(y0, ty * (int)tile_alto), by = std::min(y1, (ty + 1) * (int)tile_alto - 1);
+                    for (int y = ay; y <= by; y++)
+                        for (int x = ax; x <= bx; x++)
+                            if (o.profundidad[y * ancho + x] >= z)
+                                return true;
+                }
+            return false;
+        }
+
+        // Quitar de una lista de índices (por ejemplo, la de visibilidad::frustum) las esferas tapadas
+        // Se compacta sobre la misma lista manteniendo el orden, y devuelve cuántas quedan de las num primeras
+        inline ui32 filtrar(const Buffer& o, const visibilidad::Esferas& e, std::vector<ui32>& visibles, ui32 num, ui32 hilos = 0) {
+            hilos = visibilidad::detail::hilos(hilos, num, min_por_hilo);
+            return visibilidad::detail::compactar(visibles, num, hilos, 1, [&](ui32 ini, ui32 fin) {
+                ui32 n = ini;
+                for (ui32 i = ini; i < fin; i++) {
+                    ui32 id = visibles[i];
+                    visibles[n] = id;
+                    n += visible(o, glm::vec3(e.x[id], e.y[id], e.z[id]), e.r[id]);
+                }
+                return n - ini;
+            });
+        }
+    }
+}
@@ -0,0 +1,190 @@
+// Paquete de recursos
+// Un solo archivo con las shaders, texturas y figuras de un proyecto, pensado para mapearlo en memoria al iniciar
+// Formato: cabecera, índice de entradas ordenado por el hash del nombre, tabla de nombres y los datos de cada
+// entrada alineados a 64 bytes, así las texturas y vértices se pueden subir a la GPU directamente desde el mapeo
+// No depende de OpenGL para poder utilizarlo también desde herramientas externas (tofu-pack)
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+
+#include "clusters.h"
+
+namespace tofu
+{
+    using ui64 = std::uint64_t;
+    using ui32 = std::uint32_t;
+    using ui8 = std::uint8_t;
+
+    namespace paquete
+    {
+        constexpr char magia[8] = { 'T', 'O', 'F', 'U', 'P', 'A', 'Q', '\0' };
+        constexpr ui32 version = 1;
+        constexpr ui64 alineacion = 64;
+
+        // Tipos de entrada
+        constexpr ui32 ARCHIVO = 0;     // Contenido de un archivo tal cual (shaders, KTX, PNG...)
+        constexpr ui32 MALLA = 1;       // Vértices e índices listos para subir al VBO/EBO
+
+        // Primitivas de las mallas (mismos valores que los enums de OpenGL)
+        constexpr ui32 LINEAS_CONTINUAS = 0x0003;   // GL_LINE_STRIP
+        constexpr ui32 TRIANGULOS = 0x0004;         // GL_TRIANGLES
+
+        struct Cabecera {
+            char magia[8];
+            ui32 version;
+            ui32 num_entradas;
+            ui64 bytes_nombres;     // Tamaño de la tabla de nombres, que va justo después de las entradas
+            ui64 tam;               // Tamaño total del archivo, para detectar paquetes cortados
+        };
+        static_assert(sizeof(Cabecera) == 32, "La cabecera del paquete tiene que ocupar 32 bytes");
+
+        struct Entrada {
+            ui64 hash;              // FNV-1a del nombre, igual que los Id de tofu
+            ui64 offset, tam;       // Posición de los datos desde el inicio del archivo
+            ui32 tipo;
+            ui32 nombre;            // Posición del nombre (terminado en \0) en la tabla de nombres
+        };
+        static_assert(sizeof(Entrada) == 32, "Las entradas del paquete tienen que ocupar 32 bytes");
+
+        // Los datos de una malla empiezan con esta cabecera, seguida de los vértices (floats), de los índices y de los clusters
+        struct CabeceraMalla {
+            ui32 num_vert;          // Número de floats, como en buffer::cargarVert
+            ui32 num_ind;
+            ui32 tipo_dibujo;
+            ui32 num_clusters;      // 0 si la malla no está agrupada (tofu-pack -c)
+        };
+        static_assert(sizeof(CabeceraMalla) == 16, "La cabecera de una malla tiene que ocupar 16 bytes");
+
+        // Hash de los nombres (FNV-1a de 64 bits, el mismo que tofu::fnv1a)
+        constexpr ui64 hashNombre(const char* s, size_t n) {
+            ui64 h = 0xcbf29ce484222325ULL;
+            for (size_t i = 0; i < n; i++) {
+                h ^= (ui8)s[i];
+                h *= 0x100000001b3ULL;
+            }
+            return h;
+        }
+
+        // Índice de un paquete en memoria
+        // Apunta directamente a los datos del paquete, no se copia nada
+        struct Indice {
+            const Entrada* entradas = nullptr;
+            ui32 num_entradas = 0;
+            const char* nombres = nullptr;
+        };
+
+        // Interpretar un paquete en memoria y comprobar que todas las entradas están dentro del archivo
+        inline bool leer(const ui8* datos, size_t tam, Indice& indice) {
+            if (tam < sizeof(Cabecera))
+                return false;
+            Cabecera cab;
+            std::memcpy(&cab, datos, sizeof(Cabecera));
+            if (std::memcmp(cab.magia, magia, sizeof(magia)) != 0 or cab.version != version or cab.tam != tam)
+                return false;
+
+            ui64 fin_indice = sizeof(Cabecera) + (ui64)cab.num_entradas * sizeof(Entrada) + cab.bytes_nombres;
+            if (fin_indice > tam)
+                return false;
+
+            indice.entradas = (const Entrada*)(datos + sizeof(Cabecera));
+            indice.num_entradas = cab.num_entradas;
+            indice.nombres = (const char*)(indice.entradas + cab.num_entradas);
+            for (ui32 i = 0; i < cab.num_entradas; i++) {
+                const Entrada& e = indice.entradas[i];
+                if (e.offset < fin_indice or e.offset + e.tam > tam or e.nombre >= cab.bytes_nombres)
+                    return false;
+                if (i > 0 and indice.entradas[i - 1].hash >= e.hash)
+                    return false;
+            }
+            return cab.bytes_nombres > 0 ? indice.nombres[cab.bytes_nombres - 1] == '\0' : cab.num_entradas == 0;
+        }
+
+        // Buscar una entrada por su nombre (búsqueda binaria por el hash)
+        // Se compara también el nombre, así un hash que coincide por casualidad no devuelve otro recurso
+        inline const Entrada* buscar(const Indice& indice, const char* nombre, size_t n) {
+            ui64 hash = hashNombre(nombre, n);
+            const Entrada* fin = indice.entradas + indice.num_entradas;
+            const Entrada* e = std::lower_bound(indice.entradas, fin, hash, [](const Entrada& e, ui64 h) { return e.hash < h; });
+            if (e == fin or e->hash != hash)
+                return nullptr;
+            const char* s = indice.nombres + e->nombre;
+            if (std::strlen(s) != n or std::memcmp(s, nombre, n) != 0)
+                return nullptr;
+            return e;
+        }
+
+        // ---
+
+        // Entrada para escribir un paquete
+        struct Recurso {
+            std::string nombre;
+            ui32 tipo;
+            std::vector<ui8> datos;
+        };
+
+        // Datos de una malla para guardarla en el paquete
+        // Si se pasan clusters, los índices tienen que estar ya reordenados (clusters::agrupar)
+        inline std::vector<ui8> malla(const float* vertices, ui32 num_vert, const ui32* indices, ui32 num_ind, ui32 tipo_dibujo = TRIANGULOS,
+                                      const Cluster* clusters = nullptr, ui32 num_clusters = 0) {
+            CabeceraMalla cab = { num_vert, num_ind, tipo_dibujo, num_clusters };
+            size_t bytes_ind = sizeof(cab) + num_vert * sizeof(float) + num_ind * sizeof(ui32);
+            std::vector<ui8> datos(bytes_ind + num_clusters * sizeof(Cluster));
+            std::memcpy(datos.data(), &cab, sizeof(cab));
+            std::memcpy(datos.data() + sizeof(cab), vertices, num_vert * sizeof(float));
+            if (num_ind > 0)
+                std::memcpy(datos.data() + sizeof(cab) + num_vert * sizeof(float), indices, num_ind * sizeof(ui32));
+            if (num_clusters > 0)
+                std::memcpy(datos.data() + bytes_ind, clusters, num_clusters * sizeof(Cluster));
+            return datos;
+        }
+
+        // Escribir un paquete con los recursos indicados
+        // Devuelve un vector vacío si dos nombres están repetidos o tienen el mismo hash
+        inline std::vector<ui8> escribir(std::vector<Recurso> recursos) {
+            auto hash = [](const Recurso& r) { return hashNombre(r.nombre.data(), r.nombre.size()); };
+            std::sort(recursos.begin(), recursos.end(), [&](const Recurso& a, const Recurso& b) { return hash(a) < hash(b); });
+            for (size_t i = 1; i < recursos.size(); i++)
+                if (hash(recursos[i - 1]) == hash(recursos[i]))
+                    return {};
+
+            // Tabla de nombres
+            std::vector<Entrada> entradas(recursos.size());
+            std::string nombres;
+            for (size_t i = 0; i < recursos.size(); i++) {
+                entradas[i].hash = hash(recursos[i]);
+                entradas[i].tipo = recursos[i].tipo;
+                entradas[i].nombre = nombres.size();
+                nombres += recursos[i].nombre;
+                nombres += '\0';
+            }
+
+            // Posición de los datos, cada uno alineado
+            auto alinear = [](ui64 x) { return (x + alineacion - 1) & ~(alineacion - 1); };
+            ui64 pos = alinear(sizeof(Cabecera) + entradas.size() * sizeof(Entrada) + nombres.size());
+            for (size_t i = 0; i < recursos.size(); i++) {
+                entradas[i].offset = pos;
+                entradas[i].tam = recursos[i].datos.size();
+                pos = alinear(pos + entradas[i].tam);
+            }
+
+            Cabecera cab = {};
+            std::memcpy(cab.magia, magia, sizeof(magia));
+            cab.version = version;
+            cab.num_entradas = entradas.size();
+            cab.bytes_nombres = nombres.size();
+            cab.tam = pos;
+
+            std::vector<ui8> archivo(pos, 0);
+            std::memcpy(archivo.data(), &cab, sizeof(cab));
+            std::memcpy(archivo.data() + sizeof(cab), entradas.data(), entradas.size() * sizeof(Entrada));
+            std::memcpy(archivo.data() + sizeof(cab) + entradas.size() * sizeof(Entrada), nombres.data(), nombres.size());
+            for (size_t i = 0; i < recursos.size(); i++)
+                std::memcpy(archivo.data() + entradas[i].offset, recursos[i].datos.data(), recursos[i].datos.size());
+            return archivo;
+        }
+    }
+}
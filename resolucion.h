@@ -0,0 +1,138 @@
+// Resolución dinámica
+// Los recursos dinámicos del grafo de renderizado se dibujan a una escala de la ventana que se ajusta cada frame
+// a partir del tiempo de GPU medido con timer queries, para mantenerse por debajo de un tiempo objetivo
+// Al final, un paso del grafo escala el resultado a la pantalla con un filtro bilineal y un realce opcional
+#pragma once
+
+#include <cmath>
+
+#include "grafo.h"
+#include "consultas.h"
+
+namespace tofu
+{
+    namespace resolucion
+    {
+        namespace detail
+        {
+            // La escala cambia en saltos fijos para no recrear las texturas del grafo cada frame
+            inline const float paso = 0.05f;
+
+            // Shader de escalado
+            // Toma la imagen a la resolución interna y la estira a la pantalla con un filtro bilineal
+            // Con nitidez > 0 resta el laplaciano con los vecinos y limita el resultado a su rango para no crear halos
+            inline const str escalado_vert = R"(#version 330 core
+out vec2 uv;
+void main() {
+    vec2 pos = vec2[3](vec2(-1,-1), vec2(3,-1), vec2(-1, 3))[gl_VertexID];
+    gl_Position = vec4(pos, 0.0, 1.0);
+    uv = pos * 0.5 + 0.5;
+})";
+            inline const str escalado_frag = R"(#version 330 core
+in vec2 uv;
+uniform sampler2D imagen;
+uniform float nitidez;
+out vec4 color_out;
+void main() {
+    vec4 c = texture(imagen, uv);
+    if (nitidez <= 0.0) {
+        color_out = c;
+        return;
+    }
+    vec2 texel = 1.0 / vec2(textureSize(imagen, 0));
+    vec4 n = texture(imagen, uv + vec2(0.0, texel.y));
+    vec4 s = texture(imagen, uv - vec2(0.0, texel.y));
+    vec4 e = texture(imagen, uv + vec2(texel.x, 0.0));
+    vec4 o = texture(imagen, uv - vec2(texel.x, 0.0));
+    vec4 minimo = min(c, min(min(n, s), min(e, o)));
+    vec4 maximo = max(c, max(max(n, s), max(e, o)));
+    color_out = clamp(c + (4.0 * c - n - s - e - o) * nitidez, minimo, maximo);
+})";
+
+            // Ajustar la escala con un nuevo tiempo de frame (ms)
+            // El coste de los pasos escalados es proporcional al número de píxeles (escala²), así que si nos pasamos
+            // del objetivo bajamos directamente a la escala estimada. Para subir vamos poco a poco y con margen
+            inline void ajustar(float ms) {
+                Resolucion& r = gl.resolucion;
+                r.tiempo = r.tiempo > 0.f ? r.tiempo * 0.9f + ms * 0.1f : ms;
+
+                float escala = r.escala;
+                if (r.tiempo > r.objetivo and t - r.ultimo_cambio > 0.25)
+                    escala = std::floor(r.escala * std::sqrt(r.objetivo / r.tiempo) / paso) * paso;
+                else if (r.tiempo < r.objetivo * 0.75f and t - r.ultimo_cambio > 1.0)
+                    escala = r.escala + paso;
+                escala = std::clamp(escala, r.minima, r.maxima);
+
+                if (escala != r.escala) {
+                    r.tiempo *= (escala * escala) / (r.escala * r.escala);
+                    r.escala = escala;
+                    r.ultimo_cambio = t;
+                }
+            }
+
+            // Empezar a medir el frame
+            // El tiempo llega del pool de consultas cuando la GPU ha terminado, normalmente uno o dos frames después
+            inline void empezar() {
+                Resolucion& r = gl.resolucion;
+                if (not r.activa)
+                    return;
+
+                NOWEB(
+                    if (auto ns = consulta::nuevo("tofu_resolucion"_id))
+                        ajustar(*ns / 1e6f);
+                    consulta::empezar("tofu_resolucion"_id, GL_TIME_ELAPSED);
+                )
+                r.inicio_cpu = debug::time();
+            }
+
+            inline void terminar() {
+                Resolucion& r = gl.resolucion;
+                if (not r.activa)
+                    return;
+
+                // En la web no hay timer queries, usamos el tiempo de CPU del render como aproximación
+                NOWEB(consulta::terminar("tofu_resolucion"_id);)
+                WEB(ajustar((debug::time() - r.inicio_cpu) * 1000.f);)
+            }
+        }
+
+        // Activar la resolución dinámica con un tiempo de frame objetivo (ms)
+        // Se empieza a medir de cero, sin los tiempos ni la consulta que quedaran de otra vez que estuvo activa
+        inline void activar(float objetivo = 1000.f / 60.f, float minima = 0.5f, float maxima = 1.f) {
+            Resolucion& r = gl.resolucion;
+            r.activa = true;
+            r.objetivo = objetivo;
+            r.minima = minima;
+            r.maxima = maxima;
+            r.escala = std::clamp(r.escala, minima, maxima);
+            r.tiempo = 0.f;
+            consulta::reiniciar("tofu_resolucion"_id);
+        }
+
+        // Desactivar la resolución dinámica y volver a la escala completa
+        inline void desactivar() {
+            Resolucion& r = gl.resolucion;
+            r.activa = false;
+            r.escala = 1.f;
+            r.tiempo = 0.f;
+            consulta::reiniciar("tofu_resolucion"_id);
+        }
+
+        // Añadir al grafo el paso que escala un recurso dinámico a la pantalla
+        // Se mezcla con lo que ya haya en pantalla usando el alfa del recurso
+        inline void escalar(str recurso) {
+            if (not gl.VAOs.count("tofu_vacio"_id))
+                buffer::iniciarVAO({}, "tofu_vacio"_id);
+            if (not gl.shaders.count("tofu_escalado"_id))
+                shader::cargarFuente("tofu_escalado"_id, detail::escalado_vert, detail::escalado_frag, "tofu_vacio"_id, 0, { .depth = false, .cull = false });
+
+            grafo::paso("escalado", { recurso }, { grafo::pantalla }, [recurso](){
+                Resolucion& r = gl.resolucion;
+                shader::usar("tofu_escalado"_id);
+                shader::uniform("imagen"_id, grafo::vincular(recurso));
+                shader::uniform("nitidez"_id, r.escala < 1.f ? r.nitidez : 0.f);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            });
+        }
+    }
+}
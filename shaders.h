@@ -2,162 +2,661 @@
 #pragma once
 
 #include <cstdint>
-#include <filesystem>
-#include <fstream>
 #include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
 
+#include "archivos.h"
 #include "debug.h"
+#include "hash.h"
+#include "unidades.h"
 
-namespace fs = std::filesystem;
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
 
 namespace tofu
 {
     namespace detail
     {
-        inline std::optional<str> leerArchivo(fs::path path) {
-            // Comprobamos que el directorio existe
-            if (not fs::exists(path))
-                return std::nullopt;
+        // Caché de binarios de programas
+        // Cada programa se guarda con glGetProgramBinary en un archivo con el hash de su código, las variables de
+        // transform feedback y el driver. Si el driver cambia, cambia la clave y se vuelve a compilar
+        inline const fs::path ruta_cache_shaders = fs::path(".cache") / "shaders";
 
-            // Abrimos el fichero
-            std::ifstream in(path.string());
-            if (not in.is_open()) {
-                log::error("No se ha podido abrir el archivo: {}", path.string());
-                std::exit(-1);
+        // GL_ARB_get_program_binary no está en OpenGL 3.3, cargamos las funciones a mano
+        inline struct {
+            void (APIENTRYP obtener)(ui32 programa, int tam, int* len, ui32* formato, void* datos) = nullptr;
+            void (APIENTRYP cargar)(ui32 programa, ui32 formato, const void* datos, int len) = nullptr;
+            void (APIENTRYP parametro)(ui32 programa, ui32 nombre, int valor) = nullptr;
+        } fn_binario;
+
+        struct CabeceraBinario {
+            ui32 formato;
+            float ms;       // Lo que tardó en compilarse, para saber cuánto ahorramos al cargarlo
+        };
+
+        inline ui64 claveShader(const std::optional<str>& vsrc, const std::optional<str>& fsrc, const std::optional<str>& gsrc, const std::vector<str>& transform_feedback_var) {
+            CacheShaders& c = gl.cache_shaders;
+            if (not c.comprobada) {
+                int formatos = 0;
+                NOWEB(
+                    if (extension("GL_ARB_get_program_binary")) {
+                        fn_binario.obtener = (decltype(fn_binario.obtener))glfwGetProcAddress("glGetProgramBinary");
+                        fn_binario.cargar = (decltype(fn_binario.cargar))glfwGetProcAddress("glProgramBinary");
+                        fn_binario.parametro = (decltype(fn_binario.parametro))glfwGetProcAddress("glProgramParameteri");
+                        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatos);
+                    }
+                )
+                c.activa = formatos > 0 and fn_binario.obtener and fn_binario.cargar and fn_binario.parametro;
+                c.comprobada = true;
+
+                str driver;
+                for (ui32 e : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+                    driver += str((const char*)glGetString(e)) + "\n";
+                c.driver = hash::xxh64(driver.data(), driver.size());
             }
 
-            // Devolvemos su contenido
-            str src((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-            return src;
+            ui64 clave = c.driver;
+            for (auto src : { &vsrc, &fsrc, &gsrc })
+                clave = hash::combinar(clave, *src ? hash::xxh64((*src)->data(), (*src)->size(), 1) : 0);
+            for (auto& v : transform_feedback_var)
+                clave = hash::combinar(clave, hash::xxh64(v.data(), v.size()));
+            return clave;
         }
 
-        inline void compilarShader(str nombre, ui32& id, str src) {
-            const char* src_c = src.c_str();
-            int result, log_len;
+        inline fs::path rutaBinario(ui64 clave) {
+            char nombre[32];
+            std::snprintf(nombre, sizeof(nombre), "%016llx.bin", (unsigned long long)clave);
+            return ruta_cache_shaders / nombre;
+        }
 
-            // Compilamos
-            glShaderSource(id, 1, &src_c, NULL);
-            glCompileShader(id);
+        // Intentar cargar el programa de la caché
+        // Si el driver rechaza el binario (por ejemplo, tras una actualización que no cambia la versión) se borra y se compila
+        inline bool cargarBinario(ProgramaPendiente& p, ShaderId nombre) {
+            fs::path ruta = rutaBinario(p.clave);
+            auto datos = leerBinario(ruta);
+            if (not datos or datos->tam <= sizeof(CabeceraBinario))
+                return false;
 
-            // Comprobamos errores
-            glGetShaderiv(id, GL_COMPILE_STATUS, &result);
-            glGetShaderiv(id, GL_INFO_LOG_LENGTH, &log_len);
-            if (log_len > 0) {
-                str error(log_len, ' ');
-                glGetShaderInfoLog(id, log_len, NULL, &error[0]);
-                log::warn("No se pudo compilar el shader '{}': {}", nombre, error);
+            CabeceraBinario cab;
+            std::memcpy(&cab, datos->datos, sizeof(cab));
+            fn_binario.cargar(p.pid, cab.formato, datos->datos + sizeof(cab), datos->tam - sizeof(cab));
+
+            int result;
+            glGetProgramiv(p.pid, GL_LINK_STATUS, &result);
+            if (not result) {
+                // Un formato desconocido genera GL_INVALID_ENUM, lo descartamos porque ya lo gestionamos aquí
+                while (glGetError() != GL_NO_ERROR) {}
+                log::warn("El driver ha rechazado el binario de la shader '{}', se vuelve a compilar", nombre);
+                std::error_code ec;
+                fs::remove(ruta, ec);
+                return false;
             }
 
-            debug::gl();
+            gl.cache_shaders.ms_ahorrados += std::max(cab.ms - (debug::time() - p.inicio) * 1000.0, 0.0);
+            return true;
         }
 
-        inline ui32 cargarShader(str nombre, const std::vector<str>& transform_feedback_var = {}) {    
-            ui32 pid = glCreateProgram();
-            ui32 vid, fid, gid;
+        // Guardar el binario de un programa recién vinculado
+        inline void guardarBinario(const ProgramaPendiente& p, double ms) {
+            int len = 0;
+            glGetProgramiv(p.pid, GL_PROGRAM_BINARY_LENGTH, &len);
+            if (len <= 0)
+                return;
 
-            // Leemos los ficheros de shaders
-            fs::path shader_path = fs::path("shaders");
-            auto vsrc = leerArchivo(shader_path / (nombre + ".vert"));
-            auto fsrc = leerArchivo(shader_path / (nombre + ".frag"));
-            auto gsrc = leerArchivo(shader_path / (nombre + ".geom"));
+            CabeceraBinario cab { .ms = (float)ms };
+            std::vector<ui8> datos(sizeof(cab) + len);
+            fn_binario.obtener(p.pid, len, nullptr, &cab.formato, datos.data() + sizeof(cab));
+            std::memcpy(datos.data(), &cab, sizeof(cab));
+            debug::gl();
 
-            // Creamos las shaders y las añadimos al programa
-            if (vsrc) {
-                vid = glCreateShader(GL_VERTEX_SHADER);
-                compilarShader(nombre, vid, *vsrc);
-                glAttachShader(pid, vid);
-            } else {
+            std::error_code ec;
+            fs::create_directories(ruta_cache_shaders, ec);
+            std::ofstream out(rutaBinario(p.clave).string(), std::ios::binary);
+            if (ec or not out.is_open()) {
+                log::warn("No se pudo escribir la caché de shaders en {}", ruta_cache_shaders.string());
+                return;
+            }
+            out.write((const char*)datos.data(), datos.size());
+        }
+
+        // Compilar una etapa de una shader sin comprobar el resultado
+        // Los errores se consultan al terminar el programa, así no obligamos al driver a acabar en este momento
+        inline ui32 compilarEtapa(ui32 tipo, const str& src) {
+            ui32 id = glCreateShader(tipo);
+            const char* src_c = src.c_str();
+            glShaderSource(id, 1, &src_c, NULL);
+            glCompileShader(id);
+            return id;
+        }
+
+        // Enviar un programa al driver para que lo compile y vincule
+        // No se consulta nada hasta terminarPrograma, el driver puede hacerlo en segundo plano si soporta compilación paralela
+        inline ProgramaPendiente enviarPrograma(ShaderId nombre, std::optional<str> vsrc, std::optional<str> fsrc, std::optional<str> gsrc, const std::vector<str>& transform_feedback_var = {}) {
+            ProgramaPendiente p { .pid = glCreateProgram(), .inicio = debug::time() };
+            if (not vsrc) {
                 log::error("No se ha encontrado el shader de vértices: {}", nombre);
                 std::exit(-1);
             }
-            if (fsrc) {
-                fid = glCreateShader(GL_FRAGMENT_SHADER);
-                compilarShader(nombre, fid, *fsrc);
-                glAttachShader(pid, fid);
+
+            // Si ya lo hemos compilado antes con este driver, lo cargamos de la caché
+            p.clave = claveShader(vsrc, fsrc, gsrc, transform_feedback_var);
+            if (gl.cache_shaders.activa) {
+                p.binario = cargarBinario(p, nombre);
+                p.binario ? gl.cache_shaders.aciertos++ : gl.cache_shaders.fallos++;
+                if (p.binario)
+                    return p;
+                fn_binario.parametro(p.pid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
             }
+
+            // Creamos las shaders y las añadimos al programa
+            p.etapas.push_back(compilarEtapa(GL_VERTEX_SHADER, *vsrc));
+            if (fsrc)
+                p.etapas.push_back(compilarEtapa(GL_FRAGMENT_SHADER, *fsrc));
             if (gsrc) {
-                gid = glCreateShader(GL_GEOMETRY_SHADER);
-                compilarShader(nombre, gid, *gsrc);
-                glAttachShader(pid, gid);
+                p.etapas.push_back(compilarEtapa(GL_GEOMETRY_SHADER, *gsrc));
                 if (transform_feedback_var.size() > 0) {
                     std::vector<const char*> tf_var_c;
                     std::transform(transform_feedback_var.begin(), transform_feedback_var.end(), std::back_inserter(tf_var_c), [](const str& s) { return s.c_str(); });
-                    glTransformFeedbackVaryings(pid, tf_var_c.size(), tf_var_c.data(), GL_INTERLEAVED_ATTRIBS);
+                    glTransformFeedbackVaryings(p.pid, tf_var_c.size(), tf_var_c.data(), GL_INTERLEAVED_ATTRIBS);
                 }
             }
+            for (ui32 e : p.etapas)
+                glAttachShader(p.pid, e);
 
             // Vinculamos el programa
-            glLinkProgram(pid);
+            glLinkProgram(p.pid);
+
+            debug::gl();
+            return p;
+        }
 
-            // Comprobamos que no haya errores
+        // Comprobar el resultado de un programa enviado y terminar de configurarlo
+        // Si el driver no ha acabado todavía, espera a que lo haga. Devuelve el tiempo desde que se envió (ms)
+        inline double terminarPrograma(ShaderId nombre, ProgramaPendiente& p) {
             int result, log_len;
-            glGetProgramiv(pid, GL_LINK_STATUS, &result);
-            glGetProgramiv(pid, GL_INFO_LOG_LENGTH, &log_len);
-            if (log_len > 0) {
-                str error(log_len, ' ');
-                glGetProgramInfoLog(pid, log_len, NULL, &error[0]);
-                log::error("No se pudo vincular el programa: {}", error);
+
+            // Mensajes de compilación de cada etapa
+            for (ui32 e : p.etapas) {
+                glGetShaderiv(e, GL_INFO_LOG_LENGTH, &log_len);
+                if (log_len > 0) {
+                    str error(log_len, ' ');
+                    glGetShaderInfoLog(e, log_len, NULL, &error[0]);
+                    log::warn("No se pudo compilar el shader '{}': {}", nombre, error);
+                }
+            }
+
+            // Comprobamos que no haya errores al vincular
+            glGetProgramiv(p.pid, GL_LINK_STATUS, &result);
+            glGetProgramiv(p.pid, GL_INFO_LOG_LENGTH, &log_len);
+            if (not result or log_len > 0) {
+                str error(std::max(log_len, 1), ' ');
+                glGetProgramInfoLog(p.pid, log_len, NULL, &error[0]);
+                log::error("No se pudo vincular el programa '{}': {}", nombre, error);
                 std::exit(-1);
             }
 
+            // Conectamos el bloque de datos del frame si la shader lo usa
+            ui32 bloque = glGetUniformBlockIndex(p.pid, "FrameData");
+            if (bloque != GL_INVALID_INDEX)
+                glUniformBlockBinding(p.pid, bloque, binding_frame);
+
             // Eliminamos los shaders ya que ya no los necesitamos
-            if (vsrc) {
-                glDetachShader(pid, vid);
-                glDeleteShader(vid);
+            for (ui32 e : p.etapas) {
+                glDetachShader(p.pid, e);
+                glDeleteShader(e);
             }
-            if (fsrc) {
-                glDetachShader(pid, fid);
-                glDeleteShader(fid);
+            p.etapas.clear();
+
+            // Guardamos el binario para no tener que compilarlo la próxima vez
+            double ms = (debug::time() - p.inicio) * 1000.0;
+            if (gl.cache_shaders.activa and not p.binario)
+                guardarBinario(p, ms);
+
+            debug::gl();
+            return ms;
+        }
+
+        // Terminar una shader que se cargó dentro de un lote
+        inline double esperar(ShaderId nombre) {
+            auto it = gl.shaders_pendientes.find(nombre);
+            double ms = terminarPrograma(nombre, it->second);
+            log::info("Shader {}: {} ms{}", nombre, ms, it->second.binario ? " (caché)" : "");
+            gl.shaders_pendientes.erase(it);
+            return ms;
+        }
+
+        // Guardar una shader enviada al driver
+        // Fuera de un lote se comprueba enseguida, dentro se deja pendiente hasta que se use o se termine el lote
+        inline void registrar(ShaderId nombre, ProgramaPendiente p, VaoId vao, ui32 fbo, OpcionesShader opt) {
+            nombre = internar(nombre);
+            gl.shaders[nombre] = Shader {
+                .pid = p.pid,
+                .vao = internar(vao),
+                .fbo = fbo,
+                .opt = opt
+            };
+            if (gl.lote_shaders)
+                gl.shaders_pendientes[nombre] = p;
+            else
+                terminarPrograma(nombre, p);
+        }
+
+        // Archivos que ofrece la librería para incluir desde cualquier shader
+        inline const std::unordered_map<str, str> incluidos_tofu = {
+            // Bloque con los datos comunes del frame, tiene que coincidir con FrameData en tipos.h
+            { "tofu/frame.glsl", R"(layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 proj;
+    mat4 viewproj;
+    mat4 invviewproj;
+    vec4 viewpos;
+    float time;
+    float dt;
+    vec2 tam_win;
+    vec2 tam_fb;
+};
+)" },
+            // Oclusión con la pirámide de profundidad, los uniforms se asignan con hiz::uniforms (ver hiz.h)
+            { "tofu/hiz.glsl", R"(uniform sampler2D tofu_hiz;
+uniform int tofu_hiz_niveles;
+uniform mat4 tofu_hiz_viewproj;
+
+// Comprobar si una esfera está completamente tapada
+// Se proyectan las esquinas de su caja: el rectángulo que ocupan en pantalla elige el nivel en el que caben en 2x2 texels,
+// y la esfera está tapada si su profundidad más cercana queda detrás de la más lejana de esos texels
+// Si la caja cruza el plano de la cámara o no hay pirámide no se descarta
+bool ocluido(vec3 centro, float radio) {
+    if (tofu_hiz_niveles == 0)
+        return false;
+
+    vec3 minimo = vec3(1e9), maximo = vec3(-1e9);
+    for (int i = 0; i < 8; i++) {
+        vec3 esquina = centro + radio * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 p = tofu_hiz_viewproj * vec4(esquina, 1.0);
+        if (p.w <= 0.0)
+            return false;
+        p.xyz /= p.w;
+        minimo = min(minimo, p.xyz);
+        maximo = max(maximo, p.xyz);
+    }
+
+    ivec2 tam = textureSize(tofu_hiz, 0);
+    ivec2 a = min(ivec2(clamp(minimo.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(tam)), tam - 1);
+    ivec2 b = min(ivec2(clamp(maximo.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(tam)), tam - 1);
+    int extension = max(b.x - a.x, b.y - a.y);
+    int nivel = min(extension > 1 ? int(ceil(log2(float(extension)))) : 0, tofu_hiz_niveles - 1);
+
+    ivec2 ultimo = textureSize(tofu_hiz, nivel) - 1;
+    a = min(a >> nivel, ultimo);
+    b = min(b >> nivel, ultimo);
+    float lejana = max(max(texelFetch(tofu_hiz, a, nivel).r, texelFetch(tofu_hiz, ivec2(b.x, a.y), nivel).r),
+                       max(texelFetch(tofu_hiz, ivec2(a.x, b.y), nivel).r, texelFetch(tofu_hiz, b, nivel).r));
+    return minimo.z * 0.5 + 0.5 > lejana;
+}
+)" },
+        };
+
+        // Preprocesar el código de una shader
+        // - Las defines de la permutación se añaden justo después de #version
+        // - #include "archivo" se sustituye por su contenido. Se busca en la librería, junto al archivo que lo incluye y en shaders/
+        //   Cada archivo se incluye una sola vez, como si tuviera #pragma once
+        // Se añaden directivas #line para que los errores apunten a la línea correcta. El segundo número es el
+        // índice del archivo en el orden en que se han incluido (0 es la shader principal)
+        inline str preprocesar(const str& src, const str& archivo, const std::vector<str>& defines, std::vector<str>& incluidos) {
+            ui32 indice = incluidos.size();
+            incluidos.push_back(archivo);
+
+            std::istringstream in(src);
+            std::ostringstream out;
+            str linea;
+            for (ui32 num = 1; std::getline(in, linea); num++) {
+                size_t ini = linea.find_first_not_of(" \t");
+                str directiva = ini == str::npos ? "" : linea.substr(ini);
+
+                if (directiva.rfind("#version", 0) == 0) {
+                    out << linea << "\n";
+                    for (str d : defines) {
+                        std::replace(d.begin(), d.end(), '=', ' ');
+                        out << "#define " << d << "\n";
+                    }
+                    out << "#line " << num + 1 << " " << indice << "\n";
+                    continue;
+                }
+
+                if (directiva.rfind("#include", 0) == 0) {
+                    size_t a = directiva.find_first_of("\"<"), b = directiva.find_last_of("\">");
+                    if (a == str::npos or b <= a) {
+                        log::error("Include mal formado en {}:{}: {}", archivo, num, linea);
+                        std::exit(-1);
+                    }
+                    str incluido = directiva.substr(a + 1, b - a - 1);
+
+                    // Buscamos el archivo
+                    std::optional<str> contenido;
+                    str ruta = incluido;
+                    auto interno = incluidos_tofu.find(incluido);
+                    if (interno != incluidos_tofu.end()) {
+                        contenido = interno->second;
+                    } else {
+                        for (fs::path dir : { fs::path(archivo).parent_path(), fs::path("shaders") }) {
+                            ruta = (dir / incluido).lexically_normal().string();
+                            if ((contenido = leerArchivo(ruta)))
+                                break;
+                        }
+                    }
+                    if (not contenido) {
+                        log::error("No se ha encontrado el archivo '{}' incluido desde {}:{}", incluido, archivo, num);
+                        std::exit(-1);
+                    }
+
+                    if (std::find(incluidos.begin(), incluidos.end(), ruta) == incluidos.end()) {
+                        out << "#line 1 " << incluidos.size() << "\n";
+                        out << preprocesar(*contenido, ruta, {}, incluidos);
+                        out << "#line " << num + 1 << " " << indice << "\n";
+                    }
+                    continue;
+                }
+
+                out << linea << "\n";
             }
-            if (gsrc) {
-                glDetachShader(pid, gid);
-                glDeleteShader(gid);
+            return out.str();
+        }
+
+        inline std::optional<str> leerShader(fs::path ruta, const std::vector<str>& defines) {
+            auto src = leerArchivo(ruta);
+            if (not src)
+                return std::nullopt;
+            std::vector<str> incluidos;
+            return preprocesar(*src, ruta.string(), defines, incluidos);
+        }
+
+        inline ProgramaPendiente cargarShader(str nombre, const std::vector<str>& transform_feedback_var = {}, const std::vector<str>& defines = {}) {
+            // Leemos los ficheros de shaders
+            fs::path shader_path = fs::path("shaders");
+            auto vsrc = leerShader(shader_path / (nombre + ".vert"), defines);
+            auto fsrc = leerShader(shader_path / (nombre + ".frag"), defines);
+            auto gsrc = leerShader(shader_path / (nombre + ".geom"), defines);
+            return enviarPrograma(nombre, vsrc, fsrc, gsrc, transform_feedback_var);
+        }
+
+        // Tipos de sampler de GLSL 3.30, que se guardan como la unidad de textura (un entero)
+        inline bool esSampler(ui32 tipo) {
+            switch (tipo) {
+                case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+                case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+                case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+                case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_SAMPLER_BUFFER:
+                case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW:
+                case GL_INT_SAMPLER_1D: case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_CUBE:
+                case GL_INT_SAMPLER_1D_ARRAY: case GL_INT_SAMPLER_2D_ARRAY: case GL_INT_SAMPLER_2D_MULTISAMPLE:
+                case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY: case GL_INT_SAMPLER_BUFFER: case GL_INT_SAMPLER_2D_RECT:
+                case GL_UNSIGNED_INT_SAMPLER_1D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D:
+                case GL_UNSIGNED_INT_SAMPLER_CUBE: case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY: case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+                case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE: case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+                case GL_UNSIGNED_INT_SAMPLER_BUFFER: case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+                    return true;
+                default:
+                    return false;
             }
+        }
+
+        // Copiar los valores de los uniforms de un programa a otro (los que existan en los dos)
+        // Se usa al cambiar de permutación, para que la nueva tenga los mismos buffers, texturas y parámetros
+        inline void copiarUniforms(ui32 origen, ui32 destino) {
+            int n;
+            glGetProgramiv(origen, GL_ACTIVE_UNIFORMS, &n);
+            glUseProgram(destino);
+
+            for (int i = 0; i < n; i++) {
+                char nombre_c[256];
+                int tam;
+                ui32 tipo;
+                glGetActiveUniform(origen, i, sizeof(nombre_c), nullptr, &tam, &tipo, nombre_c);
+                str nombre = nombre_c;
+                if (nombre.size() > 3 and nombre.compare(nombre.size() - 3, 3, "[0]") == 0)
+                    nombre.resize(nombre.size() - 3);
 
-            // Cargamos el programa por defecto
-            glUseProgram(pid);
+                for (int e = 0; e < tam; e++) {
+                    str elemento = tam > 1 ? format("{}[{}]", nombre, e) : nombre;
+                    int lo = glGetUniformLocation(origen, elemento.c_str());
+                    int ld = glGetUniformLocation(destino, elemento.c_str());
+                    if (lo < 0 or ld < 0)
+                        continue;
 
+                    float f[16];
+                    int v[4];
+                    ui32 u[4];
+                    switch (tipo) {
+                        case GL_FLOAT: glGetUniformfv(origen, lo, f); glUniform1fv(ld, 1, f); break;
+                        case GL_FLOAT_VEC2: glGetUniformfv(origen, lo, f); glUniform2fv(ld, 1, f); break;
+                        case GL_FLOAT_VEC3: glGetUniformfv(origen, lo, f); glUniform3fv(ld, 1, f); break;
+                        case GL_FLOAT_VEC4: glGetUniformfv(origen, lo, f); glUniform4fv(ld, 1, f); break;
+                        case GL_FLOAT_MAT2: glGetUniformfv(origen, lo, f); glUniformMatrix2fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT3: glGetUniformfv(origen, lo, f); glUniformMatrix3fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT4: glGetUniformfv(origen, lo, f); glUniformMatrix4fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT2x3: glGetUniformfv(origen, lo, f); glUniformMatrix2x3fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT2x4: glGetUniformfv(origen, lo, f); glUniformMatrix2x4fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT3x2: glGetUniformfv(origen, lo, f); glUniformMatrix3x2fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT3x4: glGetUniformfv(origen, lo, f); glUniformMatrix3x4fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT4x2: glGetUniformfv(origen, lo, f); glUniformMatrix4x2fv(ld, 1, GL_FALSE, f); break;
+                        case GL_FLOAT_MAT4x3: glGetUniformfv(origen, lo, f); glUniformMatrix4x3fv(ld, 1, GL_FALSE, f); break;
+                        // Los booleanos se leen y se escriben como enteros
+                        case GL_INT: case GL_BOOL: glGetUniformiv(origen, lo, v); glUniform1iv(ld, 1, v); break;
+                        case GL_INT_VEC2: case GL_BOOL_VEC2: glGetUniformiv(origen, lo, v); glUniform2iv(ld, 1, v); break;
+                        case GL_INT_VEC3: case GL_BOOL_VEC3: glGetUniformiv(origen, lo, v); glUniform3iv(ld, 1, v); break;
+                        case GL_INT_VEC4: case GL_BOOL_VEC4: glGetUniformiv(origen, lo, v); glUniform4iv(ld, 1, v); break;
+                        case GL_UNSIGNED_INT: glGetUniformuiv(origen, lo, u); glUniform1uiv(ld, 1, u); break;
+                        case GL_UNSIGNED_INT_VEC2: glGetUniformuiv(origen, lo, u); glUniform2uiv(ld, 1, u); break;
+                        case GL_UNSIGNED_INT_VEC3: glGetUniformuiv(origen, lo, u); glUniform3uiv(ld, 1, u); break;
+                        case GL_UNSIGNED_INT_VEC4: glGetUniformuiv(origen, lo, u); glUniform4uiv(ld, 1, u); break;
+                        default:
+                            if (esSampler(tipo)) {
+                                glGetUniformiv(origen, lo, v);
+                                glUniform1i(ld, v[0]);
+                            } else {
+                                log::warn("No se puede copiar el uniform {} (tipo {}) a la nueva permutación", elemento, tipo);
+                            }
+                            break;
+                    }
+                }
+            }
+            debug::gl();
+        }
+
+        // Permutación de una shader que corresponde a sus defines actuales
+        // Si no existe, se compila y se le copian los uniforms de la última permutación usada
+        // El nombre de la permutación solo se construye cuando cambian los defines, no en cada frame
+        inline ShaderId permutacion(Shader& base, ShaderId nombre) {
+            if (base.archivo.empty() or not base.cambiada)
+                return base.archivo.empty() ? nombre : base.activa;
+            base.cambiada = false;
+
+            str texto = nombre.texto;
+            if (base.defines != base.defines_carga) {
+                texto += "[";
+                for (auto& d : base.defines)
+                    texto += d + (&d == &*base.defines.rbegin() ? "" : ",");
+                texto += "]";
+            }
+            ShaderId clave = texto;
+
+            if (not gl.shaders.count(clave)) {
+                Shader s = base;
+                s.archivo = "";
+                s.uniforms.clear();
+                auto p = cargarShader(base.archivo, base.tf, std::vector<str>(base.defines.begin(), base.defines.end()));
+                s.pid = p.pid;
+                gl.shaders[clave] = s;
+                log::info("Permutación {}: {} ms", clave, terminarPrograma(clave, p));
+            }
+
+            // El Shader base puede haberse movido al añadir la permutación al mapa
+            Shader& b = gl.shaders[nombre];
+            if (b.activa != clave) {
+                if (gl.shaders_pendientes.count(b.activa))
+                    esperar(b.activa);
+                copiarUniforms(gl.shaders[b.activa].pid, gl.shaders[clave].pid);
+                b.activa = clave;
+            }
+            return clave;
+        }
+
+        // Subir los datos comunes del frame al uniform buffer
+        // Se hace una sola vez por frame, al usar la primera shader, para recoger la cámara que haya puesto la aplicación
+        inline void subirFrame() {
+            FrameData& f = gl.frame;
+            f.view = gl.view;
+            f.proj = gl.proj;
+            f.viewproj = gl.proj * gl.view;
+            f.invviewproj = glm::inverse(f.viewproj);
+            f.viewpos = glm::inverse(gl.view)[3];
+            f.time = t;
+            f.dt = dt;
+            f.tam_win = gl.tam_win;
+            f.tam_fb = gl.tam_fb;
+
+            glBindBuffer(GL_UNIFORM_BUFFER, gl.ubo_frame);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &f);
+            gl.frame_pendiente = false;
             debug::gl();
-            return pid;
         }
     }
 
     namespace shader
     {
         // Cargar una shader en el programa
-        inline void cargar(str nombre, str vao = "main", ui32 fbo = 0, OpcionesShader opt = {}, std::vector<str> transform_feedback_var = {}) {
-            Shader s {
-                .pid = detail::cargarShader(nombre, transform_feedback_var),
-                .vao = vao,
-                .fbo = fbo,
-                .opt = opt
-            };
-            gl.shaders[nombre] = s;
-            glUseProgram(0);
+        // Las defines activan partes de la shader en tiempo de compilación (#ifdef), ver definir
+        inline void cargar(ShaderId nombre, VaoId vao = "main"_id, ui32 fbo = 0, OpcionesShader opt = {}, std::vector<str> transform_feedback_var = {}, std::vector<str> defines = {}) {
+            nombre = internar(nombre);
+            detail::registrar(nombre, detail::cargarShader(nombre.texto, transform_feedback_var, defines), vao, fbo, opt);
+            Shader& s = gl.shaders[nombre];
+            s.archivo = nombre.texto;
+            s.tf = transform_feedback_var;
+            s.defines = s.defines_carga = std::set<str>(defines.begin(), defines.end());
+            s.activa = nombre;
         }
 
-        // Usar una shader
-        inline void usar(str nombre = "") {
-            if (gl.shader_actual == nombre)
+        // Cargar una shader a partir de su código en vez de leerla de la carpeta shaders
+        // La usa la propia librería para las shaders internas, que tienen que funcionar en cualquier proyecto
+        inline void cargarFuente(ShaderId nombre, str vert, str frag, VaoId vao = "main"_id, ui32 fbo = 0, OpcionesShader opt = {}) {
+            std::vector<str> incluidos_vert, incluidos_frag;
+            auto p = detail::enviarPrograma(nombre, detail::preprocesar(vert, nombre.texto, {}, incluidos_vert), detail::preprocesar(frag, nombre.texto, {}, incluidos_frag), std::nullopt);
+            detail::registrar(nombre, p, vao, fbo, opt);
+        }
+
+        // Activar o desactivar una define de una shader
+        // La próxima vez que se use, se cambia a la permutación compilada con ese conjunto de defines (se compila la primera vez)
+        // Así las opciones que cambian poco no se comprueban en cada vértice o fragmento
+        inline void definir(ShaderId nombre, str define, bool activa = true) {
+            auto it = gl.shaders.find(nombre);
+            if (it == gl.shaders.end() or it->second.archivo.empty()) {
+                log::error("La shader '{}' no se ha cargado desde un archivo y no admite permutaciones", nombre);
+                std::exit(-1);
+            }
+            bool cambio = activa ? it->second.defines.insert(define).second : it->second.defines.erase(define) > 0;
+            it->second.cambiada |= cambio;
+        }
+
+        // Mostrar las estadísticas de la caché de binarios
+        inline void informeCache() {
+            CacheShaders& cache = gl.cache_shaders;
+            if (not cache.activa)
                 return;
-            
-            gl.shader_actual = nombre;
-            if (nombre.empty()) {
-                glUseProgram(0);
+            log::info("Caché de shaders: {} aciertos, {} fallos, {} ms ahorrados", cache.aciertos, cache.fallos, (int)cache.ms_ahorrados);
+        }
+
+        // Empezar un lote de shaders
+        // Hasta terminarLote, cargar solo envía el código al driver y no espera a que se compile
+        // Con GL_KHR_parallel_shader_compile (o ARB) el driver compila todas a la vez en varios hilos
+        inline void empezarLote() {
+            gl.lote_shaders = true;
+            gl.compilacion_paralela = extension("GL_KHR_parallel_shader_compile") or extension("GL_ARB_parallel_shader_compile");
+            NOWEB(
+                using hilos_fun_t = void (APIENTRYP)(ui32);
+                auto hilos = (hilos_fun_t)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+                if (not hilos)
+                    hilos = (hilos_fun_t)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+                if (gl.compilacion_paralela and hilos)
+                    hilos(0xFFFFFFFF);
+            )
+            debug::gl();
+        }
+
+        // Esperar a que terminen todas las shaders del lote e informar del tiempo de cada una
+        // Con compilación paralela se terminan en el orden en el que el driver las acaba, consultando GL_COMPLETION_STATUS_KHR
+        // Sin ella, consultar el estado ya bloquea, así que se terminan en orden
+        inline void terminarLote() {
+            double inicio = debug::time();
+            double suma = 0.0;
+            ui32 n = gl.shaders_pendientes.size();
+
+            while (not gl.shaders_pendientes.empty()) {
+                auto it = gl.shaders_pendientes.begin();
+                if (gl.compilacion_paralela) {
+                    it = std::find_if(gl.shaders_pendientes.begin(), gl.shaders_pendientes.end(), [](auto& p) {
+                        int listo = 0;
+                        glGetProgramiv(p.second.pid, GL_COMPLETION_STATUS_KHR, &listo);
+                        return listo != 0;
+                    });
+                    if (it == gl.shaders_pendientes.end()) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                }
+                suma += detail::esperar(it->first);
+            }
+
+            gl.lote_shaders = false;
+            if (n > 0)
+                log::info("{} shaders listas en {} ms ({} ms sumando cada una{})", n, (debug::time() - inicio) * 1000.0, suma, gl.compilacion_paralela ? ", compilación paralela" : "");
+            informeCache();
+        }
+
+        // Usar una shader
+        inline void usar(ShaderId nombre = {}) {
+            if (gl.frame_pendiente)
+                detail::subirFrame();
+
+            if (nombre.vacio()) {
+                if (not gl.shader_actual.vacio())
+                    glUseProgram(0);
+                gl.shader_actual = nombre;
                 return;
             }
-            
-            // Cambiamos la shader;
-            if (not gl.shaders.count(nombre)) {
+
+            auto it = gl.shaders.find(nombre);
+            if (it == gl.shaders.end()) {
                 log::error("No existe el shader especificado: {}", nombre);
                 std::exit(-1);
             }
-            Shader& s = gl.shaders[nombre];
+
+            // Si la shader tiene permutaciones, usamos la de sus defines actuales
+            // Guardamos la clave del mapa, que es dueña de su texto, en vez del identificador recibido
+            ShaderId clave = detail::permutacion(it->second, it->first);
+            if (gl.shader_actual == clave)
+                return;
+            gl.shader_actual = clave;
+
+            // Si la shader se cargó en un lote que no ha terminado, esperamos solo a esta
+            if (gl.shaders_pendientes.count(clave))
+                detail::esperar(clave);
+
+            Shader& s = gl.shaders[clave];
             glUseProgram(s.pid);
             glBindVertexArray(gl.VAOs[s.vao].vao);
            
             // Cambiamos el framebuffer
-            if (s.fbo == 0) {
+            if (gl.grafo.ejecutando) {
+                // Dentro de un paso del grafo de renderizado se mantiene el framebuffer del paso
+            } else if (s.fbo == 0) {
                 glBindFramebuffer(GL_FRAMEBUFFER, 0);
                 glViewport(0, 0, gl.tam_fb.x, gl.tam_fb.y);
             } else {
@@ -176,54 +675,57 @@ namespace tofu
 
         // Actualizar el valor de un uniform en la shader specificada
         template <typename T>
-        void uniform(str nombre, T valor) {
-            str& shader = gl.shader_actual;
-            if (shader.empty()) {
+        void uniform(Id nombre, T valor) {
+            if (gl.shader_actual.vacio()) {
                 log::error("No se ha especificado una shader para actualizar el uniform: '{}'", nombre);
                 std::exit(-1);
             }
+            Shader& s = gl.shaders[gl.shader_actual];
 
             // Si no hemos registrado el uniform, obtenemos su localización
-            if (not gl.shaders[shader].uniforms.count(nombre))
-                gl.shaders[shader].uniforms[nombre] = glGetUniformLocation(gl.shaders[shader].pid, nombre.c_str());
+            auto it = s.uniforms.find(nombre);
+            if (it == s.uniforms.end())
+                it = s.uniforms.emplace(internar(nombre), glGetUniformLocation(s.pid, nombre.texto)).first;
+            int loc = it->second;
 
             // Uniforms básicos
             if constexpr (std::is_same_v<T, int>) {
-                glUniform1i(gl.shaders[shader].uniforms[nombre], valor);
+                glUniform1i(loc, valor);
             } else if constexpr (std::is_same_v<T, ui32>) {
-                glUniform1ui(gl.shaders[shader].uniforms[nombre], valor);
+                glUniform1ui(loc, valor);
             } else if constexpr (std::is_same_v<T, float>) {
-                glUniform1f(gl.shaders[shader].uniforms[nombre], valor);
+                glUniform1f(loc, valor);
             } else if constexpr (std::is_same_v<T, glm::vec2>) {
-                glUniform2f(gl.shaders[shader].uniforms[nombre], valor.x, valor.y);
+                glUniform2f(loc, valor.x, valor.y);
             } else if constexpr (std::is_same_v<T, glm::vec3>) {
-                glUniform3f(gl.shaders[shader].uniforms[nombre], valor.x, valor.y, valor.z);
+                glUniform3f(loc, valor.x, valor.y, valor.z);
             } else if constexpr (std::is_same_v<T, glm::vec4>) {
-                glUniform4f(gl.shaders[shader].uniforms[nombre], valor.x, valor.y, valor.z, valor.w);
+                glUniform4f(loc, valor.x, valor.y, valor.z, valor.w);
             } else if constexpr (std::is_same_v<T, glm::mat4>) {
-                glUniformMatrix4fv(gl.shaders[shader].uniforms[nombre], 1, GL_FALSE, glm::value_ptr(valor));
+                glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(valor));
             } 
 
             // Arrays de uniforms
             else if constexpr (std::is_same_v<T, std::vector<int>>) {
-                glUniform1iv(gl.shaders[shader].uniforms[nombre], valor.size(), &valor[0]);
+                glUniform1iv(loc, valor.size(), &valor[0]);
             } else if constexpr (std::is_same_v<T, std::vector<ui32>>) {
-                glUniform1uiv(gl.shaders[shader].uniforms[nombre], valor.size(), &valor[0]);
+                glUniform1uiv(loc, valor.size(), &valor[0]);
             } else if constexpr (std::is_same_v<T, std::vector<float>>) {
-                glUniform1fv(gl.shaders[shader].uniforms[nombre], valor.size(), &valor[0]);
+                glUniform1fv(loc, valor.size(), &valor[0]);
             } else if constexpr (std::is_same_v<T, std::vector<glm::vec2>>) {
-                glUniform2fv(gl.shaders[shader].uniforms[nombre], valor.size(), glm::value_ptr(valor[0]));
+                glUniform2fv(loc, valor.size(), glm::value_ptr(valor[0]));
             } else if constexpr (std::is_same_v<T, std::vector<glm::vec3>>) {
-                glUniform3fv(gl.shaders[shader].uniforms[nombre], valor.size(), glm::value_ptr(valor[0]));
+                glUniform3fv(loc, valor.size(), glm::value_ptr(valor[0]));
             } else if constexpr (std::is_same_v<T, std::vector<glm::vec4>>) {
-                glUniform4fv(gl.shaders[shader].uniforms[nombre], valor.size(), glm::value_ptr(valor[0]));
+                glUniform4fv(loc, valor.size(), glm::value_ptr(valor[0]));
             } else if constexpr (std::is_same_v<T, std::vector<glm::ivec4>>) {
-                glUniform4iv(gl.shaders[shader].uniforms[nombre], valor.size(), glm::value_ptr(valor[0]));
+                glUniform4iv(loc, valor.size(), glm::value_ptr(valor[0]));
             } else if constexpr (std::is_same_v<T, std::vector<glm::mat4>>) {
-                glUniformMatrix4fv(gl.shaders[shader].uniforms[nombre], valor.size(), GL_FALSE, glm::value_ptr(valor[0]));
+                glUniformMatrix4fv(loc, valor.size(), GL_FALSE, glm::value_ptr(valor[0]));
             } 
 
             // Texture buffers
+            // Solo volvemos a conectar el buffer si ha cambiado su almacenamiento (por ejemplo, al redimensionarlo)
             else if constexpr (std::is_same_v<T, TexBuffer>) {
                 Buffer &buf = gl.buffers[valor.b];
                 Textura &tex = gl.texturas[valor.t];
@@ -231,15 +733,19 @@ namespace tofu
                     log::error("El uniform '{}' no es un texture buffer", nombre);
                     std::exit(-1);
                 }
-                glActiveTexture(GL_TEXTURE0 + valor.t);
-                glBindTexture(GL_TEXTURE_BUFFER, tex.textura);
-                glTexBuffer(GL_TEXTURE_BUFFER, tex.formato, buf.buffer);
-                glUniform1i(gl.shaders[shader].uniforms[nombre], valor.t);
+                ui32 unidad = textura::vincular(valor.t);
+                if (tex.buffer != buf.buffer or tex.version != buf.version) {
+                    textura::detail::activar(unidad);
+                    glTexBuffer(GL_TEXTURE_BUFFER, tex.formato, buf.buffer);
+                    tex.buffer = buf.buffer;
+                    tex.version = buf.version;
+                }
+                glUniform1i(loc, unidad);
             } 
 
             // Tipo no soportado
             else {
-                log::error("No se puede asignar el uniform '{}' en la shader '{}'", nombre, shader);
+                log::error("No se puede asignar el uniform '{}' en la shader '{}'", nombre, gl.shader_actual);
                 std::exit(-1);
             }
 
@@ -0,0 +1,207 @@
+// Streaming de niveles de mipmap con un presupuesto de memoria
+// Las texturas KTX se cargan primero con sus niveles más pequeños para que la aplicación pueda empezar enseguida
+// Cada frame se piden con el tamaño máximo que ocupan en pantalla, y los niveles más finos se van subiendo poco a poco
+// La textura se limita con GL_TEXTURE_BASE_LEVEL a los niveles que ya están en la GPU, así nunca está incompleta
+// Si se supera el presupuesto, se expulsan los niveles finos de las texturas que llevan más tiempo sin usarse (LRU)
+#pragma once
+
+#include <cmath>
+
+#include "buffers.h"
+
+namespace tofu
+{
+    namespace streaming
+    {
+        namespace detail
+        {
+            inline std::vector<ktx::Nivel> niveles(const TexturaStreaming& t) {
+                ktx::Cabecera cab;
+                std::vector<ktx::Nivel> n;
+                ktx::leer(t.archivo.datos, t.archivo.tam, cab, n);
+                return n;
+            }
+
+            // Bytes que ocupará un nivel en la GPU (si el formato no está soportado se sube descomprimido)
+            inline ui64 bytesNivel(const TexturaStreaming& t, const ktx::Nivel& n) {
+                if (gl.texturas[t.textura].formato != t.formato)
+                    return (ui64)n.ancho * n.alto * 4 * t.capas;
+                return (ui64)n.bytes_capa * t.capas;
+            }
+
+            // Subir el siguiente nivel más fino
+            inline void subir(TexturaStreaming& t) {
+                Textura& tex = gl.texturas[t.textura];
+                ui32 l = t.base - 1;
+                auto n = niveles(t);
+                textura::detail::vincularCarga(tex);
+                t.bytes[l] = textura::detail::subirNivel(tex, l, t.formato, n[l], t.capas);
+                glTexParameteri(tex.target, GL_TEXTURE_BASE_LEVEL, l);
+                debug::gl();
+                t.base = l;
+                gl.streaming.residente += t.bytes[l];
+                gl.streaming.subidos++;
+            }
+
+            // Expulsar el nivel más fino
+            // Primero subimos el nivel base para que la textura siga completa y luego redefinimos el nivel con tamaño 0 para liberarlo
+            inline void expulsar(TexturaStreaming& t) {
+                Textura& tex = gl.texturas[t.textura];
+                ui32 l = t.base;
+                textura::detail::vincularCarga(tex);
+                glTexParameteri(tex.target, GL_TEXTURE_BASE_LEVEL, l + 1);
+                if (tex.target == GL_TEXTURE_2D_ARRAY)
+                    glTexImage3D(tex.target, l, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                else
+                    glTexImage2D(tex.target, l, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                debug::gl();
+                t.base = l + 1;
+                gl.streaming.residente -= t.bytes[l];
+                t.bytes[l] = 0;
+                gl.streaming.expulsados++;
+            }
+
+            // Expulsar niveles hasta que quepan los bytes necesarios en el presupuesto
+            // Los candidatos son las texturas que no se han usado en el último frame (empezando por la más antigua)
+            // y las que tienen cargado más detalle del que necesitan. Los niveles iniciales nunca se expulsan
+            inline bool liberarMemoria(ui64 necesario, const TexturaStreaming* excepto = nullptr) {
+                Streaming& s = gl.streaming;
+                while (s.residente + necesario > s.presupuesto) {
+                    TexturaStreaming* candidata = nullptr;
+                    for (auto& [n, t] : s.texturas) {
+                        if (&t == excepto or t.base >= t.inicial)
+                            continue;
+                        if (t.ultimo_uso == s.frame and t.base >= t.deseado)
+                            continue;
+                        if (not candidata or t.ultimo_uso < candidata->ultimo_uso)
+                            candidata = &t;
+                    }
+                    if (not candidata)
+                        return false;
+                    expulsar(*candidata);
+                }
+                return true;
+            }
+        }
+
+        // Cargar una textura KTX con streaming
+        // Solo se suben los niveles de tamaño menor o igual a tam_inicial, el resto se cargan según se vayan pidiendo
+        inline void cargar(str ruta, ui32 tam_inicial = 64) {
+            auto bytes = tofu::detail::leerBinario(ruta);
+            if (not bytes) {
+                log::error("No se pudo cargar la textura {}", ruta);
+                std::exit(-1);
+            }
+
+            TexturaStreaming t { .archivo = std::move(*bytes) };
+            ktx::Cabecera cab;
+            std::vector<ktx::Nivel> niveles;
+            if (not ktx::leer(t.archivo.datos, t.archivo.tam, cab, niveles)) {
+                log::error("El archivo {} no es una textura KTX válida", ruta);
+                std::exit(-1);
+            }
+            ui32 num = niveles.size();
+
+            // Formato y tipo de textura
+            t.formato = cab.gl_type == 0 ? cab.gl_internal_format : GL_RGBA8;
+            t.capas = std::max(cab.capas, 1u);
+            ui32 target = cab.capas > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+            bool nativo = cab.gl_type != 0 or textura::formatoSoportado(cab.gl_internal_format);
+            if (not nativo)
+                log::warn("El formato de {} no está soportado, se descomprime a RGBA8", ruta);
+
+            // Niveles que vamos a cargar
+            // Los niveles mayores que GL_MAX_TEXTURE_SIZE no se cargan nunca
+            auto tam = [&](ui32 l) { return std::max(niveles[l].ancho, niveles[l].alto); };
+            t.minimo = 0;
+            while (t.minimo + 1 < num and tam(t.minimo) > gl.max_tex_size)
+                t.minimo++;
+            t.inicial = t.minimo;
+            while (t.inicial + 1 < num and tam(t.inicial) > tam_inicial)
+                t.inicial++;
+            t.base = num;
+            t.deseado = t.inicial;
+            t.ultimo_uso = gl.streaming.frame;
+            t.bytes.resize(num, 0);
+
+            t.textura = textura::crear(target, nativo ? t.formato : GL_RGBA8, 0, 0, glm::ivec2(cab.ancho, cab.alto));
+            Textura& tex = gl.texturas[t.textura];
+            gl.imagenes[ruta] = t.textura;
+
+            tex.sampler = sampler::obtener(num > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            textura::detail::vincularCarga(tex);
+            glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, num - 1);
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, num - 1);
+            debug::gl();
+
+            // Subimos los niveles iniciales, del más pequeño al más grande
+            TexturaStreaming& ts = gl.streaming.texturas[ruta] = std::move(t);
+            while (ts.base > ts.inicial)
+                detail::subir(ts);
+
+            log::info("Textura {}: {} de {} niveles cargados, {} KiB en la GPU", ruta, num - ts.base, num, gl.streaming.residente / 1024);
+        }
+
+        // Indicar el tamaño máximo en píxeles con el que se va a ver la textura este frame
+        // Si se pide varias veces en el mismo frame (por ejemplo, una por material de un array) se queda con el mayor
+        inline void pedir(const str& ruta, float pixeles) {
+            auto it = gl.streaming.texturas.find(ruta);
+            if (it == gl.streaming.texturas.end()) {
+                log::warn("La textura {} no se ha cargado con streaming", ruta);
+                return;
+            }
+            TexturaStreaming& t = it->second;
+
+            // Nivel más pequeño que sigue teniendo al menos un texel por píxel
+            ui32 num = t.bytes.size();
+            float tam = std::max(gl.texturas[t.textura].tam.x, gl.texturas[t.textura].tam.y);
+            int l = (int)std::floor(std::log2(tam / std::max(pixeles, 1.f)));
+            ui32 nivel = (ui32)std::clamp(l, (int)t.minimo, (int)num - 1);
+
+            t.deseado = (t.ultimo_uso == gl.streaming.frame) ? std::min(t.deseado, nivel) : nivel;
+            t.ultimo_uso = gl.streaming.frame;
+        }
+
+        // Subir los niveles pendientes respetando el presupuesto
+        // Se llama una vez por frame desde tofu::update(), antes de que la aplicación pida las texturas del frame actual
+        inline void actualizar() {
+            Streaming& s = gl.streaming;
+            if (s.texturas.empty())
+                return;
+
+            // Recortamos las texturas que no se usan si nos hemos pasado (por ejemplo, al reducir el presupuesto)
+            detail::liberarMemoria(0);
+
+            // Subimos niveles hasta llegar al límite por frame, empezando por las texturas a las que les faltan más
+            ui64 subido = 0;
+            while (subido < s.por_frame) {
+                TexturaStreaming* t = nullptr;
+                for (auto& [n, x] : s.texturas)
+                    if (x.ultimo_uso == s.frame and x.deseado < x.base)
+                        if (not t or x.base - x.deseado > t->base - t->deseado)
+                            t = &x;
+                if (not t)
+                    break;
+
+                ui64 bytes = detail::bytesNivel(*t, detail::niveles(*t)[t->base - 1]);
+                if (not detail::liberarMemoria(bytes, t))
+                    break;
+                detail::subir(*t);
+                subido += bytes;
+            }
+
+            s.frame++;
+        }
+
+        // Eliminar una textura cargada con streaming
+        inline void liberar(str ruta) {
+            auto it = gl.streaming.texturas.find(ruta);
+            if (it == gl.streaming.texturas.end())
+                return;
+            for (ui64 b : it->second.bytes)
+                gl.streaming.residente -= b;
+            gl.streaming.texturas.erase(it);
+            textura::liberar(ruta);
+        }
+    }
+}
@@ -4,16 +4,20 @@
 #include <stdint.h>
 #include <string>
 #include <cstdlib>
+#include <cstdio>
 #include <ctime>
 
 #include <array>
 #include <vector>
 #include <map>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <functional>
 #include <numeric>
 #include <memory>
+#include <type_traits>
 
 #ifdef EMSCRIPTEN
     #include <emscripten.h>
@@ -30,6 +34,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "paquete.h"
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -47,6 +53,92 @@ namespace tofu
 
     using update_fun_t = std::function<void()>;
 
+    // Identificadores de recursos
+    // Los nombres de shaders, geometrías, VAOs y uniforms se convierten en un hash de 64 bits (FNV-1a),
+    // así en cada frame solo se comparan enteros y no se crea ningún string
+    // Con un literal ("planetas"_id) el hash se calcula al compilar. Desde un str se guarda una copia en la tabla
+    // de nombres internados la primera vez, para que el texto siga siendo válido aunque el str se destruya
+    constexpr ui64 fnv1a(const char* s, size_t n) {
+        ui64 h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < n; i++) {
+            h ^= (ui8)s[i];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+    constexpr size_t longitud(const char* s) {
+        size_t n = 0;
+        while (s[n] != '\0')
+            n++;
+        return n;
+    }
+
+    // Tabla de nombres internados (hash -> texto)
+    inline std::unordered_map<ui64, str> nombres_internados;
+
+    // Guardar una copia del nombre si no existía y devolver su texto
+    // Dos nombres distintos con el mismo hash no se pueden distinguir, así que es un error
+    inline const char* internar(ui64 hash, const char* s, size_t n) {
+        auto [it, nuevo] = nombres_internados.try_emplace(hash, s, n);
+        if (not nuevo and it->second.compare(0, str::npos, s, n) != 0) {
+            std::fprintf(stderr, "[ERR]: Colisión de identificadores entre '%s' y '%.*s'\n", it->second.c_str(), (int)n, s);
+            std::exit(-1);
+        }
+        return it->second.c_str();
+    }
+
+    struct Id {
+        ui64 hash = fnv1a("", 0);
+        const char* texto = "";     // Nombre original, para los mensajes y glGetUniformLocation
+
+        constexpr Id() = default;
+        constexpr Id(const char* s) : hash(fnv1a(s, longitud(s))), texto(s) {}
+        constexpr Id(const char* s, size_t n) : hash(fnv1a(s, n)), texto(s) {}
+        Id(const str& s) : hash(fnv1a(s.data(), s.size())), texto(internar(hash, s.data(), s.size())) {}
+
+        constexpr bool vacio() const { return texto[0] == '\0'; }
+        constexpr bool operator==(const Id& o) const { return hash == o.hash; }
+        constexpr bool operator!=(const Id& o) const { return hash != o.hash; }
+        constexpr bool operator<(const Id& o) const { return hash < o.hash; }
+    };
+
+    // Copia del identificador que apunta a la tabla de nombres, para guardarlo como clave
+    // Un Id creado desde un const char* no es dueño de su texto, que podría no vivir tanto como el recurso
+    inline Id internar(Id id) {
+        id.texto = internar(id.hash, id.texto, longitud(id.texto));
+        return id;
+    }
+
+    constexpr Id operator""_id(const char* s, size_t n) { return Id(s, n); }
+
+    // Identificadores con tipo, para no poder pasar el nombre de una geometría donde se espera una shader
+    // Se construyen desde un Id, un literal o un str, pero no desde un identificador de otro tipo
+    template <typename T>
+    struct Handle : Id {
+        using Id::Id;
+        constexpr Handle() = default;
+        template <typename U, std::enable_if_t<std::is_same_v<U, Id>, int> = 0>
+        constexpr Handle(U id) : Id(id) {}
+    };
+    using ShaderId = Handle<struct ShaderTag>;
+    using GeomId = Handle<struct GeomTag>;
+    using VaoId = Handle<struct VaoTag>;
+    using ConsultaId = Handle<struct ConsultaTag>;
+}
+
+// Los identificadores ya son un hash, se usan tal cual en los mapas
+template <>
+struct std::hash<tofu::Id> {
+    size_t operator()(const tofu::Id& id) const noexcept { return id.hash; }
+};
+template <typename T>
+struct std::hash<tofu::Handle<T>> {
+    size_t operator()(const tofu::Handle<T>& id) const noexcept { return id.hash; }
+};
+
+namespace tofu
+{
+
     // Estructura de un shader
     struct OpcionesShader {
         bool blend = true;
@@ -55,10 +147,34 @@ namespace tofu
     };
     struct Shader {
         ui32 pid;
-        str vao;
+        VaoId vao;
         ui32 fbo;
-        std::unordered_map<str, ui32> uniforms;
+        std::unordered_map<Id, ui32> uniforms;
         OpcionesShader opt;
+
+        // Permutaciones (solo en la shader base, cargada desde un archivo)
+        str archivo;
+        std::vector<str> tf;
+        std::set<str> defines, defines_carga;
+        ShaderId activa;            // Permutación usada por última vez
+        bool cambiada = false;      // Han cambiado los defines desde que se eligió la permutación
+    };
+
+    // Programa enviado al driver que todavía no se ha comprobado
+    struct ProgramaPendiente {
+        ui32 pid;
+        std::vector<ui32> etapas;
+        double inicio;
+        ui64 clave = 0;         // Hash del código y del driver para la caché de binarios
+        bool binario = false;   // Se ha cargado de la caché sin compilar
+    };
+
+    // Caché de binarios de programas en disco
+    struct CacheShaders {
+        bool comprobada = false, activa = false;
+        ui64 driver = 0;        // Hash del fabricante, modelo y versión del driver
+        ui32 aciertos = 0, fallos = 0;
+        double ms_ahorrados = 0.0;
     };
 
     // Estructura de datos de entrada
@@ -83,6 +199,7 @@ namespace tofu
         ui32 modo;
         ui32 tam;
         ui32 bytes;
+        ui32 version = 0;   // Aumenta cada vez que cambia el almacenamiento (al redimensionar)
     };
     struct Textura {
         ui32 textura;
@@ -90,12 +207,90 @@ namespace tofu
         ui32 formato;
         ui32 tipo;
         glm::ivec2 tam;
+        ui32 sampler = 0;
+        ui32 buffer = 0, version = 0;   // Buffer conectado con glTexBuffer y su versión
     };
     struct TexBuffer {
         ui32 b;
         ui32 t;
     };
 
+    // Estado de una unidad de textura
+    struct UnidadTextura {
+        bool asignada = false;
+        ui32 target = 0;
+        ui32 textura = 0;
+        ui32 sampler = 0;
+    };
+
+    // Caché de imágenes indexada por el contenido de los archivos
+    struct ImagenCache {
+        ui32 textura;
+        ui32 refs;
+        ui64 bytes;
+    };
+    struct UbicacionImagen {
+        ui32 textura;
+        ui32 capa;
+    };
+    struct CacheImagenes {
+        std::unordered_map<ui64, ImagenCache> entradas;
+        std::unordered_map<ui64, UbicacionImagen> capas;
+        ui32 aciertos = 0, fallos = 0;
+        ui64 bytes_ahorrados = 0;
+    };
+
+    // Contenido de un archivo
+    // Si se ha leído de disco se guarda en memoria propia, si viene del paquete apunta directamente a la memoria mapeada
+    // Solo se puede mover, al copiarlo los datos apuntarían a la memoria del original
+    struct Archivo {
+        const ui8* datos = nullptr;
+        size_t tam = 0;
+        std::vector<ui8> propio;
+
+        Archivo() = default;
+        Archivo(const ui8* d, size_t t) : datos(d), tam(t) {}
+        Archivo(std::vector<ui8> v) : propio(std::move(v)) { datos = propio.data(); tam = propio.size(); }
+        Archivo(Archivo&&) = default;
+        Archivo& operator=(Archivo&&) = default;
+        Archivo(const Archivo&) = delete;
+        Archivo& operator=(const Archivo&) = delete;
+    };
+
+    // Archivo mapeado en memoria (solo lectura)
+    struct Mapeo {
+        const ui8* datos = nullptr;
+        size_t tam = 0;
+        void* objeto = nullptr;     // Objeto del mapeo en Windows
+    };
+
+    // Paquete de recursos mapeado en memoria (ver paquete.h)
+    struct Paquete {
+        Mapeo mapeo;
+        paquete::Indice indice;
+    };
+
+    // Texturas con niveles de mipmap que se cargan progresivamente
+    struct TexturaStreaming {
+        ui32 textura;
+        Archivo archivo;            // KTX completo (en memoria o en el paquete), del que se leen los niveles al subirlos
+        ui32 formato, capas;
+        ui32 base;                  // Nivel residente más fino
+        ui32 minimo;                // Nivel más fino que se puede cargar (limitado por GL_MAX_TEXTURE_SIZE)
+        ui32 inicial;               // Niveles que siempre están cargados (desde este hasta el último)
+        ui32 deseado;               // Nivel necesario según el tamaño en pantalla
+        ui64 ultimo_uso;            // Último frame en el que se pidió la textura
+        std::vector<ui64> bytes;    // Bytes que ocupa cada nivel en la GPU (0 si no está cargado)
+    };
+    struct Streaming {
+        std::unordered_map<str, TexturaStreaming> texturas;
+        ui64 presupuesto = 64 << 20;
+        ui64 por_frame = 4 << 20;
+        ui64 residente = 0;
+        ui64 frame = 0;
+        ui32 subidos = 0, expulsados = 0;
+    };
+
     // Framebuffers
     struct Framebuffer {
         ui32 fbo;
@@ -105,6 +300,76 @@ namespace tofu
         glm::vec4 clear;
     };
 
+    // Grafo de renderizado
+    // Los pasos declaran qué recursos leen y escriben, y el grafo decide el orden, qué pasos se pueden saltar
+    // y qué recursos temporales pueden compartir la misma textura
+    struct RecursoGrafo {
+        ui32 formato;
+        float escala = 1.f;
+        bool dinamico = false;          // Su tamaño se multiplica además por la escala de resolución dinámica
+        glm::vec4 clear = glm::vec4(0.f);
+        ui32 textura = 0;               // Textura física asignada al compilar (id en gl.texturas)
+        int primero = -1, ultimo = -1;  // Primer y último paso (en orden de ejecución) que lo usan
+    };
+    struct PasoGrafo {
+        str nombre;
+        std::vector<str> lee, escribe;
+        update_fun_t ejecutar;
+        std::function<bool()> activo;
+        ui32 fbo = 0;
+        glm::ivec2 tam;
+    };
+    struct Grafo {
+        std::map<str, RecursoGrafo> recursos;
+        std::vector<PasoGrafo> pasos;
+        std::vector<ui32> orden;
+        std::vector<ui32> fisicas;
+        std::vector<bool> activos, activos_frame;
+        glm::ivec2 tam = glm::ivec2(0);
+        float escala = 1.f;             // Escala de resolución dinámica con la que se compiló
+        bool compilado = false;
+        bool ejecutando = false;
+        ui64 ejecuciones = 0;           // Veces que se ha ejecutado, para saber si un resultado es del último frame
+        ui64 memoria_sin_alias = 0, memoria = 0;
+    };
+
+    // Resolución dinámica
+    // Los recursos dinámicos del grafo se dibujan a una fracción del tamaño de la ventana que se ajusta
+    // cada frame para mantener el tiempo de GPU por debajo del objetivo, y un último paso los escala a la pantalla
+    struct Resolucion {
+        bool activa = false;
+        float escala = 1.f;
+        float minima = 0.5f, maxima = 1.f;
+        float objetivo = 1000.f / 60.f;     // Tiempo de frame objetivo (ms)
+        float nitidez = 0.25f;              // 0 es bilineal, más alto realza los bordes al escalar
+        float tiempo = 0.f;                 // Tiempo medido y suavizado (ms)
+        double ultimo_cambio = 0.0;
+        double inicio_cpu = 0.0;
+    };
+
+    // Pirámide de profundidad (Hi-Z)
+    // Cada nivel guarda la profundidad más lejana de los 2x2 texels que cubre del anterior, así con cuatro lecturas
+    // se sabe si un rectángulo de la pantalla está tapado por completo
+    struct PiramideProfundidad {
+        int textura = -1;                   // Índice en gl.texturas (R32F con todos los niveles)
+        glm::ivec2 tam = glm::ivec2(0);
+        ui32 niveles = 0;
+        std::vector<ui32> fbos;             // Un framebuffer por nivel
+        glm::mat4 viewproj;                 // Cámara con la que se dibujó la profundidad
+        ui64 ejecucion = 0;                 // Ejecución del grafo en la que se construyó
+    };
+
+    // Consultas a la GPU (timer, transform feedback, oclusión...)
+    // Cada una rota entre varios objetos de OpenGL y solo lee los que ya tienen el resultado disponible,
+    // así nunca se espera a la GPU, a cambio de que el resultado llegue con uno o dos frames de retraso
+    struct Consulta {
+        ui32 tipo = 0;                      // GL_TIME_ELAPSED, GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, GL_ANY_SAMPLES_PASSED...
+        std::vector<ui32> ids;              // Anillo de consultas, crece si la GPU va más retrasada
+        ui32 primera = 0, pendientes = 0;   // La más antigua sin leer y cuántas hay emitidas sin leer
+        ui64 resultado = 0;                 // Último resultado disponible
+        bool valido = false, leido = false;
+    };
+
     // Posición relativa en el vector de vértices/indices
     struct Geometria {
         ui32 voff, vcount;
@@ -112,10 +377,42 @@ namespace tofu
         ui32 tipo_dibujo;
     };
 
+    // Rangos de índices de los clusters visibles para glMultiDrawElementsBaseVertex
+    // Se reutilizan entre frames para no reservar memoria al dibujar
+    struct RangosClusters {
+        std::vector<int> cuentas, bases;
+        std::vector<const void*> offsets;
+    };
+
+    // Datos comunes a todas las shaders en un frame
+    // Sigue el layout std140 del bloque "FrameData" de las shaders
+    struct FrameData {
+        glm::mat4 view;
+        glm::mat4 proj;
+        glm::mat4 viewproj;
+        glm::mat4 invviewproj;
+        glm::vec4 viewpos;
+        float time;
+        float dt;
+        glm::vec2 tam_win;
+        glm::vec2 tam_fb;
+        glm::vec2 _relleno;     // std140 redondea el tamaño del bloque a múltiplos de 16
+    };
+    static_assert(sizeof(FrameData) == 304, "FrameData tiene que coincidir con el layout std140");
+
+    // Punto de enlace fijo del bloque FrameData
+    inline const ui32 binding_frame = 0;
+
     // VAO
+    // Atributos por instancia leídos de otro buffer (glVertexAttribDivisor)
+    struct AtributosInstancia {
+        ui32 buffer;                    // Índice en gl.buffers
+        std::vector<ui32> atributos;    // Componentes de cada atributo, igual que los de vértice
+    };
     struct VAO {
         ui32 vao, vbo, ebo;
         std::vector<ui32> atributos;
+        std::vector<AtributosInstancia> por_instancia;
     };
 
     // Estructura de datos de OpenGL
@@ -123,25 +420,58 @@ namespace tofu
         GLFWwindow* win;
         glm::ivec2 tam_win, tam_fb;
         ui32 max_tex_size;
+        std::unordered_set<str> extensiones;
 
         Input io;
         bool raton_conectado = true;
 
-        std::unordered_map<str, VAO> VAOs;
+        std::unordered_map<VaoId, VAO> VAOs;
         int instancia_base = 0;
 
-        str shader_actual = "";
-        std::unordered_map<str, Shader> shaders;
-        std::unordered_map<str, Geometria> geometrias;
+        ShaderId shader_actual;
+        std::unordered_map<ShaderId, Shader> shaders;
+        std::map<ShaderId, ProgramaPendiente> shaders_pendientes;
+        bool lote_shaders = false, compilacion_paralela = false;
+        CacheShaders cache_shaders;
+        std::unordered_map<GeomId, Geometria> geometrias;
+        std::unordered_map<GeomId, std::vector<Cluster>> clusters;
+        RangosClusters rangos_clusters;
 
         std::unordered_map<ui32, Buffer> buffers;
+        int buffer_ceros = -1;
         std::map<ui32, Textura> texturas;
+        std::vector<UnidadTextura> unidades;
+        std::unordered_map<ui32, ui32> unidad_textura;
+        ui32 unidad_activa = 0;
+        std::unordered_map<ui64, ui32> samplers;
         std::unordered_map<str, ui32> imagenes;
+        CacheImagenes cache_imagenes;
+        Streaming streaming;
+        Paquete paquete;
         std::unordered_map<ui32, Framebuffer> framebuffers;
+        Grafo grafo;
+        Resolucion resolucion;
+        PiramideProfundidad hiz;
+        std::unordered_map<ConsultaId, Consulta> consultas;
 
         glm::mat4 view;
         glm::mat4 proj;
+
+        ui32 ubo_frame;
+        FrameData frame;
+        bool frame_pendiente = true;
     } gl;
 
     inline double t, dt;
+
+    // Comprobar si el driver soporta una extensión (la lista se obtiene la primera vez)
+    inline bool extension(const str& nombre) {
+        if (gl.extensiones.empty()) {
+            int n;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+            for (int i = 0; i < n; i++)
+                gl.extensiones.insert((const char*)glGetStringi(GL_EXTENSIONS, i));
+        }
+        return gl.extensiones.count(nombre) > 0;
+    }
 }
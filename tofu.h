@@ -10,11 +10,23 @@
 // Librerías principales
 
 #include "tipos.h"
+#include "hash.h"
 #include "debug.h"
+#include "archivos.h"
 #include "window.h"
 #include "input.h"
 #include "core.h"
 #include "shaders.h"
 #include "buffers.h"
+#include "visibilidad.h"
+#include "oclusores.h"
+#include "bvh.h"
+#include "jerarquia.h"
+#include "streaming.h"
+#include "grafo.h"
+#include "consultas.h"
+#include "resolucion.h"
+#include "hiz.h"
 #include "geometria.h"
+#include "modelos.h"
 #include "gui.h"
@@ -0,0 +1,116 @@
+// Unidades de textura y samplers
+// Cada recurso recibe una unidad fija la primera vez que se vincula, y guardamos qué hay en cada unidad
+// para no repetir glActiveTexture, glBindTexture ni glBindSampler si no ha cambiado nada
+// El filtrado y el modo de repetición se guardan en sampler objects compartidos en vez de en cada textura
+#pragma once
+
+#include "debug.h"
+#include "hash.h"
+
+namespace tofu
+{
+    namespace sampler
+    {
+        // Obtener un sampler con estos parámetros (se crea solo la primera vez)
+        inline ui32 obtener(ui32 min, ui32 mag = GL_LINEAR, ui32 wrap = GL_CLAMP_TO_EDGE) {
+            ui64 clave = hash::combinar(hash::combinar(min, mag), wrap);
+            auto it = gl.samplers.find(clave);
+            if (it != gl.samplers.end())
+                return it->second;
+
+            ui32 s;
+            glGenSamplers(1, &s);
+            glSamplerParameteri(s, GL_TEXTURE_MIN_FILTER, min);
+            glSamplerParameteri(s, GL_TEXTURE_MAG_FILTER, mag);
+            glSamplerParameteri(s, GL_TEXTURE_WRAP_S, wrap);
+            glSamplerParameteri(s, GL_TEXTURE_WRAP_T, wrap);
+            glSamplerParameteri(s, GL_TEXTURE_WRAP_R, wrap);
+            debug::gl();
+
+            gl.samplers[clave] = s;
+            return s;
+        }
+    }
+
+    namespace textura
+    {
+        // La unidad 0 se reserva para crear y modificar texturas, así las cargas nunca pisan a los recursos asignados
+        inline const ui32 unidad_carga = 0;
+
+        namespace detail
+        {
+            inline void activar(ui32 unidad) {
+                if (gl.unidad_activa == unidad)
+                    return;
+                glActiveTexture(GL_TEXTURE0 + unidad);
+                gl.unidad_activa = unidad;
+            }
+
+            // Vincular una textura y un sampler a una unidad, solo si no lo estaban ya
+            inline void vincular(ui32 unidad, const Textura& tex, ui32 sampler) {
+                UnidadTextura& u = gl.unidades[unidad];
+                if (u.target != tex.target or u.textura != tex.textura) {
+                    activar(unidad);
+                    glBindTexture(tex.target, tex.textura);
+                    u.target = tex.target;
+                    u.textura = tex.textura;
+                    #ifdef DEBUG
+                    debug::num_vinculos++;
+                    #endif
+                }
+                if (u.sampler != sampler) {
+                    glBindSampler(unidad, sampler);
+                    u.sampler = sampler;
+                }
+            }
+
+            // Vincular una textura en la unidad de carga para crearla o modificarla
+            inline void vincularCarga(const Textura& tex) {
+                vincular(unidad_carga, tex, 0);
+                activar(unidad_carga);
+            }
+
+            // Olvidar una textura antes de eliminarla (OpenGL la desvincula y puede reutilizar su nombre)
+            inline void olvidar(ui32 nombre) {
+                for (auto& u : gl.unidades)
+                    if (u.textura == nombre)
+                        u.target = u.textura = 0;
+            }
+        }
+
+        // Unidad asignada a una textura, se reserva la primera vez que se pide
+        inline ui32 unidad(ui32 tex_id) {
+            auto it = gl.unidad_textura.find(tex_id);
+            if (it != gl.unidad_textura.end())
+                return it->second;
+
+            for (ui32 i = unidad_carga + 1; i < gl.unidades.size(); i++) {
+                if (gl.unidades[i].asignada)
+                    continue;
+                gl.unidades[i].asignada = true;
+                gl.unidad_textura[tex_id] = i;
+                return i;
+            }
+            log::error("No quedan unidades de textura libres (máximo {})", gl.unidades.size());
+            std::exit(-1);
+        }
+
+        // Vincular una textura a su unidad con su sampler
+        // Devuelve la unidad para asignarla al uniform del sampler en la shader
+        inline int vincular(ui32 tex_id) {
+            Textura& tex = gl.texturas[tex_id];
+            ui32 u = unidad(tex_id);
+            detail::vincular(u, tex, tex.sampler);
+            return u;
+        }
+
+        // Devolver la unidad de una textura que se va a eliminar
+        inline void liberarUnidad(ui32 tex_id) {
+            auto it = gl.unidad_textura.find(tex_id);
+            if (it == gl.unidad_textura.end())
+                return;
+            gl.unidades[it->second] = {};
+            gl.unidad_textura.erase(it);
+        }
+    }
+}
@@ -0,0 +1,195 @@
+// Visibilidad de instancias en la CPU (frustum culling)
+// Las esferas envolventes se guardan por componentes (SoA) para comprobar 8 a la vez con AVX2 (compilando con -mavx2),
+// 4 con SSE (siempre disponible en x86-64), o una a una en el resto de plataformas
+// El resultado es la lista compacta de índices visibles, que se sube con buffer::reemplazar a un buffer que cambia cada frame
+// y la shader lee con texelFetch(visibles, gl_InstanceID)
+// Es una alternativa al culling con transform feedback: no hay que esperar a la GPU para saber cuántas instancias dibujar
+#pragma once
+
+#include <thread>
+#include <array>
+
+#if defined(__AVX2__) or defined(__SSE2__) or defined(_M_X64)
+    #include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+#include "buffers.h"
+
+namespace tofu
+{
+    namespace visibilidad
+    {
+        // Esferas envolventes (centro y radio) en arrays separados
+        struct Esferas {
+            std::vector<float> x, y, z, r;
+        };
+
+        // Planos del frustum (normal hacia dentro y distancia), normalizados para poder compararlos con el radio
+        using Planos = std::array<glm::vec4, 6>;
+
+        // Cada hilo se encarga de al menos este número de esferas, con menos no compensa crearlo
+        constexpr ui32 min_por_hilo = 1 << 14;
+
+        inline void insertar(Esferas& e, glm::vec3 centro, float radio) {
+            e.x.push_back(centro.x);
+            e.y.push_back(centro.y);
+            e.z.push_back(centro.z);
+            e.r.push_back(radio);
+        }
+
+        // Sacar los planos de las filas de una matriz de proyección (Gribb-Hartmann)
+        // Con viewproj quedan en el espacio del mundo, con viewproj * modelo en el del modelo
+        inline Planos planos(const glm::mat4& m) {
+            Planos p;
+            glm::vec4 w = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+            for (ui32 i = 0; i < 6; i++) {
+                glm::vec4 fila = glm::vec4(m[0][i / 2], m[1][i / 2], m[2][i / 2], m[3][i / 2]);
+                p[i] = i % 2 == 0 ? w + fila : w - fila;
+                p[i] /= glm::length(glm::vec3(p[i]));
+            }
+            return p;
+        }
+
+        namespace detail
+        {
+            // Hilos a usar para un trabajo, con al menos minimo elementos cada uno (pedidos = 0 usa todos los disponibles)
+            inline ui32 hilos(ui32 pedidos, ui32 trabajo, ui32 minimo) {
+                #ifdef EMSCRIPTEN
+                return 1;
+                #else
+                if (pedidos == 0)
+                    pedidos = std::max(1u, std::thread::hardware_concurrency());
+                return std::clamp<ui32>(trabajo / minimo, 1, pedidos);
+                #endif
+            }
+
+            // Llamar a fn(h) desde cada hilo, el primero en el hilo actual
+            template <typename F>
+            inline void repartir(ui32 hilos, F&& fn) {
+                std::vector<std::thread> trabajo;
+                for (ui32 h = 1; h < hilos; h++)
+                    trabajo.emplace_back(fn, h);
+                fn(0);
+                for (auto& t : trabajo)
+                    t.join();
+            }
+
+            // Compactar una lista de n elementos por trozos seguidos, uno por hilo
+            // fn(ini, fin) deja los que quedan de su trozo en lista a partir de ini y devuelve cuántos son
+            // Después se juntan los trozos en orden, cada uno empieza donde acaba el anterior
+            // Los trozos son múltiplos de alineacion, para que solo el último tenga elementos sueltos
+            template <typename F>
+            inline ui32 compactar(std::vector<ui32>& lista, ui32 n, ui32 hilos, ui32 alineacion, F&& fn) {
+                if (hilos <= 1)
+                    return fn(0, n);
+
+                ui32 trozo = ((n + hilos - 1) / hilos + alineacion - 1) / alineacion * alineacion;
+                std::vector<ui32> num(hilos, 0);
+                repartir(hilos, [&](ui32 h) {
+                    ui32 ini = std::min(h * trozo, n), fin = std::min(ini + trozo, n);
+                    num[h] = fn(ini, fin);
+                });
+
+                ui32 total = num[0];
+                for (ui32 h = 1; h < hilos; h++) {
+                    std::copy_n(lista.begin() + std::min(h * trozo, n), num[h], lista.begin() + total);
+                    total += num[h];
+                }
+                return total;
+            }
+
+            inline ui32 bitBajo(ui32 m) {
+                #ifdef _MSC_VER
+                unsigned long i;
+                _BitScanForward(&i, m);
+                return i;
+                #else
+                return __builtin_ctz(m);
+                #endif
+            }
+
+            // Guardar los índices de los bits activos de una máscara
+            inline ui32 compactar(ui32 mascara, ui32 base, ui32* visibles) {
+                ui32 n = 0;
+                while (mascara) {
+                    visibles[n++] = base + bitBajo(mascara);
+                    mascara &= mascara - 1;
+                }
+                return n;
+            }
+
+            // Comprobar las esferas [ini, fin) y escribir las visibles seguidas en visibles
+            inline ui32 frustumRango(const Esferas& e, const Planos& p, ui32 ini, ui32 fin, ui32* visibles) {
+                ui32 n = 0, i = ini;
+
+                #if defined(__AVX2__)
+                __m256 px[6], py[6], pz[6], pw[6];
+                for (ui32 k = 0; k < 6; k++) {
+                    px[k] = _mm256_set1_ps(p[k].x); py[k] = _mm256_set1_ps(p[k].y);
+                    pz[k] = _mm256_set1_ps(p[k].z); pw[k] = _mm256_set1_ps(p[k].w);
+                }
+                for (; i + 8 <= fin; i += 8) {
+                    __m256 x = _mm256_loadu_ps(&e.x[i]), y = _mm256_loadu_ps(&e.y[i]), z = _mm256_loadu_ps(&e.z[i]);
+                    __m256 r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&e.r[i]));
+                    __m256 dentro = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                    for (ui32 k = 0; k < 6; k++) {
+                        #ifdef __FMA__
+                        __m256 d = _mm256_fmadd_ps(px[k], x, _mm256_fmadd_ps(py[k], y, _mm256_fmadd_ps(pz[k], z, pw[k])));
+                        #else
+                        __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[k], x), _mm256_mul_ps(py[k], y)), _mm256_add_ps(_mm256_mul_ps(pz[k], z), pw[k]));
+                        #endif
+                        dentro = _mm256_and_ps(dentro, _mm256_cmp_ps(d, r, _CMP_GE_OQ));
+                    }
+                    n += compactar(_mm256_movemask_ps(dentro), i, visibles + n);
+                }
+                #elif defined(__SSE2__) or defined(_M_X64)
+                __m128 px[6], py[6], pz[6], pw[6];
+                for (ui32 k = 0; k < 6; k++) {
+                    px[k] = _mm_set1_ps(p[k].x); py[k] = _mm_set1_ps(p[k].y);
+                    pz[k] = _mm_set1_ps(p[k].z); pw[k] = _mm_set1_ps(p[k].w);
+                }
+                for (; i + 4 <= fin; i += 4) {
+                    __m128 x = _mm_loadu_ps(&e.x[i]), y = _mm_loadu_ps(&e.y[i]), z = _mm_loadu_ps(&e.z[i]);
+                    __m128 r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&e.r[i]));
+                    __m128 dentro = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (ui32 k = 0; k < 6; k++) {
+                        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[k], x), _mm_mul_ps(py[k], y)), _mm_add_ps(_mm_mul_ps(pz[k], z), pw[k]));
+                        dentro = _mm_and_ps(dentro, _mm_cmpge_ps(d, r));
+                    }
+                    n += compactar(_mm_movemask_ps(dentro), i, visibles + n);
+                }
+                #endif
+
+                // Las que quedan (o todas, si no hay SIMD)
+                for (; i < fin; i++) {
+                    bool dentro = true;
+                    for (ui32 k = 0; k < 6; k++)
+                        dentro &= p[k].x * e.x[i] + p[k].y * e.y[i] + p[k].z * e.z[i] + p[k].w >= -e.r[i];
+                    visibles[n] = i;
+                    n += dentro;
+                }
+                return n;
+            }
+        }
+
+        // Calcular las esferas visibles desde una cámara
+        // Los índices de las visibles quedan en orden al principio de visibles, que se reutiliza entre frames
+        // Con muchas esferas se reparten entre varios hilos por trozos seguidos, que luego se juntan
+        // hilos = 0 usa todos los disponibles
+        inline ui32 frustum(const Esferas& e, const glm::mat4& viewproj, std::vector<ui32>& visibles, ui32 hilos = 0) {
+            ui32 n = e.x.size();
+            Planos p = planos(viewproj);
+            if (visibles.size() < n)
+                visibles.resize(n);
+
+            // Trozos múltiplos de 8 para que solo el último tenga esferas sueltas
+            hilos = detail::hilos(hilos, n, min_por_hilo);
+            return detail::compactar(visibles, n, hilos, 8, [&](ui32 ini, ui32 fin) {
+                return detail::frustumRango(e, p, ini, fin, visibles.data() + ini);
+            });
+        }
+    }
+}
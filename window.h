@@ -74,11 +74,5 @@ namespace tofu
             else if (fb.tam.x == tam_fb_ant.x and fb.tam.y == tam_fb_ant.y)
                 framebuffer::redimensionar(id, gl.tam_fb);
         }
-
-        // Actualizar el tamaño de la ventana en la shader deferred
-        if (gl.shaders.count("deferred")) {
-            shader::usar("deferred");
-            shader::uniform("tam_win", glm::vec2(gl.tam_win));
-        }
     }
 }